@@ -1,15 +1,27 @@
 <?php
-    if ($_GET["get"] == "img") {
-        $pic = "/tmp/motdecimg.bmp";
+    if ($_GET["get"] == "img" || $_GET["get"] == "segmap") {
+        //load info to find the running motdec
+        $xml = simplexml_load_file("/tmp/motdec.info");
+        
+        //motdec publishes the live view in shared memory, 'snapshot' copies it out
+        $what = $_GET["get"] == "img" ? "frame" : "segmap";
+        $pic = shell_exec(escapeshellarg($xml->bin) . " snapshot " . $what);
     
         //set header values for mime type and no cache
         header("Content-Type: image/bmp");
-        header("Content-Length: ".filesize($pic));
+        header("Content-Length: ".strlen($pic));
         header("Cache-Control: no-cache, no-store, max-age=0, must-revalidate");
         header("Pragma: no-cache");
         
-        //Read the image and send it directly to the output.
-        echo readfile($pic);
+        //send the image directly to the output.
+        echo $pic;
+    } else if ($_GET["get"] == "stats") {
+        //load info to find the running motdec
+        $xml = simplexml_load_file("/tmp/motdec.info");
+        
+        header("Content-Type: text/xml");
+        header("Cache-Control: no-cache, no-store, max-age=0, must-revalidate");
+        echo shell_exec(escapeshellarg($xml->bin) . " snapshot stats");
     } else if ($_GET["get"] == "running") {
         //path to info file
         $inf = "/tmp/motdec.info";
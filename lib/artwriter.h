@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// ----------
+// STRUCTURES
+// ----------
+
+//an image waiting to be saved, the writer owns img until it is written
+struct ArtifactJob {
+    struct BMP *img;
+    char path[256];
+};
+
+//writes event images on its own thread so the detector never waits on storage
+//jobs sit in a bounded queue, when it is full new jobs are dropped rather than blocking
+struct ArtifactWriter {
+    struct ArtifactJob *jobs;
+    int capacity;
+    int mapped;               //images are saved through mmap instead of stdio
+    int head;                 //next job to write
+    int count;                //jobs waiting
+    int stopping;
+    int running;              //thread hasn't been joined yet
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    unsigned long queued;     //jobs accepted
+    unsigned long written;    //images saved
+    unsigned long dropped;    //jobs refused because the queue was full
+    unsigned long failed;     //images that couldn't be saved
+    int peak_count;           //most jobs ever waiting at once
+    double max_write_time;    //slowest save, seconds
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct ArtifactWriter *init_artifact_writer(int capacity,
+                                           int mapped);
+
+void stop_artifact_writer(struct ArtifactWriter *aw);
+
+void free_artifact_writer(struct ArtifactWriter *aw);
+
+int submit_artifact(struct ArtifactWriter *aw,
+                    struct BMP *img,
+                    char *path);
+
+void *do_artifact_writes(void *arg);
+
+int make_parent_dirs(char *path);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates the writer and starts its thread, mapped saves with save_BMP_mapped
+//returns NULL on error
+struct ArtifactWriter *init_artifact_writer(int capacity,
+                                           int mapped) {
+    struct ArtifactWriter *aw;
+
+    aw = calloc(sizeof(struct ArtifactWriter), 1);
+    if (!aw)
+        return NULL;
+
+    aw->jobs = calloc(capacity, sizeof(struct ArtifactJob));
+    if (!aw->jobs) {
+        free(aw);
+        return NULL;
+    }
+    aw->capacity = capacity;
+    aw->mapped = mapped;
+    pthread_mutex_init(&aw->lock, NULL);
+    pthread_cond_init(&aw->cond, NULL);
+
+    if (pthread_create(&aw->thread, NULL, do_artifact_writes, aw) != 0) {
+        pthread_mutex_destroy(&aw->lock);
+        pthread_cond_destroy(&aw->cond);
+        free(aw->jobs);
+        free(aw);
+        return NULL;
+    }
+    aw->running = 1;
+
+    return aw;
+}
+
+//writes everything still queued and stops the thread, stats stay readable
+//new jobs are dropped from here on
+void stop_artifact_writer(struct ArtifactWriter *aw) {
+    if (!aw->running)
+        return;
+
+    pthread_mutex_lock(&aw->lock);
+    aw->stopping = 1;
+    pthread_cond_signal(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+
+    //thread drains the queue before it exits
+    pthread_join(aw->thread, NULL);
+    aw->running = 0;
+}
+
+//stops the writer, if still running, and frees it
+void free_artifact_writer(struct ArtifactWriter *aw) {
+    if (!aw)
+        return;
+
+    stop_artifact_writer(aw);
+
+    pthread_mutex_destroy(&aw->lock);
+    pthread_cond_destroy(&aw->cond);
+    free(aw->jobs);
+    free(aw);
+}
+
+//queues img to be saved at path, creating any missing directories
+//the writer takes ownership of img and frees it, even if the job is dropped
+//returns 1 if queued, 0 if dropped because the queue is full
+int submit_artifact(struct ArtifactWriter *aw,
+                    struct BMP *img,
+                    char *path) {
+    struct ArtifactJob *job;
+
+    if (!img)
+        return 0;
+
+    pthread_mutex_lock(&aw->lock);
+    if (aw->count == aw->capacity || aw->stopping) {
+        aw->dropped++;
+        pthread_mutex_unlock(&aw->lock);
+        free_BMP(img);
+        return 0;
+    }
+
+    job = &aw->jobs[(aw->head + aw->count) % aw->capacity];
+    job->img = img;
+    strncpy(job->path, path, sizeof(job->path) - 1);
+    job->path[sizeof(job->path) - 1] = '\0';
+    aw->count++;
+    aw->queued++;
+    if (aw->count > aw->peak_count)
+        aw->peak_count = aw->count;
+
+    pthread_cond_signal(&aw->cond);
+    pthread_mutex_unlock(&aw->lock);
+    return 1;
+}
+
+//writer thread, saves queued images until stopped and the queue is empty
+void *do_artifact_writes(void *arg) {
+    struct ArtifactWriter *aw = arg;
+    struct ArtifactJob job;
+    double start, elapsed;
+    int ok;
+
+    pthread_mutex_lock(&aw->lock);
+    while (1) {
+        while (aw->count == 0 && !aw->stopping)
+            pthread_cond_wait(&aw->cond, &aw->lock);
+        if (aw->count == 0)
+            break;
+
+        //take the job off the queue, write it without the lock
+        job = aw->jobs[aw->head];
+        aw->head = (aw->head + 1) % aw->capacity;
+        aw->count--;
+        pthread_mutex_unlock(&aw->lock);
+
+        start = get_monotonic_time();
+        ok = make_parent_dirs(job.path)
+            && (aw->mapped ? save_BMP_mapped(job.img, job.path) : save_BMP(job.img, job.path));
+        elapsed = get_monotonic_time() - start;
+        free_BMP(job.img);
+
+        pthread_mutex_lock(&aw->lock);
+        if (ok)
+            aw->written++;
+        else
+            aw->failed++;
+        if (elapsed > aw->max_write_time)
+            aw->max_write_time = elapsed;
+    }
+    pthread_mutex_unlock(&aw->lock);
+
+    return NULL;
+}
+
+//creates every missing directory above the file at path
+//returns 1 on success
+int make_parent_dirs(char *path) {
+    char dir[256];
+    char *c;
+
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+
+    //walk each separator, skipping a leading one
+    for (c = dir + 1; *c; c++) {
+        if (*c != '/')
+            continue;
+        *c = '\0';
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+            return 0;
+        *c = '/';
+    }
+    return 1;
+}
@@ -69,6 +69,21 @@ int set_pixel(struct BMP *bmp,
               int y,
               struct Pixel pixel);
 
+unsigned char *get_row(struct BMP *bmp,
+                       int y);
+
+unsigned char *next_row(struct BMP *bmp,
+                        unsigned char *row);
+
+unsigned char *get_span(struct BMP *bmp,
+                        int x,
+                        int y);
+
+struct Pixel read_pixel(unsigned char *span);
+
+void write_pixel(unsigned char *span,
+                 struct Pixel pixel);
+
 struct Pixel make_pixel(unsigned char r,
                         unsigned char g,
                         unsigned char b);
@@ -83,6 +98,11 @@ struct BMP *get_difference(struct BMP *b1,
 struct BMP *segment_BMP(struct BMP *img,
                         unsigned char threshold);
 
+long segment_difference_BMP(struct BMP *img,
+                            struct BMP *bg,
+                            unsigned char threshold,
+                            struct BMP *seg_map);
+
 struct BMP *clone_BMP(struct BMP *img);
 
 int pixels_match(struct Pixel p1,
@@ -276,6 +296,49 @@ int set_pixel(struct BMP *bmp,
     return 1;
 }
 
+//row and span access, for kernels that walk whole images
+//get_pixel and set_pixel work out the offset and check bounds for every pixel, these
+//leave that to the caller so loops can walk a row's bytes in order
+//rows are stored bottom-up, so y counts from the top as with get_pixel, and each row
+//holds width pixels of 3 bytes, blue, green then red
+
+//first pixel of row y, y must be within the image
+unsigned char *get_row(struct BMP *bmp,
+                       int y) {
+    return bmp->pixel_data + (size_t) (bmp->image_header->height - y - 1) * bmp->scanline_size;
+}
+
+//the row below row, for walking rows top to bottom
+unsigned char *next_row(struct BMP *bmp,
+                        unsigned char *row) {
+    return row - bmp->scanline_size;
+}
+
+//pixel x of row y, the start of a span running to the end of the row
+//x and y must be within the image
+unsigned char *get_span(struct BMP *bmp,
+                        int x,
+                        int y) {
+    return get_row(bmp, y) + 3 * x;
+}
+
+//the pixel at the start of span
+struct Pixel read_pixel(unsigned char *span) {
+    struct Pixel pixel;
+    pixel.blue  = span[0];
+    pixel.green = span[1];
+    pixel.red   = span[2];
+    return pixel;
+}
+
+//sets the pixel at the start of span
+void write_pixel(unsigned char *span,
+                 struct Pixel pixel) {
+    span[0] = pixel.blue;
+    span[1] = pixel.green;
+    span[2] = pixel.red;
+}
+
 //create pixel with given rgb values
 struct Pixel make_pixel(unsigned char r,
                         unsigned char g,
@@ -299,11 +362,15 @@ struct Pixel greyscale_pixel(struct Pixel p) {
 
 //convert BMP image to greyscale
 int greyscale_BMP(struct BMP *bmp) {
-    int x, y;
-    for (x=0; x<bmp->image_header->width; x++)
-        for (y=0; y<bmp->image_header->height; y++)
-            if (!set_pixel(bmp, x, y, greyscale_pixel(get_pixel(bmp, x, y))))
-                return 0;
+    struct PixelKernels *kern = get_pixel_kernels();
+    unsigned char *row;
+    int y;
+    //rows in the order they are stored, each pixel only depends on itself
+    row = bmp->pixel_data;
+    for (y=0; y<bmp->image_header->height; y++) {
+        kern->greyscale(row, bmp->image_header->width);
+        row += bmp->scanline_size;
+    }
     return 1;
 }
 
@@ -340,10 +407,7 @@ struct BMP *get_difference(struct BMP *b1,
     diff->pixel_data = malloc(pdSize);
     
     //write difference between b1 and b2 to diff's pixel_data
-    int i;
-    for (i=0; i<pdSize; i++) {
-        diff->pixel_data[i] = abs(b1->pixel_data[i] - b2->pixel_data[i]);
-    }
+    get_pixel_kernels()->difference(b1->pixel_data, b2->pixel_data, diff->pixel_data, pdSize);
 
     //write scanline_size to diff
     diff->scanline_size = get_scanline_size(b1->image_header->width);
@@ -359,22 +423,45 @@ struct BMP *get_difference(struct BMP *b1,
 struct BMP *segment_BMP(struct BMP *img,
                         unsigned char threshold) {
     struct BMP *segMap;
-    int i, max;
+    int max;
     
     max = get_scanline_size(img->image_header->width) * img->image_header->height;
     segMap = init_BMP(img->image_header->width, img->image_header->height);
     
-    for (i = 0; i < max; i++) {
-        if (img->pixel_data[i] > threshold) {
-            segMap->pixel_data[i] = 255;
-        } else {
-            segMap->pixel_data[i] = 0;
-        }
-    }
+    get_pixel_kernels()->threshold(img->pixel_data, segMap->pixel_data, max, threshold);
     
     return segMap;
 }
 
+//segment_BMP of the greyscaled difference between img and bg, in one pass over the
+//three images, with no difference image in between
+//seg_map must be the same size and may be img or bg
+//returns the number of foreground pixels, or -1 if the sizes differ
+long segment_difference_BMP(struct BMP *img,
+                            struct BMP *bg,
+                            unsigned char threshold,
+                            struct BMP *seg_map) {
+    struct PixelKernels *kern = get_pixel_kernels();
+    size_t offset;
+    long count;
+    int y;
+    
+    if (img->image_header->width != bg->image_header->width
+        || img->image_header->height != bg->image_header->height
+        || img->image_header->width != seg_map->image_header->width
+        || img->image_header->height != seg_map->image_header->height)
+        return -1;
+    
+    count = 0;
+    for (y=0; y<img->image_header->height; y++) {
+        offset = (size_t) y * img->scanline_size;
+        count += kern->segment_difference(img->pixel_data + offset, bg->pixel_data + offset,
+                                          seg_map->pixel_data + offset, img->image_header->width,
+                                          threshold);
+    }
+    return count;
+}
+
 //clones the given BMP image
 struct BMP *clone_BMP(struct BMP *img) {
     struct BMP *clone;
@@ -1,9 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
 
-#define NUM_THREADS 4
 
 // ----------
 // STRUCTURES
@@ -11,28 +9,46 @@
 
 struct JobGreyscale {
     struct BMP *bmp;
-    int step;
+    struct JobPart part;
 };
 
 struct JobDifference {
     struct BMP *b1;
     struct BMP *b2;
     struct BMP *diff;
-    int step;
+    struct JobPart part;
 };
 
 struct JobSegment {
     struct BMP *bmp;
     struct BMP *seg_map;
     unsigned char threshold;
-    int step;
+    struct JobPart part;
+};
+
+struct JobSegmentDifference {
+    struct BMP *img;
+    struct BMP *bg;
+    struct BMP *seg_map;
+    unsigned char threshold;
+    long count;
+    struct JobPart part;
+};
+
+//segmenting into a one channel map, either gray or mask is set
+struct JobSegmentPlane {
+    struct BMP *bmp;
+    struct Gray8 *gray;
+    struct Mask1 *mask;
+    unsigned char threshold;
+    struct JobPart part;
 };
 
 struct JobCount {
     struct BMP *img;
     struct Pixel p;
     long count;
-    int step;
+    struct JobPart part;
 };
 
 // ------------
@@ -47,6 +63,24 @@ struct BMP *get_difference_thr(struct BMP *b1,
 struct BMP *segment_BMP_thr(struct BMP *img,
                             unsigned char threshold);
 
+long segment_difference_BMP_thr(struct BMP *img,
+                                struct BMP *bg,
+                                unsigned char threshold,
+                                struct BMP *seg_map);
+
+int segment_BMP_gray8_thr(struct BMP *img,
+                          unsigned char threshold,
+                          struct Gray8 *seg_map);
+
+int segment_BMP_mask1_thr(struct BMP *img,
+                          unsigned char threshold,
+                          struct Mask1 *mask);
+
+int run_segment_plane_jobs(struct BMP *img,
+                           unsigned char threshold,
+                           struct Gray8 *gray,
+                           struct Mask1 *mask);
+
 long count_pixels_thr(struct BMP *img,
                      struct Pixel p);
 
@@ -58,24 +92,11 @@ void *do_job_difference(void *job_struct);
 
 void *do_job_segment(void *job_struct);
 
-void *do_job_count(void *job_struct);
-
-struct JobGreyscale *create_job_greyscale(struct BMP *bmp,
-                                          int step);
-
-struct JobDifference *create_job_difference(struct BMP *b1,
-                                            struct BMP *b2,
-                                            struct BMP *diff,
-                                            int step);
+void *do_job_segment_difference(void *job_struct);
 
-struct JobSegment *create_job_segment(struct BMP *b1,
-                                      struct BMP *seg_map,
-                                      unsigned char threshold,
-                                      int step);
+void *do_job_count(void *job_struct);
 
-struct JobCount *create_job_count(struct BMP *img,
-                                  struct Pixel p,
-                                  int step);
+void *do_job_segment_plane(void *job_struct);
 
 // ---------
 // FUNCTIONS
@@ -83,39 +104,16 @@ struct JobCount *create_job_count(struct BMP *img,
 
 //convert BMP image to greyscale
 int greyscale_BMP_thr(struct BMP *bmp) {
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobGreyscale *t1_job, *t2_job, *t3_job, *t4_job;
-                
-    //create jobs
-    t1_job = create_job_greyscale(bmp, 0);
-    t2_job = create_job_greyscale(bmp, 1);
-    t3_job = create_job_greyscale(bmp, 2);
-    t4_job = create_job_greyscale(bmp, 3);
-            
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_greyscale, t1_job) ||
-        pthread_create(&t2, NULL, do_job_greyscale, t2_job) ||
-        pthread_create(&t3, NULL, do_job_greyscale, t3_job) ||
-        pthread_create(&t4, NULL, do_job_greyscale, t4_job)) {
-        return 0;
-    }
-            
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return 0;
-    }
+    struct JobGreyscale jobs[MAX_BATCH_JOBS];
+    int i, steps;
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
+    steps = get_job_count(bmp->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].bmp = bmp;
+        get_job_part(i, steps, bmp->image_header->height, 0, &jobs[i].part);
+    }
     
-    return 1;
+    return parallel_for(do_job_greyscale, jobs, sizeof(struct JobGreyscale), steps);
 }
 
 //creates image from the difference in pixel values between b1 and b2
@@ -149,38 +147,26 @@ struct BMP *get_difference_thr(struct BMP *b1,
     
     int pdSize = b1->file_header->file_size - 54;
     diff->pixel_data = malloc(pdSize);
-    
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobDifference *t1_job, *t2_job, *t3_job, *t4_job;
-    
-    //create jobs
-    t1_job = create_job_difference(b1, b2, diff, 0);
-    t2_job = create_job_difference(b1, b2, diff, 1);
-    t3_job = create_job_difference(b1, b2, diff, 2);
-    t4_job = create_job_difference(b1, b2, diff, 3);
-        
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_difference, t1_job) ||
-        pthread_create(&t2, NULL, do_job_difference, t2_job) ||
-        pthread_create(&t3, NULL, do_job_difference, t3_job) ||
-        pthread_create(&t4, NULL, do_job_difference, t4_job)) {
+    if (!diff->pixel_data) {
+        free_BMP(diff);
         return NULL;
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return NULL;
+    struct JobDifference jobs[MAX_BATCH_JOBS];
+    int i, steps;
+    
+    steps = get_job_count(b1->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].b1 = b1;
+        jobs[i].b2 = b2;
+        jobs[i].diff = diff;
+        get_job_part(i, steps, b1->image_header->height, 0, &jobs[i].part);
     }
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
+    if (!parallel_for(do_job_difference, jobs, sizeof(struct JobDifference), steps)) {
+        free_BMP(diff);
+        return NULL;
+    }
     
     //write scanline_size to diff
     diff->scanline_size = get_scanline_size(b1->image_header->width);
@@ -193,86 +179,132 @@ struct BMP *get_difference_thr(struct BMP *b1,
 //is above the threshold, the output pixel is white, else
 //the pixel is black.
 //intended for use with a greyscaled 'difference image'
+//returns NULL on error
 struct BMP *segment_BMP_thr(struct BMP *img,
                             unsigned char threshold) {
     struct BMP *seg_map;
     seg_map = init_BMP(img->image_header->width, img->image_header->height);
-    
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobSegment *t1_job, *t2_job, *t3_job, *t4_job;
-    
-    //create jobs
-    t1_job = create_job_segment(img, seg_map, threshold, 0);
-    t2_job = create_job_segment(img, seg_map, threshold, 1);
-    t3_job = create_job_segment(img, seg_map, threshold, 2);
-    t4_job = create_job_segment(img, seg_map, threshold, 3);
-    
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_segment, t1_job) ||
-        pthread_create(&t2, NULL, do_job_segment, t2_job) ||
-        pthread_create(&t3, NULL, do_job_segment, t3_job) ||
-        pthread_create(&t4, NULL, do_job_segment, t4_job)) {
+    if (!seg_map)
         return NULL;
+    
+    struct JobSegment jobs[MAX_BATCH_JOBS];
+    int i, steps;
+    
+    steps = get_job_count(img->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].bmp = img;
+        jobs[i].seg_map = seg_map;
+        jobs[i].threshold = threshold;
+        get_job_part(i, steps, img->image_header->height, 0, &jobs[i].part);
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
+    if (!parallel_for(do_job_segment, jobs, sizeof(struct JobSegment), steps)) {
+        free_BMP(seg_map);
         return NULL;
     }
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
-    
     return seg_map;
 }
 
-//counts the number of pixels matching p in img
-long count_pixels_thr(struct BMP *img,
-                     struct Pixel p) {
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobCount *t1_job, *t2_job, *t3_job, *t4_job;
-    int full_count;
+//segment_difference_BMP on the worker pool
+//returns the number of foreground pixels, or -1 if the sizes differ or on error
+long segment_difference_BMP_thr(struct BMP *img,
+                                struct BMP *bg,
+                                unsigned char threshold,
+                                struct BMP *seg_map) {
+    if (img->image_header->width != bg->image_header->width
+        || img->image_header->height != bg->image_header->height
+        || img->image_header->width != seg_map->image_header->width
+        || img->image_header->height != seg_map->image_header->height)
+        return -1;
     
-    full_count = 0;
+    struct JobSegmentDifference jobs[MAX_BATCH_JOBS];
+    long count;
+    int i, steps;
+    
+    steps = get_job_count(img->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].img = img;
+        jobs[i].bg = bg;
+        jobs[i].seg_map = seg_map;
+        jobs[i].threshold = threshold;
+        jobs[i].count = 0;
+        get_job_part(i, steps, img->image_header->height, 0, &jobs[i].part);
+    }
     
-    //create jobs
-    t1_job = create_job_count(img, p, 0);
-    t2_job = create_job_count(img, p, 1);
-    t3_job = create_job_count(img, p, 2);
-    t4_job = create_job_count(img, p, 3);
-    
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_count, t1_job) ||
-        pthread_create(&t2, NULL, do_job_count, t2_job) ||
-        pthread_create(&t3, NULL, do_job_count, t3_job) ||
-        pthread_create(&t4, NULL, do_job_count, t4_job)) {
+    if (!parallel_for(do_job_segment_difference, jobs, sizeof(struct JobSegmentDifference), steps))
         return -1;
+    
+    count = 0;
+    for (i = 0; i < steps; i++) {
+        count += jobs[i].count;
+    }
+    return count;
+}
+
+//segment_BMP_thr into an 8 bit map, 255 where img's pixel is above the threshold and
+//0 elsewhere, a third of the memory of the 24 bit map
+//img is a greyscale image, seg_map must be the same size
+//will return 0 if errors
+int segment_BMP_gray8_thr(struct BMP *img,
+                          unsigned char threshold,
+                          struct Gray8 *seg_map) {
+    return run_segment_plane_jobs(img, threshold, seg_map, NULL);
+}
+
+//segment_BMP_thr into a one bit mask, set where img's pixel is above the threshold
+//img is a greyscale image, mask must be the same size
+//will return 0 if errors
+int segment_BMP_mask1_thr(struct BMP *img,
+                          unsigned char threshold,
+                          struct Mask1 *mask) {
+    return run_segment_plane_jobs(img, threshold, NULL, mask);
+}
+
+//runs the threads for segment_BMP_gray8_thr and segment_BMP_mask1_thr
+//will return 0 if errors
+int run_segment_plane_jobs(struct BMP *img,
+                           unsigned char threshold,
+                           struct Gray8 *gray,
+                           struct Mask1 *mask) {
+    struct JobSegmentPlane jobs[MAX_BATCH_JOBS];
+    int i, steps;
+    
+    steps = get_job_count(img->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].bmp = img;
+        jobs[i].gray = gray;
+        jobs[i].mask = mask;
+        jobs[i].threshold = threshold;
+        get_job_part(i, steps, img->image_header->height, 1, &jobs[i].part);
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return -1;
+    return parallel_for(do_job_segment_plane, jobs, sizeof(struct JobSegmentPlane), steps);
+}
+
+//counts the number of pixels matching p in img
+long count_pixels_thr(struct BMP *img,
+                     struct Pixel p) {
+    struct JobCount jobs[MAX_BATCH_JOBS];
+    long full_count;
+    int i, steps;
+    
+    steps = get_job_count(img->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].img = img;
+        jobs[i].p = p;
+        jobs[i].count = 0;
+        get_job_part(i, steps, img->image_header->height, 0, &jobs[i].part);
     }
     
-    //gather counts from each job
-    full_count = t1_job->count + t2_job->count + t3_job->count + t4_job->count;
+    if (!parallel_for(do_job_count, jobs, sizeof(struct JobCount), steps))
+        return -1;
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
+    //gather counts from each job
+    full_count = 0;
+    for (i = 0; i < steps; i++) {
+        full_count += jobs[i].count;
+    }
     
     return full_count;
 }
@@ -281,37 +313,39 @@ long count_pixels_thr(struct BMP *img,
 
 void *do_job_greyscale(void *job_struct) {
     struct JobGreyscale *job = (struct JobGreyscale *) job_struct;
+    struct PixelKernels *kern = get_pixel_kernels();
     struct BMP *bmp;
-    int step;
-    int x, y;
+    int width;
+    int y;
     
     bmp = job->bmp;
-    step = job->step;
+    width = bmp->image_header->width;
     
-    for (y = 0; y < bmp->image_header->height; y++) {
-        for (x = step; x < bmp->image_header->width; x += NUM_THREADS) {
-            set_pixel(bmp, x, y, greyscale_pixel(get_pixel(bmp, x, y)));
-        }
+    //whole rows, so the kernels see long runs
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        kern->greyscale(bmp->pixel_data + (size_t) y * bmp->scanline_size, width);
     }
     return NULL;
 }
 
 void *do_job_difference(void *job_struct) {
     struct JobDifference *job = (struct JobDifference *) job_struct;
+    struct PixelKernels *kern = get_pixel_kernels();
     struct BMP *b1, *b2, *diff;
-    int step;
-    int pdsize;
-    int i;
+    size_t offset;
+    int scanline;
+    int y;
     
     b1 = job->b1;
     b2 = job->b2;
     diff = job->diff;
-    step = job->step;
-    pdsize = b1->image_header->height * get_scanline_size(b1->image_header->width);
-    
+    scanline = get_scanline_size(b1->image_header->width);
     
-    for (i = step; i < pdsize; i += NUM_THREADS) {
-        diff->pixel_data[i] = abs(b1->pixel_data[i] - b2->pixel_data[i]);
+    //whole rows, padding included
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        offset = (size_t) y * scanline;
+        kern->difference(b1->pixel_data + offset, b2->pixel_data + offset, diff->pixel_data + offset,
+                         scanline);
     }
     
     return NULL;
@@ -319,106 +353,108 @@ void *do_job_difference(void *job_struct) {
 
 void *do_job_segment(void *job_struct) {
     struct JobSegment *job = (struct JobSegment *) job_struct;
+    struct PixelKernels *kern = get_pixel_kernels();
     struct BMP *bmp, *seg_map;
-    unsigned char threshold;
-    int step;
-    int pdsize;
-    int i;
+    size_t offset;
+    int scanline;
+    int y;
     
     bmp = job->bmp;
     seg_map = job->seg_map;
-    threshold = job->threshold;
-    step = job->step;
-    pdsize = bmp->image_header->height * get_scanline_size(bmp->image_header->width);
-    
-    for (i = step; i < pdsize; i += NUM_THREADS) {
-        if (bmp->pixel_data[i] > threshold) {
-            seg_map->pixel_data[i] = 255;
-        } else {
-            seg_map->pixel_data[i] = 0;
-        }   
+    scanline = get_scanline_size(bmp->image_header->width);
+    
+    //whole rows, padding included
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        offset = (size_t) y * scanline;
+        kern->threshold(bmp->pixel_data + offset, seg_map->pixel_data + offset, scanline,
+                        job->threshold);
     }
     
     return NULL;
 }
 
+void *do_job_segment_difference(void *job_struct) {
+    struct JobSegmentDifference *job = (struct JobSegmentDifference *) job_struct;
+    struct PixelKernels *kern = get_pixel_kernels();
+    size_t offset;
+    long count;
+    int y;
+    
+    count = 0;
+    
+    //whole rows
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        offset = (size_t) y * job->img->scanline_size;
+        count += kern->segment_difference(job->img->pixel_data + offset, job->bg->pixel_data + offset,
+                                          job->seg_map->pixel_data + offset,
+                                          job->img->image_header->width, job->threshold);
+    }
+    job->count = count;
+    return NULL;
+}
+
 void *do_job_count(void *job_struct) {
     struct JobCount *job = (struct JobCount *) job_struct;
+    struct PixelKernels *kern = get_pixel_kernels();
     struct BMP *img;
-    struct Pixel p, t;
-    int step;
-    int x, y;
-    int count;
+    struct Pixel p;
+    int width;
+    int y;
+    long count;
     
     img = job->img;
     p = job->p;
-    step = job->step;
+    width = img->image_header->width;
     
     count = 0;
     
-    for (y = 0; y < img->image_header->height; y++) {
-        for (x = step; x < img->image_header->width; x += NUM_THREADS) {
-            t = get_pixel(img, x, y);
-            if (t.red == p.red && t.green == p.green && t.blue == p.blue) {
-                count++;
-            }
-        }
+    //whole rows, so the kernels see long runs
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        count += kern->count(img->pixel_data + (size_t) y * img->scanline_size, width,
+                             p.blue, p.green, p.red);
     }
     job->count = count;
     return NULL;
 }
 
-struct JobGreyscale *create_job_greyscale(struct BMP *bmp,
-                                          int step) {
-    struct JobGreyscale *job;
-    job = malloc(sizeof(struct JobGreyscale));
-    if (!job)
-        return NULL;
-    job->bmp = bmp;
-    job->step = step;
-    return job;
-}
-
-struct JobDifference *create_job_difference(struct BMP *b1,
-                                            struct BMP *b2,
-                                            struct BMP *diff,
-                                            int step) {
-    struct JobDifference *job;
-    job = malloc(sizeof(struct JobDifference));
-    if (!job)
-        return NULL;
-    job->b1 = b1;
-    job->b2 = b2;
-    job->diff = diff;
-    job->step = step;
-    return job;
-}
-
-struct JobSegment *create_job_segment(struct BMP *bmp,
-                                      struct BMP *seg_map,
-                                      unsigned char threshold,
-                                      int step) {
-    struct JobSegment *job;
-    job = malloc(sizeof(struct JobSegment));
-    if (!job)
-        return NULL;
-    job->bmp = bmp;
-    job->seg_map = seg_map;
-    job->threshold = threshold;
-    job->step = step;
-    return job;
-}
-
-struct JobCount *create_job_count(struct BMP *img,
-                                  struct Pixel p,
-                                  int step) {
-    struct JobCount *job;
-    job = malloc(sizeof(struct JobCount));
-    if (!job)
-        return NULL;
-    job->img = img;
-    job->p = p;
-    job->count = 0;
-    job->step = step;
-    return job;
+//each job covers the rows of its band or tile in runs of 8 pixels, a mask byte each,
+//interleaved, jobs take the runs of every row in turn, so a mask byte still has one writer
+void *do_job_segment_plane(void *job_struct) {
+    struct JobSegmentPlane *job = (struct JobSegmentPlane *) job_struct;
+    struct BMP *bmp;
+    unsigned char *row, *out, *bits;
+    unsigned char threshold, b;
+    int width;
+    int x, xb, xe, y;
+    
+    bmp = job->bmp;
+    threshold = job->threshold;
+    width = bmp->image_header->width;
+    
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        //bmp rows are stored bottom-up, the maps top-down
+        row = get_row(bmp, y);
+        out = job->gray ? job->gray->pixel_data + (y * width) : NULL;
+        bits = job->mask ? job->mask->bit_data + (y * job->mask->stride) : NULL;
+        for (xb = job->part.x0 * 8; xb < width; xb += 8 * job->part.xstep) {
+            xe = xb + 8 < width ? xb + 8 : width;
+            b = 0;
+            for (x = xb; x < xe; x++) {
+                if (row[3 * x] > threshold) {
+                    b |= 1 << (x - xb);
+                    if (out)
+                        out[x] = 255;
+                } else if (out) {
+                    out[x] = 0;
+                }
+            }
+            if (bits)
+                bits[xb >> 3] = b;
+        }
+        //mask padding past the last pixel is always 0
+        if (bits && job->part.x0 == 0)
+            memset(bits + ((width + 7) >> 3), 0, job->mask->stride - ((width + 7) >> 3));
+    }
+    
+    return NULL;
 }
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a BMP whose pixels live in a mapping of its file instead of on the heap, for writing
+//event images
+//bmp comes first, so the struct BMP * handed out can be cast back, the headers are
+//copies held here as the file's are not aligned
+//replayed BMPs are read with stdio, not mapped, they are copied into preallocated
+//ring frames either way and a mapping per file only adds mmap and page fault cost
+struct MappedBMP {
+    struct BMP bmp;
+    struct BMPFileHeader file_header;
+    struct BMPImageHeader image_header;
+    unsigned char *map;           //whole file
+    size_t map_size;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct BMP *create_mapped_BMP(char *path,
+                              unsigned int width,
+                              unsigned int height);
+
+void unmap_BMP(struct BMP *bmp);
+
+int save_BMP_mapped(struct BMP *bmp,
+                    char *path);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a width x height BMP file at path and maps it, pixels written to the BMP
+//go straight to the file, which is complete once unmap_BMP is called
+//the file's blocks are reserved first, a write to a page the disk has no room for
+//would otherwise raise SIGBUS instead of failing
+//returns NULL on error, or if the disk is full
+struct BMP *create_mapped_BMP(char *path,
+                              unsigned int width,
+                              unsigned int height) {
+    struct MappedBMP *mb;
+    unsigned char *map;
+    size_t size;
+    int fd, sl;
+
+    sl = get_scanline_size(width);
+    size = 54 + (size_t) sl * height;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+        return NULL;
+    if (posix_fallocate(fd, 0, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    mb = calloc(sizeof(struct MappedBMP), 1);
+    if (!mb) {
+        munmap(map, size);
+        return NULL;
+    }
+    mb->map = map;
+    mb->map_size = size;
+
+    mb->file_header.type = (((short) 77) << 8) | 66;
+    mb->file_header.file_size = size;
+    mb->file_header.off_bits = 54;
+    mb->image_header.size = 40;
+    mb->image_header.width = width;
+    mb->image_header.height = height;
+    mb->image_header.planes = 1;
+    mb->image_header.bit_count = 24;
+    memcpy(map, &mb->file_header, 14);
+    memcpy(map + 14, &mb->image_header, 40);
+
+    mb->bmp.scanline_size = sl;
+    mb->bmp.file_header = &mb->file_header;
+    mb->bmp.image_header = &mb->image_header;
+    mb->bmp.pixel_data = map + 54;
+
+    return &mb->bmp;
+}
+
+//unmaps a BMP from create_mapped_BMP and frees it
+void unmap_BMP(struct BMP *bmp) {
+    struct MappedBMP *mb = (struct MappedBMP *) bmp;
+
+    if (!mb)
+        return;
+    munmap(mb->map, mb->map_size);
+    free(mb);
+}
+
+//saves bmp to path through a mapping of the new file, in place of save_BMP
+//the pixels are copied once, into the page cache, with no stdio buffer between
+//falls back to save_BMP if the file's blocks can't be reserved
+//returns 1 once the file is on disk, 0 if it couldn't be written
+int save_BMP_mapped(struct BMP *bmp,
+                    char *path) {
+    struct MappedBMP *mb;
+    struct BMP *out;
+    int ok;
+
+    out = create_mapped_BMP(path, bmp->image_header->width, bmp->image_header->height);
+    if (!out)
+        return save_BMP(bmp, path);
+    memcpy(out->pixel_data, bmp->pixel_data, (size_t) out->scanline_size * bmp->image_header->height);
+
+    //writeback errors only show up here
+    mb = (struct MappedBMP *) out;
+    ok = msync(mb->map, mb->map_size, MS_SYNC) == 0;
+    unmap_BMP(out);
+
+    return ok;
+}
+
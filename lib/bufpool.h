@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define POOL_BMP 0                //buffers are struct BMP
+#define POOL_GRAY8 1              //buffers are struct Gray8
+#define POOL_MASK1 2              //buffers are struct Mask1
+#define POOL_MAX_CLASSES 16       //distinct kinds and resolutions a pool holds
+#define POOL_CLASS_CAPACITY 32    //free buffers kept per class, more are freed on return
+
+// ----------
+// STRUCTURES
+// ----------
+
+//free buffers of one kind and resolution
+struct BufferClass {
+    int kind;
+    unsigned int width;
+    unsigned int height;
+    int count;                          //buffers waiting in free
+    void *free[POOL_CLASS_CAPACITY];
+};
+
+//hands out frame sized images and takes them back, so the detector reuses the same few
+//buffers instead of allocating every frame
+//each buffer is one block, the struct and headers sit in front of the pixels, and
+//must only ever go back to the pool, never to free_BMP or free_gray8
+struct BufferPool {
+    struct BufferClass classes[POOL_MAX_CLASSES];
+    int class_count;
+    pthread_mutex_t lock;
+    unsigned long allocations;          //buffers created because none were free
+    unsigned long gets;
+    unsigned long outstanding;          //buffers handed out and not yet returned
+    unsigned long peak_outstanding;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct BufferPool *init_buffer_pool();
+
+void free_buffer_pool(struct BufferPool *pool);
+
+struct BMP *pool_get_BMP(struct BufferPool *pool,
+                         unsigned int width,
+                         unsigned int height);
+
+void pool_put_BMP(struct BufferPool *pool,
+                  struct BMP *bmp);
+
+struct Gray8 *pool_get_gray8(struct BufferPool *pool,
+                             unsigned int width,
+                             unsigned int height);
+
+void pool_put_gray8(struct BufferPool *pool,
+                    struct Gray8 *img);
+
+struct Mask1 *pool_get_mask1(struct BufferPool *pool,
+                             unsigned int width,
+                             unsigned int height);
+
+void pool_put_mask1(struct BufferPool *pool,
+                    struct Mask1 *mask);
+
+void *pool_get(struct BufferPool *pool,
+               int kind,
+               unsigned int width,
+               unsigned int height);
+
+void pool_put(struct BufferPool *pool,
+              void *buf,
+              int kind,
+              unsigned int width,
+              unsigned int height);
+
+struct BufferClass *find_buffer_class(struct BufferPool *pool,
+                                      int kind,
+                                      unsigned int width,
+                                      unsigned int height);
+
+void *alloc_pool_buffer(int kind,
+                        unsigned int width,
+                        unsigned int height);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates an empty pool, buffers are allocated the first time each is needed
+//returns NULL on memory error
+struct BufferPool *init_buffer_pool() {
+    struct BufferPool *pool;
+
+    pool = calloc(sizeof(struct BufferPool), 1);
+    if (!pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    return pool;
+}
+
+//frees the pool and every buffer returned to it
+void free_buffer_pool(struct BufferPool *pool) {
+    int i, j;
+
+    if (!pool)
+        return;
+    for (i = 0; i < pool->class_count; i++) {
+        for (j = 0; j < pool->classes[i].count; j++) {
+            free(pool->classes[i].free[j]);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+//takes a width x height BMP from the pool, its pixels hold whatever they last held
+//returns NULL on memory error
+struct BMP *pool_get_BMP(struct BufferPool *pool,
+                         unsigned int width,
+                         unsigned int height) {
+    return pool_get(pool, POOL_BMP, width, height);
+}
+
+//gives a BMP from pool_get_BMP back
+void pool_put_BMP(struct BufferPool *pool,
+                  struct BMP *bmp) {
+    if (!bmp)
+        return;
+    pool_put(pool, bmp, POOL_BMP, bmp->image_header->width, bmp->image_header->height);
+}
+
+//takes a width x height Gray8 from the pool, its pixels hold whatever they last held
+//returns NULL on memory error
+struct Gray8 *pool_get_gray8(struct BufferPool *pool,
+                             unsigned int width,
+                             unsigned int height) {
+    return pool_get(pool, POOL_GRAY8, width, height);
+}
+
+//gives a Gray8 from pool_get_gray8 back
+void pool_put_gray8(struct BufferPool *pool,
+                    struct Gray8 *img) {
+    if (!img)
+        return;
+    pool_put(pool, img, POOL_GRAY8, img->width, img->height);
+}
+
+//takes a width x height Mask1 from the pool, its bits hold whatever they last held,
+//apart from the row padding, which is always 0
+//returns NULL on memory error
+struct Mask1 *pool_get_mask1(struct BufferPool *pool,
+                             unsigned int width,
+                             unsigned int height) {
+    return pool_get(pool, POOL_MASK1, width, height);
+}
+
+//gives a Mask1 from pool_get_mask1 back
+void pool_put_mask1(struct BufferPool *pool,
+                    struct Mask1 *mask) {
+    if (!mask)
+        return;
+    pool_put(pool, mask, POOL_MASK1, mask->width, mask->height);
+}
+
+//takes a free buffer of the class, allocating one only if there are none
+void *pool_get(struct BufferPool *pool,
+               int kind,
+               unsigned int width,
+               unsigned int height) {
+    struct BufferClass *bc;
+    void *buf;
+    int created;
+
+    buf = NULL;
+    created = 0;
+    pthread_mutex_lock(&pool->lock);
+    bc = find_buffer_class(pool, kind, width, height);
+    if (bc && bc->count > 0)
+        buf = bc->free[--bc->count];
+    pool->gets++;
+    pthread_mutex_unlock(&pool->lock);
+
+    //allocated outside the lock, other cameras keep getting buffers meanwhile
+    if (!buf) {
+        buf = alloc_pool_buffer(kind, width, height);
+        if (!buf)
+            return NULL;
+        created = 1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->allocations += created;
+    pool->outstanding++;
+    if (pool->outstanding > pool->peak_outstanding)
+        pool->peak_outstanding = pool->outstanding;
+    pthread_mutex_unlock(&pool->lock);
+
+    return buf;
+}
+
+//returns a buffer to its class, freeing it if the class is full
+void pool_put(struct BufferPool *pool,
+              void *buf,
+              int kind,
+              unsigned int width,
+              unsigned int height) {
+    struct BufferClass *bc;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->outstanding--;
+    bc = find_buffer_class(pool, kind, width, height);
+    if (bc && bc->count < POOL_CLASS_CAPACITY) {
+        bc->free[bc->count++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(buf);
+}
+
+//returns the class for buffers of kind and size, adding it if there is room
+//call with the lock held, returns NULL if every class is in use
+struct BufferClass *find_buffer_class(struct BufferPool *pool,
+                                      int kind,
+                                      unsigned int width,
+                                      unsigned int height) {
+    struct BufferClass *bc;
+    int i;
+
+    for (i = 0; i < pool->class_count; i++) {
+        bc = &pool->classes[i];
+        if (bc->kind == kind && bc->width == width && bc->height == height)
+            return bc;
+    }
+    if (pool->class_count == POOL_MAX_CLASSES)
+        return NULL;
+
+    bc = &pool->classes[pool->class_count++];
+    bc->kind = kind;
+    bc->width = width;
+    bc->height = height;
+    bc->count = 0;
+    return bc;
+}
+
+//allocates one buffer, the struct, headers and pixels in a single block
+//BMP headers are filled in the same as init_BMP
+void *alloc_pool_buffer(int kind,
+                        unsigned int width,
+                        unsigned int height) {
+    struct BMP *bmp;
+    struct Gray8 *img;
+    struct Mask1 *mask;
+    size_t head, size;
+    int scanline;
+
+    if (kind == POOL_GRAY8) {
+        //pixels start on a cache line
+        head = (sizeof(struct Gray8) + 63) & ~(size_t) 63;
+        img = malloc(head + (size_t) width * height);
+        if (!img)
+            return NULL;
+        img->width = width;
+        img->height = height;
+        img->pixel_data = (unsigned char *) img + head;
+        return img;
+    }
+
+    if (kind == POOL_MASK1) {
+        head = (sizeof(struct Mask1) + 63) & ~(size_t) 63;
+        size = (size_t) get_mask1_stride(width) * height;
+        mask = malloc(head + size);
+        if (!mask)
+            return NULL;
+        mask->width = width;
+        mask->height = height;
+        mask->stride = get_mask1_stride(width);
+        mask->bit_data = (unsigned char *) mask + head;
+        //cleared once so the padding starts at 0, segmenting only writes the pixels
+        memset(mask->bit_data, 0, size);
+        return mask;
+    }
+
+    scanline = get_scanline_size(width);
+    head = (sizeof(struct BMP) + sizeof(struct BMPFileHeader)
+            + sizeof(struct BMPImageHeader) + 63) & ~(size_t) 63;
+    bmp = malloc(head + (size_t) scanline * height);
+    if (!bmp)
+        return NULL;
+    bmp->scanline_size = scanline;
+    bmp->file_header = (struct BMPFileHeader *) (bmp + 1);
+    bmp->image_header = (struct BMPImageHeader *) (bmp->file_header + 1);
+    bmp->pixel_data = (unsigned char *) bmp + head;
+
+    memset(bmp->file_header, 0, sizeof(struct BMPFileHeader));
+    memset(bmp->image_header, 0, sizeof(struct BMPImageHeader));
+    bmp->file_header->type = (((short) 77) << 8) | 66;
+    bmp->file_header->file_size = 54 + (scanline * height);
+    bmp->file_header->off_bits = 54;
+    bmp->image_header->size = 40;
+    bmp->image_header->width = width;
+    bmp->image_header->height = height;
+    bmp->image_header->planes = 1;
+    bmp->image_header->bit_count = 24;
+
+    return bmp;
+}
@@ -45,6 +45,36 @@ struct SysConfig {
     int ent_max_width;  //maximum width of entities in segmap not filtered (-1 < )
     int ent_min_height; //minimum height of entities in segmap not filtered (-1 < )
     int ent_max_height; //maximum height of entities in segmap not filtered (-1 < )
+    int capture_mode;   //frame source (0 - ffmpeg, 1 - v4l2 mmap, 2 - replay, 3 - synthetic)
+    int ring_size;      //frames buffered between capture and detection (2 - 64)
+    int ring_policy;    //when the ring is full (0 - drop oldest, 1 - drop newest, 2 - block)
+    char *replay_path;  //bmp directory or raw bgr24 file replayed when capture_mode is 2
+    double replay_fps;  //replay frame rate (0 - 255), 0 replays as fast as possible
+    int replay_loop;    //restart the replay when it ends (0 - 1)
+    int synth_objects;  //moving objects in the synthetic scene (0 - 255)
+    int synth_noise;    //max noise added to synthetic frames (0 - 255)
+    int synth_drift;    //max lighting drift of synthetic frames (0 - 255)
+    int synth_frames;   //synthetic frames generated before stopping, 0 for no limit
+    int record_length;  //seconds of video recorded after an event (1 - 255)
+    int record_max_length; //longest a clip can be extended to by further events (1 - 255)
+    int max_recordings; //clips that may be recording at once (1 - 16)
+    int record_fps;     //frame rate of event clips (1 - 60)
+    int preroll_seconds; //seconds of video kept in memory from before an event (0 - 30)
+    int artifact_queue; //event images waiting to be written before more are dropped (1 - 255)
+    int luma_only;      //detect on the 8 bit luma of frames instead of bgr (0 - 1)
+    int stream_port;    //port the mjpeg live stream is served on, 0 for no stream (0 - 65535)
+    int stream_quality; //jpeg quality of the live stream (1 - 100)
+    char *cameras;      //comma separated camera config files, empty for the one camera set up here
+    int detect_workers; //threads the cameras' detection is shared across, 0 for one per cpu (0 - 64)
+    int target_fps;     //frames detected per second, 0 for every frame captured (0 - 255)
+    int max_latency_ms; //longest from capture to decision before a frame is a miss, 0 for no limit (0 - 60000)
+    int idle_fps;       //frames detected per second once the scene is static, 0 to never step down (0 - 255)
+    int idle_seconds;   //seconds without change before the scene counts as static (1 - 255)
+    int mapped_io;      //raw replay and event images read and written through mmap instead of stdio (0 - 1)
+    int kernel_threads; //threads each threaded kernel splits a frame across, 0 for one per cpu (0 - 64)
+    char *kernel_cpus;  //cpus the kernel threads are pinned to, as 0,2 or 0-3, empty for no pinning
+    int pipeline_update; //update the model with each frame in the pass segmenting the next (0 - 1)
+    int stream_public;  //serve the live stream on every interface instead of only this machine (0 - 1)
 };
 
 //---------------------
@@ -81,6 +111,8 @@ int init_config(struct SysConfig *config,
                 int ent_min_height,
                 int ent_max_height);
 
+void default_config(struct SysConfig *config);
+
 int set(struct SysConfig *config,
         char *name,
         char *value);
@@ -107,12 +139,22 @@ int is_valid_dir(char *dpath);
 
 int is_valid_file(char *fpath);
 
+int is_valid_file_list(char *list);
+
+int parse_cpu_list(char *list,
+                   int *cpus,
+                   int max);
+
 int is_valid_filter_val(char *str);
 
 int is_uns_int(char *value);
 
 int replace_newline(char *str, char c);
 
+int parse_resolution(char *res,
+                     unsigned int *width,
+                     unsigned int *height);
+
 //-------------------------
 //main function definitions
 //-------------------------
@@ -144,6 +186,36 @@ int replace_newline(char *str, char c);
 // 22 - ent_max_width must be >= -1
 // 23 - ent_min_height must be >= -1
 // 24 - ent_max_height must be >= -1
+// 25 - capture_mode must be 0 - 3
+// 26 - ring_size must be 2 - 64
+// 27 - ring_policy must be 0 - 2
+// 28 - replay_path must be a directory or file
+// 29 - replay_fps must be 0 - 255
+// 30 - replay_loop must be 0 - 1
+// 31 - synth_objects must be 0 - 255
+// 32 - synth_noise must be 0 - 255
+// 33 - synth_drift must be 0 - 255
+// 34 - synth_frames must be >= 0
+// 35 - record_length must be 1 - 255
+// 36 - record_max_length must be 1 - 255
+// 37 - max_recordings must be 1 - 16
+// 38 - record_fps must be 1 - 60
+// 39 - preroll_seconds must be 0 - 30
+// 40 - artifact_queue must be 1 - 255
+// 41 - luma_only must be 0 - 1
+// 42 - stream_port must be 0 - 65535
+// 43 - stream_quality must be 1 - 100
+// 44 - cameras must be a list of files
+// 45 - detect_workers must be 0 - 64
+// 46 - target_fps must be 0 - 255
+// 47 - max_latency_ms must be 0 - 60000
+// 48 - idle_fps must be 0 - 255
+// 49 - idle_seconds must be 1 - 255
+// 50 - mapped_io must be 0 - 1
+// 51 - kernel_threads must be 0 - 64
+// 52 - kernel_cpus must be a list of cpus
+// 53 - pipeline_update must be 0 - 1
+// 54 - stream_public must be 0 - 1
 int set(struct SysConfig *config,
         char *name,
         char *value) {
@@ -482,6 +554,370 @@ int set(struct SysConfig *config,
         } else {
             return 24;
         }
+    //capture_mode
+    } else if ((c = strstr(name, "capture_mode")) != NULL
+        || (c = strstr(name, "capm")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v <= 3) {
+                config->capture_mode = v;
+            } else {
+                return 25;
+            }
+        } else {
+            return 25;
+        }
+    //ring_size
+    } else if ((c = strstr(name, "ring_size")) != NULL
+        || (c = strstr(name, "rsz")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 2 && v <= 64) {
+                config->ring_size = v;
+            } else {
+                return 26;
+            }
+        } else {
+            return 26;
+        }
+    //ring_policy
+    } else if ((c = strstr(name, "ring_policy")) != NULL
+        || (c = strstr(name, "rpol")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v <= 2) {
+                config->ring_policy = v;
+            } else {
+                return 27;
+            }
+        } else {
+            return 27;
+        }
+    //replay_path
+    } else if ((c = strstr(name, "replay_path")) != NULL
+        || (c = strstr(name, "rpth")) != NULL) {
+        //remove trailing newline
+        int len = strlen(value);
+        if (len > 0 && value[len-1] == '\n') {
+            value[len-1] = '\0';
+        }
+        //empty until a recording is given
+        if (value[0] == '\0' || is_valid_dir(value) || is_valid_file(value)) {
+            //free existing path
+            if (config->replay_path != NULL) {
+                free(config->replay_path);
+                config->replay_path = NULL;
+            }
+            //malloc for copy
+            config->replay_path = malloc(len+1);
+            if (!config->replay_path) {
+                printf("Error: Memory Error.");
+                return 28;
+            }
+            //copy
+            strcpy(config->replay_path, value);
+        } else {
+            return 28;
+        }
+    //replay_fps
+    } else if ((c = strstr(name, "replay_fps")) != NULL
+        || (c = strstr(name, "rfps")) != NULL) {
+        if (is_uns_char(value)) {
+            config->replay_fps = (double) str_to_uns_char(value);
+        } else {
+            return 29;
+        }
+    //replay_loop
+    } else if ((c = strstr(name, "replay_loop")) != NULL
+        || (c = strstr(name, "rlp")) != NULL) {
+        if (is_bool(value)) {
+            config->replay_loop = value[0] - '0';
+        } else {
+            return 30;
+        }
+    //synth_objects
+    } else if ((c = strstr(name, "synth_objects")) != NULL
+        || (c = strstr(name, "sobj")) != NULL) {
+        if (is_uns_char(value)) {
+            config->synth_objects = str_to_uns_char(value);
+        } else {
+            return 31;
+        }
+    //synth_noise
+    } else if ((c = strstr(name, "synth_noise")) != NULL
+        || (c = strstr(name, "snoi")) != NULL) {
+        if (is_uns_char(value)) {
+            config->synth_noise = str_to_uns_char(value);
+        } else {
+            return 32;
+        }
+    //synth_drift
+    } else if ((c = strstr(name, "synth_drift")) != NULL
+        || (c = strstr(name, "sdrf")) != NULL) {
+        if (is_uns_char(value)) {
+            config->synth_drift = str_to_uns_char(value);
+        } else {
+            return 33;
+        }
+    //synth_frames
+    } else if ((c = strstr(name, "synth_frames")) != NULL
+        || (c = strstr(name, "sfrm")) != NULL) {
+        if (is_uns_int(value) && value[0] != '\0' && value[0] != '\n') {
+            config->synth_frames = str_to_filter_val(value);
+        } else {
+            return 34;
+        }
+    //record_length
+    } else if ((c = strstr(name, "record_length")) != NULL
+        || (c = strstr(name, "rlen")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1) {
+                config->record_length = v;
+            } else {
+                return 35;
+            }
+        } else {
+            return 35;
+        }
+    //record_max_length
+    } else if ((c = strstr(name, "record_max_length")) != NULL
+        || (c = strstr(name, "rmax")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1) {
+                config->record_max_length = v;
+            } else {
+                return 36;
+            }
+        } else {
+            return 36;
+        }
+    //max_recordings
+    } else if ((c = strstr(name, "max_recordings")) != NULL
+        || (c = strstr(name, "mrec")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1 && v <= 16) {
+                config->max_recordings = v;
+            } else {
+                return 37;
+            }
+        } else {
+            return 37;
+        }
+    //record_fps
+    } else if ((c = strstr(name, "record_fps")) != NULL
+        || (c = strstr(name, "recf")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1 && v <= 60) {
+                config->record_fps = v;
+            } else {
+                return 38;
+            }
+        } else {
+            return 38;
+        }
+    //preroll_seconds
+    } else if ((c = strstr(name, "preroll_seconds")) != NULL
+        || (c = strstr(name, "prs")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v <= 30) {
+                config->preroll_seconds = v;
+            } else {
+                return 39;
+            }
+        } else {
+            return 39;
+        }
+    //artifact_queue
+    } else if ((c = strstr(name, "artifact_queue")) != NULL
+        || (c = strstr(name, "artq")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1) {
+                config->artifact_queue = v;
+            } else {
+                return 40;
+            }
+        } else {
+            return 40;
+        }
+    //luma_only
+    } else if ((c = strstr(name, "luma_only")) != NULL
+        || (c = strstr(name, "luma")) != NULL) {
+        if (is_bool(value)) {
+            config->luma_only = value[0] - '0';
+        } else {
+            return 41;
+        }
+    //stream_port
+    } else if ((c = strstr(name, "stream_port")) != NULL
+        || (c = strstr(name, "sprt")) != NULL) {
+        if (is_uns_int(value) && value[0] != '\0' && value[0] != '\n') {
+            int v = str_to_filter_val(value);
+            if (v >= 0 && v <= 65535) {
+                config->stream_port = v;
+            } else {
+                return 42;
+            }
+        } else {
+            return 42;
+        }
+    //stream_quality
+    } else if ((c = strstr(name, "stream_quality")) != NULL
+        || (c = strstr(name, "sqty")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1 && v <= 100) {
+                config->stream_quality = v;
+            } else {
+                return 43;
+            }
+        } else {
+            return 43;
+        }
+    //cameras
+    } else if ((c = strstr(name, "cameras")) != NULL
+        || (c = strstr(name, "cams")) != NULL) {
+        //remove trailing newline
+        int len = strlen(value);
+        if (len > 0 && value[len-1] == '\n') {
+            value[len-1] = '\0';
+        }
+        //empty for a single camera configured by this file
+        if (value[0] == '\0' || is_valid_file_list(value)) {
+            //free existing list
+            if (config->cameras != NULL) {
+                free(config->cameras);
+                config->cameras = NULL;
+            }
+            //malloc for copy
+            config->cameras = malloc(len+1);
+            if (!config->cameras) {
+                printf("Error: Memory Error.");
+                return 44;
+            }
+            //copy
+            strcpy(config->cameras, value);
+        } else {
+            return 44;
+        }
+    //detect_workers
+    } else if ((c = strstr(name, "detect_workers")) != NULL
+        || (c = strstr(name, "dwk")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v <= 64) {
+                config->detect_workers = v;
+            } else {
+                return 45;
+            }
+        } else {
+            return 45;
+        }
+    //target_fps
+    } else if ((c = strstr(name, "target_fps")) != NULL
+        || (c = strstr(name, "tfps")) != NULL) {
+        if (is_uns_char(value)) {
+            config->target_fps = str_to_uns_char(value);
+        } else {
+            return 46;
+        }
+    //max_latency_ms
+    } else if ((c = strstr(name, "max_latency_ms")) != NULL
+        || (c = strstr(name, "mlat")) != NULL) {
+        if (is_uns_int(value) && value[0] != '\0' && value[0] != '\n') {
+            int v = str_to_filter_val(value);
+            if (v >= 0 && v <= 60000) {
+                config->max_latency_ms = v;
+            } else {
+                return 47;
+            }
+        } else {
+            return 47;
+        }
+    //idle_fps
+    } else if ((c = strstr(name, "idle_fps")) != NULL
+        || (c = strstr(name, "ifps")) != NULL) {
+        if (is_uns_char(value)) {
+            config->idle_fps = str_to_uns_char(value);
+        } else {
+            return 48;
+        }
+    //idle_seconds
+    } else if ((c = strstr(name, "idle_seconds")) != NULL
+        || (c = strstr(name, "idls")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v >= 1) {
+                config->idle_seconds = v;
+            } else {
+                return 49;
+            }
+        } else {
+            return 49;
+        }
+    //mapped_io
+    } else if ((c = strstr(name, "mapped_io")) != NULL
+        || (c = strstr(name, "mio")) != NULL) {
+        if (is_bool(value)) {
+            config->mapped_io = value[0] - '0';
+        } else {
+            return 50;
+        }
+    //kernel_threads
+    } else if ((c = strstr(name, "kernel_threads")) != NULL
+        || (c = strstr(name, "kthr")) != NULL) {
+        if (is_uns_char(value)) {
+            unsigned char v = str_to_uns_char(value);
+            if (v <= 64) {
+                config->kernel_threads = v;
+            } else {
+                return 51;
+            }
+        } else {
+            return 51;
+        }
+    //kernel_cpus
+    } else if ((c = strstr(name, "kernel_cpus")) != NULL
+        || (c = strstr(name, "kcpu")) != NULL) {
+        //remove trailing newline
+        int len = strlen(value);
+        if (len > 0 && value[len-1] == '\n') {
+            value[len-1] = '\0';
+            len--;
+        }
+        //empty for no pinning
+        if (parse_cpu_list(value, NULL, 0) >= 0) {
+            free(config->kernel_cpus);
+            config->kernel_cpus = malloc(len+1);
+            if (!config->kernel_cpus) {
+                printf("Error: Memory Error.");
+                return 52;
+            }
+            strcpy(config->kernel_cpus, value);
+        } else {
+            return 52;
+        }
+    //pipeline_update
+    } else if ((c = strstr(name, "pipeline_update")) != NULL
+        || (c = strstr(name, "pipe")) != NULL) {
+        if (is_bool(value)) {
+            config->pipeline_update = value[0] - '0';
+        } else {
+            return 53;
+        }
+    //stream_public
+    } else if ((c = strstr(name, "stream_public")) != NULL
+        || (c = strstr(name, "spub")) != NULL) {
+        if (is_bool(value)) {
+            config->stream_public = value[0] - '0';
+        } else {
+            return 54;
+        }
     //unknown variablename
     } else {
         return 1;
@@ -536,6 +972,77 @@ void output_config(struct SysConfig *config,
     fprintf(output, "ent_max_width=%d\n", config->ent_max_width);
     fprintf(output, "ent_min_height=%d\n", config->ent_min_height);
     fprintf(output, "ent_max_height=%d\n", config->ent_max_height);
+    fprintf(output, "capture_mode=%d\n", config->capture_mode);
+    fprintf(output, "ring_size=%d\n", config->ring_size);
+    fprintf(output, "ring_policy=%d\n", config->ring_policy);
+    fprintf(output, "replay_path=%s\n", config->replay_path);
+    fprintf(output, "replay_fps=%d\n", (int) config->replay_fps);
+    fprintf(output, "replay_loop=%d\n", config->replay_loop);
+    fprintf(output, "synth_objects=%d\n", config->synth_objects);
+    fprintf(output, "synth_noise=%d\n", config->synth_noise);
+    fprintf(output, "synth_drift=%d\n", config->synth_drift);
+    fprintf(output, "synth_frames=%d\n", config->synth_frames);
+    fprintf(output, "record_length=%d\n", config->record_length);
+    fprintf(output, "record_max_length=%d\n", config->record_max_length);
+    fprintf(output, "max_recordings=%d\n", config->max_recordings);
+    fprintf(output, "record_fps=%d\n", config->record_fps);
+    fprintf(output, "preroll_seconds=%d\n", config->preroll_seconds);
+    fprintf(output, "artifact_queue=%d\n", config->artifact_queue);
+    fprintf(output, "luma_only=%d\n", config->luma_only);
+    fprintf(output, "stream_port=%d\n", config->stream_port);
+    fprintf(output, "stream_quality=%d\n", config->stream_quality);
+    fprintf(output, "cameras=%s\n", config->cameras);
+    fprintf(output, "detect_workers=%d\n", config->detect_workers);
+    fprintf(output, "target_fps=%d\n", config->target_fps);
+    fprintf(output, "max_latency_ms=%d\n", config->max_latency_ms);
+    fprintf(output, "idle_fps=%d\n", config->idle_fps);
+    fprintf(output, "idle_seconds=%d\n", config->idle_seconds);
+    fprintf(output, "mapped_io=%d\n", config->mapped_io);
+    fprintf(output, "kernel_threads=%d\n", config->kernel_threads);
+    fprintf(output, "kernel_cpus=%s\n", config->kernel_cpus);
+    fprintf(output, "pipeline_update=%d\n", config->pipeline_update);
+    fprintf(output, "stream_public=%d\n", config->stream_public);
+}
+
+//sets the variables that have no init_config parameter to their defaults
+//keeps configs written before a variable existed loading with sane values
+void default_config(struct SysConfig *config) {
+    config->capture_mode = 0;
+    config->ring_size = 4;
+    config->ring_policy = 0;
+    config->replay_path = malloc(1);
+    if (config->replay_path)
+        config->replay_path[0] = '\0';
+    config->replay_fps = 0.0;
+    config->replay_loop = 0;
+    config->synth_objects = 4;
+    config->synth_noise = 6;
+    config->synth_drift = 20;
+    config->synth_frames = 0;
+    config->record_length = 15;
+    config->record_max_length = 60;
+    config->max_recordings = 2;
+    config->record_fps = 20;
+    config->preroll_seconds = 3;
+    config->artifact_queue = 32;
+    config->luma_only = 0;
+    config->stream_port = 0;
+    config->stream_quality = 75;
+    config->cameras = malloc(1);
+    if (config->cameras)
+        config->cameras[0] = '\0';
+    config->detect_workers = 0;
+    config->target_fps = 0;
+    config->max_latency_ms = 0;
+    config->idle_fps = 0;
+    config->idle_seconds = 10;
+    config->mapped_io = 0;
+    config->kernel_threads = 0;
+    config->kernel_cpus = malloc(1);
+    if (config->kernel_cpus)
+        config->kernel_cpus[0] = '\0';
+    config->pipeline_update = 1;
+    config->stream_public = 0;
 }
 
 //initialises the given 'config' with the given values.
@@ -593,6 +1100,7 @@ int init_config(struct SysConfig *config,
     config->ent_max_width = 0;
     config->ent_min_height = 0;
     config->ent_max_height = 0;
+    default_config(config);
     
     if (cpt >= 0 && cpt <= 1)
         config->change_percent_threshold = cpt;
@@ -693,6 +1201,36 @@ int init_config(struct SysConfig *config,
 // 22 - couldn't set ent_max_width
 // 23 - couldn't set ent_min_height
 // 24 - couldn't set ent_max_height
+// 25 - couldn't set capture_mode
+// 26 - couldn't set ring_size
+// 27 - couldn't set ring_policy
+// 28 - couldn't set replay_path
+// 29 - couldn't set replay_fps
+// 30 - couldn't set replay_loop
+// 31 - couldn't set synth_objects
+// 32 - couldn't set synth_noise
+// 33 - couldn't set synth_drift
+// 34 - couldn't set synth_frames
+// 35 - couldn't set record_length
+// 36 - couldn't set record_max_length
+// 37 - couldn't set max_recordings
+// 38 - couldn't set record_fps
+// 39 - couldn't set preroll_seconds
+// 40 - couldn't set artifact_queue
+// 41 - couldn't set luma_only
+// 42 - couldn't set stream_port
+// 43 - couldn't set stream_quality
+// 44 - couldn't set cameras
+// 45 - couldn't set detect_workers
+// 46 - couldn't set target_fps
+// 47 - couldn't set max_latency_ms
+// 48 - couldn't set idle_fps
+// 49 - couldn't set idle_seconds
+// 50 - couldn't set mapped_io
+// 51 - couldn't set kernel_threads
+// 52 - couldn't set kernel_cpus
+// 53 - couldn't set pipeline_update
+// 54 - couldn't set stream_public
 int load_config(struct SysConfig *config,
                 char *path) {
     FILE *f;
@@ -705,6 +1243,9 @@ int load_config(struct SysConfig *config,
         return 1;
     }
     
+    //variables missing from older config files keep their defaults
+    default_config(config);
+    
     //read lines
     while (getline(&line, &n, f) != -1) {
         if (line[0] != '#' && line[0] != '\n') {   //ignore comment and empty lines
@@ -823,6 +1364,156 @@ int load_config(struct SysConfig *config,
                 if (set(config, "ent_max_height", &line[15]) != 0) {
                     return 24; //unable to set value, return error
                 }
+            //capture_mode
+            } else if (strstr(line, "capture_mode=") != NULL) {
+                if (set(config, "capture_mode", &line[13]) != 0) {
+                    return 25; //unable to set value, return error
+                }
+            //ring_size
+            } else if (strstr(line, "ring_size=") != NULL) {
+                if (set(config, "ring_size", &line[10]) != 0) {
+                    return 26; //unable to set value, return error
+                }
+            //ring_policy
+            } else if (strstr(line, "ring_policy=") != NULL) {
+                if (set(config, "ring_policy", &line[12]) != 0) {
+                    return 27; //unable to set value, return error
+                }
+            //replay_path
+            } else if (strstr(line, "replay_path=") != NULL) {
+                if (set(config, "replay_path", &line[12]) != 0) {
+                    return 28; //unable to set value, return error
+                }
+            //replay_fps
+            } else if (strstr(line, "replay_fps=") != NULL) {
+                if (set(config, "replay_fps", &line[11]) != 0) {
+                    return 29; //unable to set value, return error
+                }
+            //replay_loop
+            } else if (strstr(line, "replay_loop=") != NULL) {
+                if (set(config, "replay_loop", &line[12]) != 0) {
+                    return 30; //unable to set value, return error
+                }
+            //synth_objects
+            } else if (strstr(line, "synth_objects=") != NULL) {
+                if (set(config, "synth_objects", &line[14]) != 0) {
+                    return 31; //unable to set value, return error
+                }
+            //synth_noise
+            } else if (strstr(line, "synth_noise=") != NULL) {
+                if (set(config, "synth_noise", &line[12]) != 0) {
+                    return 32; //unable to set value, return error
+                }
+            //synth_drift
+            } else if (strstr(line, "synth_drift=") != NULL) {
+                if (set(config, "synth_drift", &line[12]) != 0) {
+                    return 33; //unable to set value, return error
+                }
+            //synth_frames
+            } else if (strstr(line, "synth_frames=") != NULL) {
+                if (set(config, "synth_frames", &line[13]) != 0) {
+                    return 34; //unable to set value, return error
+                }
+            //record_length
+            } else if (strstr(line, "record_length=") != NULL) {
+                if (set(config, "record_length", &line[14]) != 0) {
+                    return 35; //unable to set value, return error
+                }
+            //record_max_length
+            } else if (strstr(line, "record_max_length=") != NULL) {
+                if (set(config, "record_max_length", &line[18]) != 0) {
+                    return 36; //unable to set value, return error
+                }
+            //max_recordings
+            } else if (strstr(line, "max_recordings=") != NULL) {
+                if (set(config, "max_recordings", &line[15]) != 0) {
+                    return 37; //unable to set value, return error
+                }
+            //record_fps
+            } else if (strstr(line, "record_fps=") != NULL) {
+                if (set(config, "record_fps", &line[11]) != 0) {
+                    return 38; //unable to set value, return error
+                }
+            //preroll_seconds
+            } else if (strstr(line, "preroll_seconds=") != NULL) {
+                if (set(config, "preroll_seconds", &line[16]) != 0) {
+                    return 39; //unable to set value, return error
+                }
+            //artifact_queue
+            } else if (strstr(line, "artifact_queue=") != NULL) {
+                if (set(config, "artifact_queue", &line[15]) != 0) {
+                    return 40; //unable to set value, return error
+                }
+            //luma_only
+            } else if (strstr(line, "luma_only=") != NULL) {
+                if (set(config, "luma_only", &line[10]) != 0) {
+                    return 41; //unable to set value, return error
+                }
+            //stream_port
+            } else if (strstr(line, "stream_port=") != NULL) {
+                if (set(config, "stream_port", &line[12]) != 0) {
+                    return 42; //unable to set value, return error
+                }
+            //stream_quality
+            } else if (strstr(line, "stream_quality=") != NULL) {
+                if (set(config, "stream_quality", &line[15]) != 0) {
+                    return 43; //unable to set value, return error
+                }
+            //cameras
+            } else if (strstr(line, "cameras=") != NULL) {
+                if (set(config, "cameras", &line[8]) != 0) {
+                    return 44; //unable to set value, return error
+                }
+            //detect_workers
+            } else if (strstr(line, "detect_workers=") != NULL) {
+                if (set(config, "detect_workers", &line[15]) != 0) {
+                    return 45; //unable to set value, return error
+                }
+            //target_fps
+            } else if (strstr(line, "target_fps=") != NULL) {
+                if (set(config, "target_fps", &line[11]) != 0) {
+                    return 46; //unable to set value, return error
+                }
+            //max_latency_ms
+            } else if (strstr(line, "max_latency_ms=") != NULL) {
+                if (set(config, "max_latency_ms", &line[15]) != 0) {
+                    return 47; //unable to set value, return error
+                }
+            //idle_fps
+            } else if (strstr(line, "idle_fps=") != NULL) {
+                if (set(config, "idle_fps", &line[9]) != 0) {
+                    return 48; //unable to set value, return error
+                }
+            //idle_seconds
+            } else if (strstr(line, "idle_seconds=") != NULL) {
+                if (set(config, "idle_seconds", &line[13]) != 0) {
+                    return 49; //unable to set value, return error
+                }
+            //mapped_io
+            } else if (strstr(line, "mapped_io=") != NULL) {
+                if (set(config, "mapped_io", &line[10]) != 0) {
+                    return 50; //unable to set value, return error
+                }
+            //kernel_threads
+            } else if (strstr(line, "kernel_threads=") != NULL) {
+                if (set(config, "kernel_threads", &line[15]) != 0) {
+                    return 51; //unable to set value, return error
+                }
+            //kernel_cpus
+            } else if (strstr(line, "kernel_cpus=") != NULL) {
+                if (set(config, "kernel_cpus", &line[12]) != 0) {
+                    return 52; //unable to set value, return error
+                }
+            //pipeline_update
+            } else if (strstr(line, "pipeline_update=") != NULL) {
+                if (set(config, "pipeline_update", &line[16]) != 0) {
+                    return 53; //unable to set value, return error
+                }
+            //stream_public
+            } else if (strstr(line, "stream_public=") != NULL) {
+                if (set(config, "stream_public", &line[14]) != 0) {
+                    return 54; //unable to set value, return error
+                }
             }
         }
         n = 0;
@@ -843,6 +1534,9 @@ void free_conf(struct SysConfig *conf) {
     free(conf->video_device);
     free(conf->ffmpeg_path);
     free(conf->resolution);
+    free(conf->replay_path);
+    free(conf->cameras);
+    free(conf->kernel_cpus);
     free(conf);
 }
 
@@ -983,6 +1677,69 @@ int is_valid_file(char *fpath) {
     }
 }
 
+//checks every entry of a comma separated list is a file that can be opened
+int is_valid_file_list(char *list) {
+    char path[PATH_MAX];
+    char *start, *end;
+    int len;
+
+    start = list;
+    while (1) {
+        end = strchr(start, ',');
+        len = end ? end - start : (int) strlen(start);
+        if (len == 0 || len >= PATH_MAX)
+            return 0;
+        memcpy(path, start, len);
+        path[len] = '\0';
+        if (!is_valid_file(path))
+            return 0;
+        if (!end)
+            return 1;
+        start = end + 1;
+    }
+}
+
+//reads a comma separated list of cpus and ranges of them, as 0,2 or 0-3,6, into cpus
+//only the first max are stored, cpus may be NULL to only check the list
+//returns the number of cpus in the list, 0 if it's empty, -1 if it isn't valid
+int parse_cpu_list(char *list,
+                   int *cpus,
+                   int max) {
+    char *p, *end;
+    long first, last, cpu;
+    int n;
+
+    n = 0;
+    p = list;
+    if (*p == '\0' || *p == '\n')
+        return 0;
+    while (1) {
+        if (*p < '0' || *p > '9')
+            return -1;
+        first = strtol(p, &end, 10);
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            if (*p < '0' || *p > '9')
+                return -1;
+            last = strtol(p, &end, 10);
+        }
+        //a cpu_set_t holds 1024 cpus
+        if (last < first || last > 1023)
+            return -1;
+        for (cpu = first; cpu <= last; cpu++) {
+            if (cpus && n < max)
+                cpus[n] = cpu;
+            n++;
+        }
+        if (*end == '\0' || *end == '\n')
+            return n;
+        if (*end != ',')
+            return -1;
+        p = end + 1;
+    }
+}
+
 //checks if string is -1 or a positive number
 int is_valid_filter_val(char *str) {
     return (strlen(str) == 3 && str[0] == '-' && str[1] == '1') || is_uns_int(str);
@@ -1011,4 +1768,17 @@ int replace_newline(char *str, char c) {
         }
     }
     return 0;
-}    
+}
+
+//parses a resolution string of the form widthxheight (e.g. 640x480)
+//returns 1 on success
+int parse_resolution(char *res,
+                     unsigned int *width,
+                     unsigned int *height) {
+    unsigned int w, h;
+    if (!res || sscanf(res, "%ux%u", &w, &h) != 2 || w == 0 || h == 0)
+        return 0;
+    *width = w;
+    *height = h;
+    return 1;
+}
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define POOL_IDLE_WAIT_MS 50      //longest an idle worker sleeps before checking the tasks again
+
+// ----------
+// STRUCTURES
+// ----------
+
+//one camera, or anything else stepped by the pool
+//a task is only ever run by one worker at a time, so its state needs no locking
+struct PoolTask {
+    void *arg;
+    int busy;                     //a worker is stepping it
+    int finished;                 //step returned < 0, it is never run again
+    unsigned long steps;          //steps that did work
+    double last_run;              //monotonic time it was last picked
+    double run_time;              //seconds workers spent stepping it
+};
+
+//a fixed set of workers shared by every task
+//workers pick the ready task that has waited longest since its last step, so when
+//there are more tasks than cores each gets an equal turn instead of the busiest
+//one taking every free worker
+struct DetectPool {
+    int num_workers;
+    int num_tasks;
+    struct PoolTask *tasks;
+    int (*ready)(void *arg);      //1 if stepping arg would find work, called with the lock held
+    int (*step)(void *arg);       //does one unit of work, 1 if it did, 0 if none, < 0 when done
+    int unfinished;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;     //wakes idle workers
+    pthread_cond_t done_cond;     //signalled when the last task finishes
+    pthread_t *workers;
+    int started;                  //workers that need joining
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct DetectPool *init_detect_pool(int num_workers,
+                                    int num_tasks,
+                                    void **args,
+                                    int (*ready)(void *),
+                                    int (*step)(void *));
+
+int start_detect_pool(struct DetectPool *pool);
+
+void stop_detect_pool(struct DetectPool *pool);
+
+void free_detect_pool(struct DetectPool *pool);
+
+void detect_pool_notify(struct DetectPool *pool);
+
+int wait_detect_pool(struct DetectPool *pool,
+                     int timeout_ms);
+
+void *do_pool_work(void *arg);
+
+void pool_deadline(struct timespec *ts,
+                   int timeout_ms);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a pool of num_workers threads for the num_tasks tasks whose args are given
+//nothing is stepped until start_detect_pool, notify may be called before then
+//returns NULL on memory error
+struct DetectPool *init_detect_pool(int num_workers,
+                                    int num_tasks,
+                                    void **args,
+                                    int (*ready)(void *),
+                                    int (*step)(void *)) {
+    struct DetectPool *pool;
+    int i;
+
+    pool = calloc(sizeof(struct DetectPool), 1);
+    if (!pool)
+        return NULL;
+
+    pool->tasks = calloc(num_tasks, sizeof(struct PoolTask));
+    pool->workers = calloc(num_workers, sizeof(pthread_t));
+    if (!pool->tasks || !pool->workers) {
+        free(pool->tasks);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pool->num_workers = num_workers;
+    pool->num_tasks = num_tasks;
+    pool->unfinished = num_tasks;
+    pool->ready = ready;
+    pool->step = step;
+    for (i = 0; i < num_tasks; i++) {
+        pool->tasks[i].arg = args[i];
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    return pool;
+}
+
+//starts the workers
+//returns 0 if they can't all be started, any that were are stopped again
+int start_detect_pool(struct DetectPool *pool) {
+    int i;
+
+    for (i = 0; i < pool->num_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, do_pool_work, pool) != 0) {
+            stop_detect_pool(pool);
+            return 0;
+        }
+        pool->started++;
+    }
+    return 1;
+}
+
+//stops the workers once they finish the step they are on, stats stay readable
+void stop_detect_pool(struct DetectPool *pool) {
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pool->started = 0;
+}
+
+//stops the pool, if still running, and frees it
+void free_detect_pool(struct DetectPool *pool) {
+    if (!pool)
+        return;
+
+    stop_detect_pool(pool);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->tasks);
+    free(pool->workers);
+    free(pool);
+}
+
+//wakes a worker to look for work, call when a task may have become ready
+void detect_pool_notify(struct DetectPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+//waits up to timeout_ms for every task to finish
+//returns 1 once they have
+int wait_detect_pool(struct DetectPool *pool,
+                     int timeout_ms) {
+    struct timespec deadline;
+    int done;
+
+    pool_deadline(&deadline, timeout_ms);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->unfinished > 0) {
+        if (pthread_cond_timedwait(&pool->done_cond, &pool->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    done = pool->unfinished == 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    return done;
+}
+
+//worker thread, steps the fairest ready task until stopped
+void *do_pool_work(void *arg) {
+    struct DetectPool *pool = arg;
+    struct PoolTask *task, *t;
+    struct timespec deadline;
+    double start, elapsed;
+    int i, ret;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stopping) {
+        //ready task that has gone longest without a turn
+        task = NULL;
+        for (i = 0; i < pool->num_tasks; i++) {
+            t = &pool->tasks[i];
+            if (t->busy || t->finished || !pool->ready(t->arg))
+                continue;
+            if (!task || t->last_run < task->last_run)
+                task = t;
+        }
+        if (!task) {
+            //notify wakes us as soon as a frame arrives, the timeout is a backstop
+            pool_deadline(&deadline, POOL_IDLE_WAIT_MS);
+            pthread_cond_timedwait(&pool->work_cond, &pool->lock, &deadline);
+            continue;
+        }
+
+        task->busy = 1;
+        start = get_monotonic_time();
+        task->last_run = start;
+        pthread_mutex_unlock(&pool->lock);
+
+        ret = pool->step(task->arg);
+        elapsed = get_monotonic_time() - start;
+
+        pthread_mutex_lock(&pool->lock);
+        task->busy = 0;
+        task->run_time += elapsed;
+        if (ret > 0)
+            task->steps++;
+        if (ret < 0) {
+            task->finished = 1;
+            if (--pool->unfinished == 0)
+                pthread_cond_broadcast(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+//sets ts to timeout_ms from now, on the clock pthread_cond_timedwait uses
+void pool_deadline(struct timespec *ts,
+                   int timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
@@ -38,6 +38,19 @@ struct PointList {
     struct PointList *next;
 };
 
+//storage kept between calls to filter_entities_mask1, it only grows, so filtering
+//a scene no busier than one already seen allocates nothing
+//the entity list returned is built in it and is valid until the next call
+struct EntityStore {
+    struct Entity *entity;          //entities that passed the filter
+    struct EntityList *node;        //list nodes, linked over entity before returning
+    int entities;
+    int entity_capacity;
+    int *points;                    //fill queue of pixel offsets
+    int point_capacity;
+    struct Gray8 *tagged;           //the mask unpacked to 8 bits for tagging
+};
+
 //---------------------
 //function declarations
 //---------------------
@@ -55,6 +68,15 @@ struct EntityList *filter_entities(struct BMP *segmap,
                                    struct EntityFilter filter,
                                    int tag_segmap);
 
+struct EntityList *filter_entities_gray8(struct Gray8 *segmap,
+                                         struct EntityFilter filter,
+                                         int tag_segmap,
+                                         struct EntityStore *store);
+
+struct EntityList *filter_entities_mask1(struct Mask1 *mask,
+                                         struct EntityFilter filter,
+                                         struct EntityStore *store);
+
 struct EntityList *old_filter_entities(struct BMP *segmap,
                                   struct BMP *tagged_segmap,
                                   struct EntityList *entities,
@@ -81,6 +103,15 @@ struct EntityList *init_entity_list(struct Entity *entity);
 struct EntityList *add_entity(struct EntityList *head,
                               struct Entity *entity);
 
+void free_entity_list(struct EntityList *el);
+
+struct EntityStore *init_entity_store();
+
+void free_entity_store(struct EntityStore *store);
+
+int reserve_entity_store(struct EntityStore *store,
+                         int entities);
+
 struct PointList *init_point_list(int x,
                                   int y);
 
@@ -106,6 +137,7 @@ void print_filter(struct EntityFilter ef);
 struct EntityList *find_entities(struct BMP *segmap) {
     struct Entity *new_entity;
     struct EntityList *elist;
+    unsigned char *row;
     unsigned char id;
     int x, y;
     
@@ -117,9 +149,10 @@ struct EntityList *find_entities(struct BMP *segmap) {
     
     //iterate through pixel data
     for (y = 0; y < segmap->image_header->height; y++) {
+        row = get_row(segmap, y);
         for (x = 0; x < segmap->image_header->width; x++) {
             //check for foreground pixel
-            if (is_foreground(get_pixel(segmap, x, y))) {
+            if (is_foreground(read_pixel(row + 3 * x))) {
                 
                 //make Entity struct
                 new_entity = init_entity(id, x, y);
@@ -156,7 +189,8 @@ void target_tag_entity(struct BMP *segmap,
                 struct Pixel target) {
     struct Pixel tag;
     struct PointList *queue;
-    int x, y;
+    unsigned char *p;
+    int x, y, sl;
     unsigned int id;
     
     //get start point from initial entity struct
@@ -166,6 +200,9 @@ void target_tag_entity(struct BMP *segmap,
     id = entity->id;
     tag = make_pixel(id, id, id); //pixel used to tag in segmap
     
+    //rows are stored bottom-up, so the row below is a scanline back
+    sl = segmap->scanline_size;
+    
     //pop initial point to queue
     queue = init_point_list(x, y);
     
@@ -192,27 +229,28 @@ void target_tag_entity(struct BMP *segmap,
         queue = pop_point(queue);
         
         //tag current position
-        set_pixel(segmap, x, y, tag);
+        p = get_span(segmap, x, y);
+        write_pixel(p, tag);
         
         //add children
         //right
         if (x < segmap->image_header->width-1 &&
-            pixels_match(target, get_pixel(segmap, x+1, y))) {
+            pixels_match(target, read_pixel(p + 3))) {
             queue = add_point(queue, x+1, y);
         }
         //down
         if (y < segmap->image_header->height-1 &&
-            pixels_match(target, get_pixel(segmap, x, y+1))) {
+            pixels_match(target, read_pixel(p - sl))) {
             queue = add_point(queue, x, y+1);
         }
         //left
         if (x > 0 &&
-            pixels_match(target, get_pixel(segmap, x-1, y))) {
+            pixels_match(target, read_pixel(p - 3))) {
             queue = add_point(queue, x-1, y);
         }
         //up
         if (y > 0 &&
-            pixels_match(target, get_pixel(segmap, x, y-1))) {
+            pixels_match(target, read_pixel(p + sl))) {
             queue = add_point(queue, x, y-1);
         }
     }
@@ -223,7 +261,7 @@ void target_tag_entity(struct BMP *segmap,
 //searches segmap for 'entities' and returns list of those that passed filter
 //entities that fail to pass filter are blacked out of segmap
 //if tag_segmap 1, entities will be tagged with pixels as their id values
-//if tag_segmap 1, note there is a max id range of 0-255 for pixel tagging
+//if tag_segmap 1, note there is a max id range of 1-254 for pixel tagging, ids wrap after it
 struct EntityList *filter_entities(struct BMP *segmap,
                                    struct EntityFilter filter,
                                    int tag_segmap) {
@@ -231,6 +269,7 @@ struct EntityList *filter_entities(struct BMP *segmap,
     struct Pixel p;
     struct Entity *new_entity;
     struct EntityList *elist;
+    unsigned char *row;
     unsigned char id;
     int x, y;
     
@@ -241,9 +280,10 @@ struct EntityList *filter_entities(struct BMP *segmap,
     
     //iterate through pixel data to initially tag
     for (y = 0; y < segmap->image_header->height; y++) {
+        row = get_row(segmap, y);
         for (x = 0; x < segmap->image_header->width; x++) {
             //check for foreground pixel
-            if (is_foreground(get_pixel(segmap, x, y))) {
+            if (is_foreground(read_pixel(row + 3 * x))) {
                 //make Entity struct
                 new_entity = init_entity(id, x, y);
                 
@@ -260,7 +300,8 @@ struct EntityList *filter_entities(struct BMP *segmap,
                 } else {
                     //add to list
                     elist = add_entity(elist, new_entity); 
-                    id++;
+                    //255 is foreground, tagging with it would never finish
+                    id = id == 254 ? 1 : id + 1;
                 }
             }
         }
@@ -268,9 +309,10 @@ struct EntityList *filter_entities(struct BMP *segmap,
     if (!tag_segmap) {
         //for each pixel in segmap
         for (y = 0; y < segmap->image_header->height; y++) {
+            row = get_row(segmap, y);
             for (x = 0; x < segmap->image_header->width; x++) {
                 //get pixel
-                p = get_pixel(segmap, x, y);
+                p = read_pixel(row + 3 * x);
                 //if 0,0,0 then do next pixel
                 if (is_background(p)) {
                     continue;
@@ -284,7 +326,7 @@ struct EntityList *filter_entities(struct BMP *segmap,
                     if (p.red == tmp->entity->id &&
                         p.green == tmp->entity->id &&
                         p.blue == tmp->entity->id) {
-                        set_pixel(segmap, x, y, make_pixel(255,255,255));
+                        write_pixel(row + 3 * x, make_pixel(255,255,255));
                         break;
                     }
                     tmp = tmp->next;
@@ -295,6 +337,150 @@ struct EntityList *filter_entities(struct BMP *segmap,
     return elist;
 }
 
+//filter_entities for an 8 bit segmap, 255 is foreground
+//entities that fail the filter are blacked out, the rest are left as 255 or,
+//if tag_segmap 1, tagged with their id (ids wrap after 254)
+//regions are filled through a single array of pixel offsets, which also lists
+//the pixels to black out, so no pixel is visited more than twice
+//the entities and the fill queue are kept in store, which owns the list returned
+//returns NULL if there are no entities or on memory error
+struct EntityList *filter_entities_gray8(struct Gray8 *segmap,
+                                         struct EntityFilter filter,
+                                         int tag_segmap,
+                                         struct EntityStore *store) {
+    struct Entity e;
+    unsigned char *px;
+    unsigned char id;
+    int *points, *grown;
+    int capacity, count, head, width, height, i, p, x, y;
+
+    width = segmap->width;
+    height = segmap->height;
+    px = segmap->pixel_data;
+    id = 1;
+    store->entities = 0;
+
+    if (!store->points) {
+        store->points = malloc(1024 * sizeof(int));
+        if (!store->points)
+            return NULL;
+        store->point_capacity = 1024;
+    }
+    points = store->points;
+    capacity = store->point_capacity;
+
+    for (i = 0; i < width * height; i++) {
+        if (px[i] != 255)
+            continue;
+
+        e.id = id;
+        e.mass = 0;
+        e.minx = e.maxx = i % width;
+        e.miny = e.maxy = i / width;
+
+        //breadth first fill, pixels are tagged as they are queued
+        count = 0;
+        points[count++] = i;
+        px[i] = id;
+        for (head = 0; head < count; head++) {
+            //room for the four neighbours
+            if (count + 4 > capacity) {
+                grown = realloc(points, capacity * 2 * sizeof(int));
+                if (!grown)
+                    break;
+                points = store->points = grown;
+                capacity = store->point_capacity = capacity * 2;
+            }
+            p = points[head];
+            x = p % width;
+            y = p / width;
+
+            e.mass += 1;
+            if (x < e.minx) {
+                e.minx = x;
+            } else if (x > e.maxx) {
+                e.maxx = x;
+            }
+            if (y < e.miny) {
+                e.miny = y;
+            } else if (y > e.maxy) {
+                e.maxy = y;
+            }
+
+            //right, down, left, up
+            if (x < width - 1 && px[p + 1] == 255) {
+                px[p + 1] = id;
+                points[count++] = p + 1;
+            }
+            if (y < height - 1 && px[p + width] == 255) {
+                px[p + width] = id;
+                points[count++] = p + width;
+            }
+            if (x > 0 && px[p - 1] == 255) {
+                px[p - 1] = id;
+                points[count++] = p - 1;
+            }
+            if (y > 0 && px[p - width] == 255) {
+                px[p - width] = id;
+                points[count++] = p - width;
+            }
+        }
+
+        if (!passes_filter(&e, filter)) {
+            //blackout
+            for (head = 0; head < count; head++) {
+                px[points[head]] = 0;
+            }
+        } else {
+            if (!reserve_entity_store(store, store->entities + 1))
+                break;
+            store->entity[store->entities++] = e;
+            //255 marks untagged foreground, so tags stop short of it
+            id = id == 254 ? 1 : id + 1;
+        }
+    }
+
+    if (!tag_segmap) {
+        for (i = 0; i < width * height; i++) {
+            if (px[i])
+                px[i] = 255;
+        }
+    }
+
+    //the entity array may have moved while growing, so the list is linked last
+    for (i = 0; i < store->entities; i++) {
+        store->node[i].entity = &store->entity[i];
+        store->node[i].next = i + 1 < store->entities ? &store->node[i + 1] : NULL;
+    }
+    return store->entities > 0 ? store->node : NULL;
+}
+
+//filter_entities for a one bit mask, entities that fail the filter are cleared
+//a mask can't hold ids, so it is unpacked to 8 bits to tag, filtered, and packed again
+//the list returned belongs to store, don't free it
+//returns NULL if there are no entities or on memory error
+struct EntityList *filter_entities_mask1(struct Mask1 *mask,
+                                         struct EntityFilter filter,
+                                         struct EntityStore *store) {
+    struct EntityList *elist;
+
+    if (store->tagged && (store->tagged->width != mask->width ||
+                          store->tagged->height != mask->height)) {
+        free_gray8(store->tagged);
+        store->tagged = NULL;
+    }
+    if (!store->tagged) {
+        store->tagged = init_gray8(mask->width, mask->height);
+        if (!store->tagged)
+            return NULL;
+    }
+    mask1_to_gray8(mask, store->tagged);
+    elist = filter_entities_gray8(store->tagged, filter, 0, store);
+    gray8_to_mask1(store->tagged, mask);
+
+    return elist;
+}
+
 //filters entities from the segmap and tagged_segmap
 //returns list of remaining entities
 //filtered entities are 'blacked out' from both segmap and tagged_segmap
@@ -304,6 +490,7 @@ struct EntityList *old_filter_entities(struct BMP *segmap,
                                        struct EntityFilter filter) {
     struct EntityList *tmp, *filtered, *passed;
     struct Pixel p;
+    unsigned char *row, *tagged_row;
     int x, y;
     
     filtered = passed = NULL;
@@ -326,9 +513,11 @@ struct EntityList *old_filter_entities(struct BMP *segmap,
     
     //for each pixel in segmap
     for (y = 0; y < segmap->image_header->height; y++) {
+        row = get_row(segmap, y);
+        tagged_row = get_row(tagged_segmap, y);
         for (x = 0; x < segmap->image_header->width; x++) {
             //get pixel
-            p = get_pixel(tagged_segmap, x, y);
+            p = read_pixel(tagged_row + 3 * x);
             //if 0,0,0 then do next pixel
             if (is_background(p)) {
                 continue;
@@ -342,8 +531,8 @@ struct EntityList *old_filter_entities(struct BMP *segmap,
                 if (p.red == tmp->entity->id &&
                     p.green == tmp->entity->id &&
                     p.blue == tmp->entity->id) {
-                    set_pixel(segmap, x, y, make_pixel(0,0,0));
-                    set_pixel(tagged_segmap, x, y, make_pixel(0,0,0));
+                    write_pixel(row + 3 * x, make_pixel(0,0,0));
+                    write_pixel(tagged_row + 3 * x, make_pixel(0,0,0));
                     break;
                 }
                 tmp = tmp->next;
@@ -461,6 +650,61 @@ struct EntityList *add_entity(struct EntityList *head,
     return el;
 }
 
+//frees the given entity list and its entities
+void free_entity_list(struct EntityList *el) {
+    struct EntityList *tmp;
+    while (el != NULL) {
+        tmp = el->next;
+        free(el->entity);
+        free(el);
+        el = tmp;
+    }
+}
+
+//creates an empty entity store, its buffers are made on first use
+//returns NULL on memory error
+struct EntityStore *init_entity_store() {
+    return calloc(1, sizeof(struct EntityStore));
+}
+
+//frees the store and the last list built in it
+void free_entity_store(struct EntityStore *store) {
+    if (!store)
+        return;
+    free(store->entity);
+    free(store->node);
+    free(store->points);
+    if (store->tagged)
+        free_gray8(store->tagged);
+    free(store);
+}
+
+//makes room for at least the given number of entities, doubling as it grows
+//returns 0 on memory error, leaving the store as it was
+int reserve_entity_store(struct EntityStore *store,
+                         int entities) {
+    struct Entity *entity;
+    struct EntityList *node;
+    int capacity;
+
+    if (entities <= store->entity_capacity)
+        return 1;
+    capacity = store->entity_capacity > 0 ? store->entity_capacity : 16;
+    while (capacity < entities)
+        capacity *= 2;
+
+    entity = realloc(store->entity, capacity * sizeof(struct Entity));
+    if (!entity)
+        return 0;
+    store->entity = entity;
+    node = realloc(store->node, capacity * sizeof(struct EntityList));
+    if (!node)
+        return 0;
+    store->node = node;
+    store->entity_capacity = capacity;
+    return 1;
+}
+
 //initialises a point list node with the given values
 struct PointList *init_point_list(int x,
                                   int y) {
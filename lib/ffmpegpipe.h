@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define FFMPEG_PIPE_RETRIES 3
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a single ffmpeg child writing bgr24 (or gray) frames to a pipe for as long as we run
+struct FFmpegPipe {
+    pid_t pid;               //pid of ffmpeg child, -1 if not running
+    int fd;                  //read end of the frame pipe
+    char *ffmpeg_path;
+    char *device;
+    char *resolution;        //widthxheight, as given to ffmpeg
+    unsigned int width;
+    unsigned int height;
+    int luma;                //ffmpeg sends top-down 8 bit luma instead of bgr
+    int restarts;            //number of times the child has been restarted
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct FFmpegPipe *open_ffmpeg_pipe(char *ffmpeg_path,
+                                    char *device,
+                                    char *resolution,
+                                    int luma);
+
+int read_ffmpeg_frame(struct FFmpegPipe *fp,
+                      struct BMP *frame);
+
+int read_ffmpeg_luma(struct FFmpegPipe *fp,
+                     struct Gray8 *frame);
+
+void close_ffmpeg_pipe(struct FFmpegPipe *fp);
+
+int start_ffmpeg_child(struct FFmpegPipe *fp);
+
+void stop_ffmpeg_child(struct FFmpegPipe *fp);
+
+int read_full(int fd,
+              unsigned char *buf,
+              size_t len);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//starts ffmpeg capturing from device and streaming raw frames back to us
+//if luma is set ffmpeg only sends the 8 bit luma of each frame
+//returns NULL if resolution is invalid or ffmpeg can't be started
+struct FFmpegPipe *open_ffmpeg_pipe(char *ffmpeg_path,
+                                    char *device,
+                                    char *resolution,
+                                    int luma) {
+    struct FFmpegPipe *fp;
+
+    fp = calloc(sizeof(struct FFmpegPipe), 1);
+    if (!fp)
+        return NULL;
+
+    if (!parse_resolution(resolution, &fp->width, &fp->height)) {
+        free(fp);
+        return NULL;
+    }
+
+    fp->pid = -1;
+    fp->fd = -1;
+    fp->ffmpeg_path = ffmpeg_path;
+    fp->device = device;
+    fp->resolution = resolution;
+    fp->luma = luma;
+
+    if (!start_ffmpeg_child(fp)) {
+        free(fp);
+        return NULL;
+    }
+
+    return fp;
+}
+
+//reads the next frame from the pipe straight into the pixel data of frame
+//restarts ffmpeg if it has died, the caller only sees a slower frame
+//returns 1 on success
+int read_ffmpeg_frame(struct FFmpegPipe *fp,
+                      struct BMP *frame) {
+    int y, attempt, row_size, ok;
+
+    if (frame->image_header->width != fp->width ||
+        frame->image_header->height != fp->height || fp->luma)
+        return 0;
+
+    row_size = fp->width * 3;
+
+    for (attempt = 0; attempt < FFMPEG_PIPE_RETRIES; attempt++) {
+        if (fp->pid == -1 && !start_ffmpeg_child(fp)) {
+            sleep(1);
+            continue;
+        }
+
+        //frames arrive bottom-up (vflip) so rows land in BMP order
+        if (row_size == frame->scanline_size) {
+            ok = read_full(fp->fd, frame->pixel_data, row_size * fp->height);
+        } else {
+            //rows are padded in the BMP, read one row at a time
+            ok = 1;
+            for (y = 0; y < fp->height && ok; y++) {
+                ok = read_full(fp->fd, frame->pixel_data + (y * frame->scanline_size), row_size);
+            }
+        }
+
+        if (ok)
+            return 1;
+
+        //child has died or the pipe is broken, restart it
+        stop_ffmpeg_child(fp);
+        fp->restarts++;
+    }
+
+    return 0;
+}
+
+//reads the next luma frame from the pipe straight into frame
+//restarts ffmpeg if it has died, the caller only sees a slower frame
+//returns 1 on success
+int read_ffmpeg_luma(struct FFmpegPipe *fp,
+                     struct Gray8 *frame) {
+    int attempt;
+
+    if (frame->width != fp->width || frame->height != fp->height || !fp->luma)
+        return 0;
+
+    for (attempt = 0; attempt < FFMPEG_PIPE_RETRIES; attempt++) {
+        if (fp->pid == -1 && !start_ffmpeg_child(fp)) {
+            sleep(1);
+            continue;
+        }
+
+        //rows are unpadded and top-down, the same as a Gray8
+        if (read_full(fp->fd, frame->pixel_data, (size_t) fp->width * fp->height))
+            return 1;
+
+        //child has died or the pipe is broken, restart it
+        stop_ffmpeg_child(fp);
+        fp->restarts++;
+    }
+
+    return 0;
+}
+
+//stops ffmpeg and frees the pipe
+void close_ffmpeg_pipe(struct FFmpegPipe *fp) {
+    if (!fp)
+        return;
+    stop_ffmpeg_child(fp);
+    free(fp);
+}
+
+//forks ffmpeg with its stdout connected to a new pipe
+//returns 1 on success
+int start_ffmpeg_child(struct FFmpegPipe *fp) {
+    int pipefd[2];
+    int devnull;
+    pid_t pid;
+    char *args[20];
+
+    //close on exec so recording children don't hold the frame pipe open
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
+        return 0;
+
+    // ffmpeg args
+    args[0] = fp->ffmpeg_path;
+    //-loglevel panic
+    args[1] = "-loglevel";
+    args[2] = "panic";
+    // -f video4linux2 -i videodevice
+    args[3] = "-f";
+    args[4] = "video4linux2";
+    args[5] = "-i";
+    args[6] = fp->device;
+    // -s
+    args[7] = "-s";
+    args[8] = fp->resolution;
+    //flip so rows come out bottom-up like a BMP
+    args[9] = "-vf";
+    args[10] = "vflip";
+    // -f rawvideo -pix_fmt bgr24
+    args[11] = "-f";
+    args[12] = "rawvideo";
+    args[13] = "-pix_fmt";
+    args[14] = "bgr24";
+    // stdout
+    args[15] = "pipe:1";
+    args[16] = (char *) NULL;
+    //luma stays top-down and only the Y plane is sent
+    if (fp->luma) {
+        args[9] = "-f";
+        args[10] = "rawvideo";
+        args[11] = "-pix_fmt";
+        args[12] = "gray";
+        args[13] = "pipe:1";
+        args[14] = (char *) NULL;
+    }
+
+    pid = fork();
+
+    //fork error return
+    if (pid == -1) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 0;
+    //child - exec with stdout as write end of pipe
+    } else if (pid == 0) {
+        dup2(pipefd[1], STDOUT_FILENO);
+        devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDIN_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        execv(fp->ffmpeg_path, args);
+        _exit(EXIT_FAILURE);
+    }
+
+    //parent - keep read end
+    close(pipefd[1]);
+    fp->pid = pid;
+    fp->fd = pipefd[0];
+    return 1;
+}
+
+//stops the ffmpeg child, if running, and closes the pipe
+void stop_ffmpeg_child(struct FFmpegPipe *fp) {
+    if (fp->fd != -1) {
+        close(fp->fd);
+        fp->fd = -1;
+    }
+    if (fp->pid != -1) {
+        kill(fp->pid, SIGTERM);
+        waitpid(fp->pid, NULL, 0);
+        fp->pid = -1;
+    }
+}
+
+//reads exactly len bytes from fd into buf
+//returns 1 on success, 0 on eof or error
+int read_full(int fd,
+              unsigned char *buf,
+              size_t len) {
+    ssize_t r;
+    while (len > 0) {
+        r = read(fd, buf, len);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return 0;
+        buf += r;
+        len -= r;
+    }
+    return 1;
+}
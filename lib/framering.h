@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+//what the producer does when the detector has fallen behind and the ring is full
+#define RING_DROP_OLDEST 0  //discard the oldest waiting frame, keep the newest
+#define RING_DROP_NEWEST 1  //discard the frame that was just captured
+#define RING_BLOCK       2  //wait for the detector to take a frame
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a preallocated frame handed between the capture and detector threads
+struct Frame {
+    struct BMP *img;       //bgr frame, NULL for a luma only ring
+    struct Gray8 *luma;    //luma frame, NULL unless the ring is luma only
+    unsigned long seq;     //capture sequence number
+    double capture_time;   //monotonic time the frame was captured
+};
+
+//single producer / single consumer ring of captured frames
+//frames are never copied, only pointers move between the two threads:
+//  ready     - captured frames waiting for the detector (producer -> consumer)
+//  recycled  - frames the detector has finished with (consumer -> producer)
+struct FrameRing {
+    int size;                  //capacity of the ready ring
+    int policy;                //RING_* policy when ready is full
+    int frame_count;           //frames in the pool, size + one for the producer + those the consumer holds
+    struct Frame *frames;      //the pool
+    struct Frame **ready;
+    struct Frame **recycled;
+    struct Frame *spare;       //producer owned frame waiting to be reused
+    _Atomic unsigned long head;            //next ready slot to write (producer)
+    _Atomic unsigned long tail;            //next ready slot to read (consumer)
+    _Atomic unsigned long recycled_head;   //next recycled slot to write (consumer)
+    _Atomic unsigned long recycled_tail;   //next recycled slot to read (producer)
+    _Atomic unsigned long captured;
+    _Atomic unsigned long delivered;
+    _Atomic unsigned long dropped;
+    _Atomic int peak_occupancy;
+    _Atomic int closed;
+};
+
+//snapshot of the ring counters
+struct FrameRingStats {
+    unsigned long captured;   //frames captured by the producer
+    unsigned long delivered;  //frames taken by the consumer
+    unsigned long dropped;    //frames discarded by the policy
+    int occupancy;            //frames currently waiting
+    int peak_occupancy;       //most frames ever waiting at once
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct FrameRing *init_frame_ring(int size,
+                                  int policy,
+                                  unsigned int width,
+                                  unsigned int height,
+                                  int luma,
+                                  int held);
+
+void free_frame_ring(struct FrameRing *ring);
+
+struct Frame *ring_acquire_write(struct FrameRing *ring);
+
+void ring_return_write(struct FrameRing *ring,
+                       struct Frame *frame);
+
+int ring_publish(struct FrameRing *ring,
+                 struct Frame *frame);
+
+struct Frame *ring_acquire_read(struct FrameRing *ring,
+                                int timeout_ms);
+
+void ring_release_read(struct FrameRing *ring,
+                       struct Frame *frame);
+
+void ring_flush(struct FrameRing *ring);
+
+void ring_close(struct FrameRing *ring);
+
+int ring_is_closed(struct FrameRing *ring);
+
+int ring_waiting(struct FrameRing *ring);
+
+struct FrameRingStats get_ring_stats(struct FrameRing *ring);
+
+void print_ring_stats(struct FrameRingStats stats);
+
+double get_monotonic_time();
+
+void ring_wait(int *spins);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a ring of size slots with every frame preallocated at width x height
+//frames are bgr BMPs, or 8 bit luma if luma is set
+//held is the most frames the consumer keeps acquired at once
+struct FrameRing *init_frame_ring(int size,
+                                  int policy,
+                                  unsigned int width,
+                                  unsigned int height,
+                                  int luma,
+                                  int held) {
+    struct FrameRing *ring;
+    int i;
+
+    ring = calloc(sizeof(struct FrameRing), 1);
+    if (!ring)
+        return NULL;
+
+    ring->size = size;
+    ring->policy = policy;
+    //one frame being filled by the producer, the rest held by the consumer
+    ring->frame_count = size + 1 + (held > 1 ? held : 1);
+
+    ring->frames = calloc(ring->frame_count, sizeof(struct Frame));
+    ring->ready = calloc(size, sizeof(struct Frame *));
+    ring->recycled = calloc(ring->frame_count, sizeof(struct Frame *));
+    if (!ring->frames || !ring->ready || !ring->recycled) {
+        free_frame_ring(ring);
+        return NULL;
+    }
+
+    //every frame starts out on the recycled ring, owned by the producer
+    for (i = 0; i < ring->frame_count; i++) {
+        if (luma)
+            ring->frames[i].luma = init_gray8(width, height);
+        else
+            ring->frames[i].img = init_BMP(width, height);
+        if (!ring->frames[i].img && !ring->frames[i].luma) {
+            free_frame_ring(ring);
+            return NULL;
+        }
+        ring->recycled[i] = &ring->frames[i];
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->recycled_head, ring->frame_count);
+    atomic_init(&ring->recycled_tail, 0);
+    atomic_init(&ring->captured, 0);
+    atomic_init(&ring->delivered, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->peak_occupancy, 0);
+    atomic_init(&ring->closed, 0);
+
+    return ring;
+}
+
+//frees the ring and all of its frames
+//both threads must be finished with the ring
+void free_frame_ring(struct FrameRing *ring) {
+    int i;
+    if (!ring)
+        return;
+    if (ring->frames) {
+        for (i = 0; i < ring->frame_count; i++) {
+            if (ring->frames[i].img)
+                free_BMP(ring->frames[i].img);
+            free_gray8(ring->frames[i].luma);
+        }
+    }
+    free(ring->frames);
+    free(ring->ready);
+    free(ring->recycled);
+    free(ring);
+}
+
+//producer: gets an empty frame to capture into
+//there is always one available, the pool is sized so it can't run dry
+struct Frame *ring_acquire_write(struct FrameRing *ring) {
+    struct Frame *frame;
+    unsigned long t;
+    int spins = 0;
+
+    //reuse a frame reclaimed by a drop first
+    if (ring->spare) {
+        frame = ring->spare;
+        ring->spare = NULL;
+        return frame;
+    }
+
+    t = atomic_load_explicit(&ring->recycled_tail, memory_order_relaxed);
+    while (t == atomic_load_explicit(&ring->recycled_head, memory_order_acquire)) {
+        if (atomic_load(&ring->closed))
+            return NULL;
+        ring_wait(&spins);
+    }
+    frame = ring->recycled[t % ring->frame_count];
+    atomic_store_explicit(&ring->recycled_tail, t + 1, memory_order_release);
+    return frame;
+}
+
+//producer: gives back a frame from ring_acquire_write that won't be published, as when
+//a capture fails, it is the next one ring_acquire_write hands out
+void ring_return_write(struct FrameRing *ring,
+                       struct Frame *frame) {
+    //acquiring takes the spare first, so the slot is free for the frame it gave out
+    ring->spare = frame;
+}
+
+//producer: hands a captured frame to the consumer, applying the policy if full
+//returns 1 if the frame was queued, 0 if it (or an older frame) was dropped
+int ring_publish(struct FrameRing *ring,
+                 struct Frame *frame) {
+    unsigned long h, t;
+    int occupancy, peak, spins, dropped;
+
+    h = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    spins = 0;
+    dropped = 0;
+    atomic_fetch_add(&ring->captured, 1);
+
+    while (1) {
+        t = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (h - t < ring->size)
+            break;
+
+        //ring is full
+        if (ring->policy == RING_DROP_NEWEST) {
+            ring->spare = frame;
+            atomic_fetch_add(&ring->dropped, 1);
+            return 0;
+        } else if (ring->policy == RING_DROP_OLDEST) {
+            //race the consumer for the oldest frame, if we win we own it
+            if (atomic_compare_exchange_strong(&ring->tail, &t, t + 1)) {
+                ring->spare = ring->ready[t % ring->size];
+                atomic_fetch_add(&ring->dropped, 1);
+                dropped = 1;
+            }
+        } else {
+            if (atomic_load(&ring->closed)) {
+                ring->spare = frame;
+                return 0;
+            }
+            ring_wait(&spins);
+        }
+    }
+
+    ring->ready[h % ring->size] = frame;
+    atomic_store_explicit(&ring->head, h + 1, memory_order_release);
+
+    //track occupancy high water mark
+    occupancy = (h + 1) - t;
+    peak = atomic_load(&ring->peak_occupancy);
+    if (occupancy > peak)
+        atomic_store(&ring->peak_occupancy, occupancy);
+
+    return !dropped;
+}
+
+//consumer: takes the oldest waiting frame, without copying it
+//waits up to timeout_ms for one, returns NULL on timeout or if the ring is closed and empty
+struct Frame *ring_acquire_read(struct FrameRing *ring,
+                                int timeout_ms) {
+    struct Frame *frame;
+    unsigned long t, h;
+    double deadline;
+    int spins = 0;
+
+    deadline = get_monotonic_time() + (timeout_ms / 1000.0);
+
+    while (1) {
+        t = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        h = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (t != h) {
+            frame = ring->ready[t % ring->size];
+            //the producer may have dropped this frame under us, retry if so
+            if (atomic_compare_exchange_strong(&ring->tail, &t, t + 1)) {
+                atomic_fetch_add(&ring->delivered, 1);
+                return frame;
+            }
+            continue;
+        }
+        if (atomic_load(&ring->closed) || get_monotonic_time() >= deadline)
+            return NULL;
+        ring_wait(&spins);
+    }
+}
+
+//consumer: gives a frame back to the producer once the detector is done with it
+void ring_release_read(struct FrameRing *ring,
+                       struct Frame *frame) {
+    unsigned long h;
+    h = atomic_load_explicit(&ring->recycled_head, memory_order_relaxed);
+    ring->recycled[h % ring->frame_count] = frame;
+    atomic_store_explicit(&ring->recycled_head, h + 1, memory_order_release);
+}
+
+//consumer: discards every waiting frame, used after the capture has been paused
+void ring_flush(struct FrameRing *ring) {
+    struct Frame *frame;
+    while ((frame = ring_acquire_read(ring, 0)) != NULL) {
+        ring_release_read(ring, frame);
+    }
+}
+
+//marks the ring closed, wakes any waiting producer or consumer
+void ring_close(struct FrameRing *ring) {
+    atomic_store(&ring->closed, 1);
+}
+
+//returns 1 if the ring has been closed
+int ring_is_closed(struct FrameRing *ring) {
+    return atomic_load(&ring->closed);
+}
+
+//returns the number of frames waiting for the consumer
+int ring_waiting(struct FrameRing *ring) {
+    return atomic_load(&ring->head) - atomic_load(&ring->tail);
+}
+
+//returns a snapshot of the ring counters
+struct FrameRingStats get_ring_stats(struct FrameRing *ring) {
+    struct FrameRingStats stats;
+    stats.captured = atomic_load(&ring->captured);
+    stats.delivered = atomic_load(&ring->delivered);
+    stats.dropped = atomic_load(&ring->dropped);
+    stats.occupancy = atomic_load(&ring->head) - atomic_load(&ring->tail);
+    stats.peak_occupancy = atomic_load(&ring->peak_occupancy);
+    return stats;
+}
+
+//prints ring counters
+void print_ring_stats(struct FrameRingStats stats) {
+    printf("Frame Ring\ncaptured %lu\ndelivered %lu\ndropped %lu\noccupancy %d\npeak_occupancy %d\n",
+           stats.captured, stats.delivered, stats.dropped,
+           stats.occupancy, stats.peak_occupancy);
+}
+
+//returns monotonic clock time in seconds
+double get_monotonic_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+//backs off while waiting on the other thread, spins briefly then sleeps
+void ring_wait(int *spins) {
+    struct timespec ts;
+    if ((*spins)++ < 64) {
+        sched_yield();
+        return;
+    }
+    ts.tv_sec = 0;
+    ts.tv_nsec = 500000;
+    nanosleep(&ts, NULL);
+}
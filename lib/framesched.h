@@ -0,0 +1,164 @@
+#include <stdlib.h>
+
+//what the scheduler decides for a frame taken from the ring
+#define SCHED_PROCESS 0     //detect on it
+#define SCHED_SKIP 1        //drop it, the detection rate has already been met
+#define SCHED_COALESCE 2    //drop it for the newer frame waiting behind it, it would miss its deadline
+
+//change in the rate the scheduler detects at, returned by sched_done
+#define SCHED_STEADY 0
+#define SCHED_STEPPED_DOWN 1  //scene went static, detecting at the idle rate
+#define SCHED_STEPPED_UP 2    //change seen, back to the full rate
+
+#define SCHED_EARLY_FRACTION 0.25  //portion of an interval a frame may arrive early and still be due
+#define SCHED_WAKE_FRACTION 0.25   //portion of the event threshold that counts as change for stepping up
+#define SCHED_COST_WEIGHT 0.2      //weight of the newest frame in the running detection cost
+
+// ----------
+// STRUCTURES
+// ----------
+
+//decides which captured frames a camera detects on, to keep to a rate and a latency budget
+//frames are only ever dropped, a frame that is detected on is never degraded
+struct FrameScheduler {
+    double interval;         //seconds between detected frames at the full rate, 0 for every frame
+    double idle_interval;    //seconds between them once the scene is static, 0 to never step down
+    double max_latency;      //seconds from capture to decision, 0 for no budget
+    double idle_after;       //seconds without change before stepping down
+    double wake_threshold;   //change percent that counts as change
+    double next_due;         //capture time the next frame is due at
+    double last_change;      //capture time of the last frame with change
+    double cost;             //running average of seconds to detect on a frame
+    int idle;                //detecting at the idle rate
+    unsigned long processed; //frames detected on
+    unsigned long skipped;   //frames dropped to keep to the rate
+    unsigned long coalesced; //frames dropped for a newer one to keep to the budget
+    unsigned long missed;    //frames detected on after their deadline
+    unsigned long idle_periods; //times the scene went static
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct FrameScheduler *init_frame_scheduler(int target_fps,
+                                            int idle_fps,
+                                            int idle_seconds,
+                                            int max_latency_ms,
+                                            double change_percent_threshold);
+
+void free_frame_scheduler(struct FrameScheduler *sched);
+
+int sched_take(struct FrameScheduler *sched,
+               double capture_time,
+               int waiting,
+               double now);
+
+int sched_done(struct FrameScheduler *sched,
+               double capture_time,
+               double change_percent,
+               double started,
+               double now);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a scheduler for the given rates and budget, 0 turns each off
+//returns NULL on memory error
+struct FrameScheduler *init_frame_scheduler(int target_fps,
+                                            int idle_fps,
+                                            int idle_seconds,
+                                            int max_latency_ms,
+                                            double change_percent_threshold) {
+    struct FrameScheduler *sched;
+
+    sched = calloc(sizeof(struct FrameScheduler), 1);
+    if (!sched)
+        return NULL;
+
+    sched->interval = target_fps > 0 ? 1.0 / target_fps : 0.0;
+    sched->idle_interval = idle_fps > 0 ? 1.0 / idle_fps : 0.0;
+    sched->max_latency = max_latency_ms / 1000.0;
+    sched->idle_after = idle_seconds;
+    sched->wake_threshold = change_percent_threshold * SCHED_WAKE_FRACTION;
+    sched->last_change = -1.0;
+
+    return sched;
+}
+
+//frees the given scheduler
+void free_frame_scheduler(struct FrameScheduler *sched) {
+    free(sched);
+}
+
+//decides what to do with the frame captured at capture_time, waiting is the number
+//of newer frames behind it in the ring
+//returns SCHED_PROCESS, SCHED_SKIP or SCHED_COALESCE
+int sched_take(struct FrameScheduler *sched,
+               double capture_time,
+               int waiting,
+               double now) {
+    double interval;
+
+    //a newer frame can still make the budget when this one can't, never drop the last
+    if (sched->max_latency > 0 && waiting > 0
+        && (now - capture_time) + sched->cost > sched->max_latency) {
+        sched->coalesced++;
+        return SCHED_COALESCE;
+    }
+
+    interval = sched->idle ? sched->idle_interval : sched->interval;
+    if (interval > 0) {
+        //frames a little early are taken, capture jitter would otherwise halve the rate
+        if (capture_time < sched->next_due - interval * SCHED_EARLY_FRACTION) {
+            sched->skipped++;
+            return SCHED_SKIP;
+        }
+        sched->next_due += interval;
+        //fell behind, start the schedule again from this frame
+        if (sched->next_due < capture_time)
+            sched->next_due = capture_time + interval;
+    }
+
+    sched->processed++;
+    return SCHED_PROCESS;
+}
+
+//records the decision on a frame sched_take gave SCHED_PROCESS for
+//started is when detection on it began, now when the decision was made
+//returns SCHED_STEADY, or SCHED_STEPPED_DOWN or SCHED_STEPPED_UP when the rate changed
+int sched_done(struct FrameScheduler *sched,
+               double capture_time,
+               double change_percent,
+               double started,
+               double now) {
+    if (sched->processed == 1)
+        sched->cost = now - started;
+    else
+        sched->cost += SCHED_COST_WEIGHT * ((now - started) - sched->cost);
+
+    if (sched->max_latency > 0 && now - capture_time > sched->max_latency)
+        sched->missed++;
+
+    if (sched->last_change < 0)
+        sched->last_change = capture_time;
+
+    //back up to the full rate on the first frame with change
+    if (change_percent > sched->wake_threshold) {
+        sched->last_change = capture_time;
+        if (sched->idle) {
+            sched->idle = 0;
+            sched->next_due = capture_time;
+            return SCHED_STEPPED_UP;
+        }
+    } else if (!sched->idle && sched->idle_interval > 0
+               && capture_time - sched->last_change >= sched->idle_after) {
+        sched->idle = 1;
+        sched->idle_periods++;
+        sched->next_due = capture_time + sched->idle_interval;
+        return SCHED_STEPPED_DOWN;
+    }
+
+    return SCHED_STEADY;
+}
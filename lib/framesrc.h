@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+//kinds of frame source, matches the capture_mode config variable
+#define SOURCE_FFMPEG 0   //ffmpeg streaming raw frames from the video device
+#define SOURCE_V4L2   1   //the video device read directly through v4l2 mmap
+#define SOURCE_REPLAY 2   //frames replayed from disk
+#define SOURCE_SYNTH  3   //generated scene of moving objects
+
+//returned by read_frame_source when a finite source has no more frames
+#define SOURCE_END -1
+
+// ----------
+// STRUCTURES
+// ----------
+
+//something that produces frames for the detector, camera or otherwise
+//callers only use the fields here, impl belongs to the source type
+struct FrameSource {
+    int type;              //SOURCE_* kind of source
+    unsigned int width;
+    unsigned int height;
+    int live;              //1 if frames come from a real device
+    int luma;              //frames are read as 8 bit luma with read_frame_source_luma
+    struct BMP *scratch;   //bgr frame for sources that can only make bgr, luma only
+    void *impl;            //V4L2Capture, FFmpegPipe, ReplaySource or SynthSource
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct FrameSource *open_frame_source(struct SysConfig *config);
+
+int read_frame_source(struct FrameSource *src,
+                      struct BMP *frame);
+
+int read_frame_source_luma(struct FrameSource *src,
+                           struct Gray8 *frame);
+
+void close_frame_source(struct FrameSource *src);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//opens the frame source selected by the capture_mode of config
+//with luma_only set, cameras are asked for luma and other sources are converted
+//returns NULL if the source can't be opened
+struct FrameSource *open_frame_source(struct SysConfig *config) {
+    struct FrameSource *src;
+    struct V4L2Capture *v4l2;
+    struct FFmpegPipe *ffpipe;
+    struct ReplaySource *replay;
+    struct SynthSource *synth;
+    unsigned int width, height;
+
+    src = calloc(sizeof(struct FrameSource), 1);
+    if (!src)
+        return NULL;
+
+    src->type = config->capture_mode;
+    src->luma = config->luma_only;
+
+    switch (src->type) {
+        //v4l2, device is opened once and streams into mmap'd buffers
+        case SOURCE_V4L2:
+            if (!parse_resolution(config->resolution, &width, &height))
+                break;
+            v4l2 = open_v4l2_capture(config->video_device, width, height, src->luma);
+            if (!v4l2)
+                break;
+            src->width = v4l2->width;
+            src->height = v4l2->height;
+            src->live = 1;
+            src->impl = v4l2;
+            break;
+        //recorded frames from a directory or raw file
+        case SOURCE_REPLAY:
+            replay = open_replay_source(config->replay_path,
+                                        config->resolution,
+                                        config->replay_fps,
+                                        config->replay_loop,
+                                        config->mapped_io);
+            if (!replay)
+                break;
+            src->width = replay->width;
+            src->height = replay->height;
+            src->impl = replay;
+            break;
+        //generated scene at the configured resolution
+        case SOURCE_SYNTH:
+            if (!parse_resolution(config->resolution, &width, &height))
+                break;
+            synth = open_synth_source(width, height,
+                                      config->synth_objects,
+                                      config->synth_noise,
+                                      config->synth_drift,
+                                      config->synth_frames);
+            if (!synth)
+                break;
+            src->width = width;
+            src->height = height;
+            src->impl = synth;
+            break;
+        //ffmpeg, one long running child streaming raw frames over a pipe
+        default:
+            src->type = SOURCE_FFMPEG;
+            ffpipe = open_ffmpeg_pipe(config->ffmpeg_path,
+                                      config->video_device,
+                                      config->resolution,
+                                      src->luma);
+            if (!ffpipe)
+                break;
+            src->width = ffpipe->width;
+            src->height = ffpipe->height;
+            src->live = 1;
+            src->impl = ffpipe;
+            break;
+    }
+
+    if (!src->impl) {
+        free(src);
+        return NULL;
+    }
+
+    //recordings and the synthetic scene are bgr, their frames are converted once read
+    if (src->luma && (src->type == SOURCE_REPLAY || src->type == SOURCE_SYNTH)) {
+        src->scratch = init_BMP(src->width, src->height);
+        if (!src->scratch) {
+            close_frame_source(src);
+            return NULL;
+        }
+    }
+
+    return src;
+}
+
+//reads the next frame from the source into frame, frame must be width x height
+//returns 1 on success, 0 on error and SOURCE_END when a finite source runs out
+int read_frame_source(struct FrameSource *src,
+                      struct BMP *frame) {
+    switch (src->type) {
+        case SOURCE_V4L2:
+            return read_v4l2_frame(src->impl, frame);
+        case SOURCE_REPLAY:
+            return read_replay_frame(src->impl, frame);
+        case SOURCE_SYNTH:
+            return read_synth_frame(src->impl, frame);
+        default:
+            return read_ffmpeg_frame(src->impl, frame);
+    }
+}
+
+//reads the luma of the next frame from the source into frame, frame must be width x height
+//returns 1 on success, 0 on error and SOURCE_END when a finite source runs out
+int read_frame_source_luma(struct FrameSource *src,
+                           struct Gray8 *frame) {
+    int ret;
+
+    switch (src->type) {
+        case SOURCE_V4L2:
+            return read_v4l2_luma(src->impl, frame);
+        case SOURCE_REPLAY:
+        case SOURCE_SYNTH:
+            ret = src->type == SOURCE_REPLAY ? read_replay_frame(src->impl, src->scratch)
+                                             : read_synth_frame(src->impl, src->scratch);
+            if (ret == 1)
+                bgr_to_gray8(src->scratch, frame);
+            return ret;
+        default:
+            return read_ffmpeg_luma(src->impl, frame);
+    }
+}
+
+//closes the source and frees it
+void close_frame_source(struct FrameSource *src) {
+    if (!src)
+        return;
+
+    switch (src->type) {
+        case SOURCE_V4L2:
+            close_v4l2_capture(src->impl);
+            break;
+        case SOURCE_REPLAY:
+            close_replay_source(src->impl);
+            break;
+        case SOURCE_SYNTH:
+            close_synth_source(src->impl);
+            break;
+        default:
+            close_ffmpeg_pipe(src->impl);
+            break;
+    }
+
+    if (src->scratch)
+        free_BMP(src->scratch);
+    free(src);
+}
@@ -115,6 +115,7 @@ struct GaussianModel *init_gaussian_model(struct BMP *img,
     struct GaussianMixture *tmpm;
     struct GaussianPixel *tmpp;
     struct Pixel bg_pixel;
+    unsigned char *row;
     int x, y, i;
 
     model = malloc(sizeof(struct GaussianModel));
@@ -136,10 +137,11 @@ struct GaussianModel *init_gaussian_model(struct BMP *img,
         return NULL;
     
     //for each point in the map, initialize the mixture and pixels
-    for (x = 0; x < model->width; x++) {
-        for (y = 0; y < model->height; y++) {
+    for (y = 0; y < model->height; y++) {
+        row = get_row(img, y);
+        for (x = 0; x < model->width; x++) {
             //get pixel from init image
-            bg_pixel = get_pixel(img, x, y);
+            bg_pixel = read_pixel(row + 3 * x);
             //init space for pointers to k mixtures
             model->map[(y*model->width)+x] = malloc(k * sizeof(struct GaussianMixture *));
             if (!model->map[(y*model->width)+x])
@@ -170,6 +172,7 @@ struct BMP *generate_gaussian_seg_map(struct GaussianModel *model,
     struct GaussianMixture *gm;
     struct GaussianPixel *gp; 
     struct Pixel p;
+    unsigned char *row, *out;
     int x, y, k, is_bg;
     double wsum;
     double *priors, *sorted_priors;
@@ -189,8 +192,10 @@ struct BMP *generate_gaussian_seg_map(struct GaussianModel *model,
     seg_map = init_BMP(model->width, model->height);
     
     //for each point in the map
-    for (x = 0; x < model->width; x++) {
-        for (y = 0; y < model->height; y++) {
+    for (y = 0; y < model->height; y++) {
+        row = get_row(img, y);
+        out = get_row(seg_map, y);
+        for (x = 0; x < model->width; x++) {
             gm = model->map[(y * model->width) + x];
             is_bg = 0;
             wsum = 0;
@@ -207,7 +212,7 @@ struct BMP *generate_gaussian_seg_map(struct GaussianModel *model,
             sorted_indexes = get_sorted_indexes(priors, sorted_priors, model->k);
 
             //get the pixel at the location
-            p = get_pixel(img, x, y);
+            p = read_pixel(row + 3 * x);
             
             for (k = 0; k < model->k; k++) {
                 //check we are not yet > T
@@ -220,14 +225,14 @@ struct BMP *generate_gaussian_seg_map(struct GaussianModel *model,
                 
                 //check if pixel in img matches the kth distribution
                 if (matches_distribution(p, *gp)) {
-                    set_pixel(seg_map, x, y, make_pixel(0, 0, 0));
+                    write_pixel(out + 3 * x, make_pixel(0, 0, 0));
                     is_bg = 1;
                     break;
                 }
             }
             //if no distribution matched or > T, mark as foreground
             if (!is_bg) {
-                set_pixel(seg_map, x, y, make_pixel(255, 255, 255));
+                write_pixel(out + 3 * x, make_pixel(255, 255, 255));
             }
             
             //free sorted index list
@@ -250,6 +255,7 @@ int update_gaussian_model(struct GaussianModel *model,
     struct GaussianMixture *gm;
     struct GaussianPixel *gp;
     struct Pixel p, cp;
+    unsigned char *row, *seg_row;
     int x, y, k, worst, matched;
     double meanr, meang, meanb, valr, valg, valb, avg_val, avg_mean;
     double var;
@@ -269,12 +275,14 @@ int update_gaussian_model(struct GaussianModel *model,
     }
     
     //for each place in map
-    for (x = 0; x < model->width; x++) {
-        for (y = 0; y < model->height; y++) {
+    for (y = 0; y < model->height; y++) {
+        row = get_row(img, y);
+        seg_row = get_row(seg_map, y);
+        for (x = 0; x < model->width; x++) {
             //get gaussian mixture for this coordinate
             gm = model->map[(y*model->width)+x];
             //get segmap pixel at this coordinate
-            p = get_pixel(seg_map, x, y);
+            p = read_pixel(seg_row + 3 * x);
             //check if pixel is foreground classified
             if (is_foreground(p)) {
                 //gather 'ratings' (prior/variance) of pixels at this coordinate
@@ -285,7 +293,7 @@ int update_gaussian_model(struct GaussianModel *model,
                 worst = index_of_min(ratings, model->k);
                 gp = gm->mixture[worst]; //store pointer to the one to be deleted
                 //get pixel from change image
-                cp = get_pixel(img, x, y);
+                cp = read_pixel(row + 3 * x);
                 //replace worst rated pixel with newly observed pixel.
                 gp->meanr = cp.red;
                 gp->meang = cp.green;
@@ -295,7 +303,7 @@ int update_gaussian_model(struct GaussianModel *model,
                 gm->mixture[worst] = gp;
             } else {
                 //otherwise pixel is background
-                p = get_pixel(img, x, y);
+                p = read_pixel(row + 3 * x);
                 valr = p.red;
                 valg = p.green;
                 valb = p.blue;
@@ -336,6 +344,7 @@ struct BMP *generate_gaussian_background(struct GaussianModel *model) {
     struct GaussianPixel *pixel;
     struct Pixel newp;
     struct BMP *bg;
+    unsigned char *row;
     int x, y, i;
     double ratings[model->k];
     
@@ -345,8 +354,9 @@ struct BMP *generate_gaussian_background(struct GaussianModel *model) {
     
     //for each mixture within the map, set the pixel value at the same
     //location in the bg to the most likely gaussian by prior/variance
-    for (x = 0; x < model->width; x++) {
-        for (y = 0; y < model->height; y++) {
+    for (y = 0; y < model->height; y++) {
+        row = get_row(bg, y);
+        for (x = 0; x < model->width; x++) {
             tmp = model->map[(y*model->width)+x];
             //store ratings
             for (i = 0; i < model->k; i++) {
@@ -375,9 +385,7 @@ struct BMP *generate_gaussian_background(struct GaussianModel *model) {
             } else if (pixel->meanb < 0.0) {
                 newp.blue = 0;
             }
-            if (!set_pixel(bg, x, y, newp)) {
-                return NULL;
-            }
+            write_pixel(row + 3 * x, newp);
         }
     }
     
@@ -387,8 +395,8 @@ struct BMP *generate_gaussian_background(struct GaussianModel *model) {
 //frees the given gaussian model
 void free_gaussian_model(struct GaussianModel *model) {
     int x, y, i;
-    for (x = 0; x < model->width; x++) {
-        for (y = 0; y < model->height; y++) {
+    for (y = 0; y < model->height; y++) {
+        for (x = 0; x < model->width; x++) {
             for (i = 0; i < model->k; i++) {
                 free(model->map[(y*model->width)+x]->mixture[i]);
             }
@@ -1,38 +1,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <pthread.h>
 
 #define PI 3.14159265358979323846
-#define NUM_THREADS 4
 
 // ----------
 // STRUCTURES
 // ----------
 
+//the segmap is read from whichever of seg_map, gray_map and mask is set
 struct JobUpdateGMM {
     struct GaussianModel *model;
     struct BMP *seg_map;
     struct BMP *img;
-    int step;
+    struct Gray8 *gray_map;
+    struct Mask1 *mask;
+    struct JobPart part;
 };
 
 struct JobBackgroundGMM {
     struct GaussianModel *model;
     struct BMP *background;
-    int step;
+    struct JobPart part;
 };
 
+//the segmap is written to whichever of seg_map, gray_map and mask is set
 struct JobSegmentGMM {
     struct GaussianModel *model;
     struct BMP *img;
     struct BMP *seg_map;
-    int step;
+    struct Gray8 *gray_map;
+    struct Mask1 *mask;
+    struct JobPart part;
 };
 
 struct JobNormalizeGMM {
     struct GaussianModel *model;
-    int step;
+    struct JobPart part;
+};
+
+//one part of the frame updated with the frame before, normalised, then segmented
+struct JobUpdateSegmentGMM {
+    struct JobUpdateGMM update;
+    struct JobNormalizeGMM normalize;
+    struct JobSegmentGMM segment;
 };
 
 // ------------
@@ -49,6 +60,43 @@ struct BMP *generate_gaussian_background_thr(struct GaussianModel *model);
 struct BMP *generate_gaussian_seg_map_thr(struct GaussianModel *model,
                                          struct BMP *img);
 
+int segment_gaussian_model_thr(struct GaussianModel *model,
+                               struct BMP *img,
+                               struct BMP *seg_map);
+
+int segment_gaussian_model_gray8_thr(struct GaussianModel *model,
+                                     struct BMP *img,
+                                     struct Gray8 *seg_map);
+
+int segment_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                     struct BMP *img,
+                                     struct Mask1 *mask);
+
+int update_gaussian_model_gray8_thr(struct GaussianModel *model,
+                                    struct BMP *img,
+                                    struct Gray8 *seg_map);
+
+int update_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                    struct BMP *img,
+                                    struct Mask1 *mask);
+
+int update_segment_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                            struct BMP *prev_img,
+                                            struct Mask1 *prev_mask,
+                                            struct BMP *img,
+                                            struct Mask1 *mask);
+
+int run_gaussian_segment_jobs(struct JobSegmentGMM *job);
+
+int run_gaussian_update_jobs(struct JobUpdateGMM *job);
+
+int is_gaussian_foreground(struct GaussianModel *model,
+                           struct GaussianMixture *gm,
+                           struct Pixel p,
+                           double *priors,
+                           double *sorted_priors,
+                           int *sorted_indexes);
+
 int normalize_priors_thr(struct GaussianModel *model);
 
 int *get_sorted_indexes(double *initial_list, 
@@ -65,22 +113,7 @@ void *do_job_segment_gmm(void *job_struct);
 
 void *do_job_normalize_gmm(void *job_struct);
 
-struct JobUpdateGMM *create_job_update_gmm(struct GaussianModel *model,
-                                           struct BMP *img,
-                                           struct BMP *seg_map,
-                                           int step);
-
-struct JobBackgroundGMM *create_job_background_gmm(struct GaussianModel *model,
-                                                   struct BMP *background,
-                                                   int step);
-
-struct JobSegmentGMM *create_job_segment_gmm(struct GaussianModel *model,
-                                             struct BMP *img,
-                                             struct BMP *seg_map,
-                                             int step);
-
-struct JobNormalizeGMM *create_job_normalize_gmm(struct GaussianModel *model,
-                                                 int step);
+void *do_job_update_segment_gmm(void *job_struct);
 
 // ---------
 // FUNCTIONS
@@ -95,160 +128,165 @@ struct BMP *generate_gaussian_seg_map_thr(struct GaussianModel *model,
     if (!seg_map)
         return NULL;
     
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobSegmentGMM *t1_job, *t2_job, *t3_job, *t4_job;
-        
-    //create jobs
-    t1_job = create_job_segment_gmm(model, img, seg_map, 0);
-    t2_job = create_job_segment_gmm(model, img, seg_map, 1);
-    t3_job = create_job_segment_gmm(model, img, seg_map, 2);
-    t4_job = create_job_segment_gmm(model, img, seg_map, 3);
-            
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_segment_gmm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_segment_gmm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_segment_gmm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_segment_gmm, t4_job)) {
+    if (!segment_gaussian_model_thr(model, img, seg_map)) {
+        free_BMP(seg_map);
         return NULL;
     }
-        
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return NULL;
-    }
-    
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
     
     return seg_map;
 }
 
+//writes the segmentation map of the foreground of img into seg_map, which must be
+//the size of the model, so a caller can reuse the same map every frame
+//will return 0 if errors
+int segment_gaussian_model_thr(struct GaussianModel *model,
+                               struct BMP *img,
+                               struct BMP *seg_map) {
+    struct JobSegmentGMM job = {model, img, seg_map, NULL, NULL};
+    return run_gaussian_segment_jobs(&job);
+}
+
+//segment_gaussian_model_thr into an 8 bit map, foreground is 255 and background 0
+//will return 0 if errors
+int segment_gaussian_model_gray8_thr(struct GaussianModel *model,
+                                     struct BMP *img,
+                                     struct Gray8 *seg_map) {
+    struct JobSegmentGMM job = {model, img, NULL, seg_map, NULL};
+    return run_gaussian_segment_jobs(&job);
+}
+
+//segment_gaussian_model_thr into a one bit mask, foreground is set
+//will return 0 if errors
+int segment_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                     struct BMP *img,
+                                     struct Mask1 *mask) {
+    struct JobSegmentGMM job = {model, img, NULL, NULL, mask};
+    return run_gaussian_segment_jobs(&job);
+}
+
+//runs a copy of job for each part of the frame on the worker pool
+//will return 0 if errors
+int run_gaussian_segment_jobs(struct JobSegmentGMM *job) {
+    struct JobSegmentGMM jobs[MAX_BATCH_JOBS];
+    int i, steps;
+    
+    steps = get_job_count(job->model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i] = *job;
+        get_job_part(i, steps, job->model->height, 1, &jobs[i].part);
+    }
+    
+    return parallel_for(do_job_segment_gmm, jobs, sizeof(struct JobSegmentGMM), steps);
+}
+
 //updates the given model based on the given image and it's segmentation map
 //will return 0 if errors
 int update_gaussian_model_thr(struct GaussianModel *model,
                               struct BMP *img,
                               struct BMP *seg_map) {
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobUpdateGMM *t1_job, *t2_job, *t3_job, *t4_job;
-
-    //create jobs
-    t1_job = create_job_update_gmm(model, img, seg_map, 0);
-    t2_job = create_job_update_gmm(model, img, seg_map, 1);
-    t3_job = create_job_update_gmm(model, img, seg_map, 2);
-    t4_job = create_job_update_gmm(model, img, seg_map, 3);
-        
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_update_gmm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_update_gmm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_update_gmm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_update_gmm, t4_job)) {
-        return 0;
-    }
+    struct JobUpdateGMM job = {model, seg_map, img, NULL, NULL};
+    return run_gaussian_update_jobs(&job);
+}
+
+//update_gaussian_model_thr with an 8 bit segmap, foreground is 255
+//will return 0 if errors
+int update_gaussian_model_gray8_thr(struct GaussianModel *model,
+                                    struct BMP *img,
+                                    struct Gray8 *seg_map) {
+    struct JobUpdateGMM job = {model, NULL, img, seg_map, NULL};
+    return run_gaussian_update_jobs(&job);
+}
+
+//update_gaussian_model_thr with a one bit segmap, foreground is set
+//will return 0 if errors
+int update_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                    struct BMP *img,
+                                    struct Mask1 *mask) {
+    struct JobUpdateGMM job = {model, NULL, img, NULL, mask};
+    return run_gaussian_update_jobs(&job);
+}
+
+//updates the model with prev_img and its mask, normalises it and segments img into
+//mask, in one pass over the model instead of three
+//every pixel's mixture is updated before it is segmented, so mask is the same as
+//segmenting after update_gaussian_model_mask1_thr and normalize_priors_thr
+//mask must not be prev_mask
+//will return 0 if errors
+int update_segment_gaussian_model_mask1_thr(struct GaussianModel *model,
+                                            struct BMP *prev_img,
+                                            struct Mask1 *prev_mask,
+                                            struct BMP *img,
+                                            struct Mask1 *mask) {
+    struct JobUpdateSegmentGMM jobs[MAX_BATCH_JOBS];
+    int i, steps;
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return 0;
+    steps = get_job_count(model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].update = (struct JobUpdateGMM) {model, NULL, prev_img, NULL, prev_mask};
+        jobs[i].normalize.model = model;
+        jobs[i].segment = (struct JobSegmentGMM) {model, img, NULL, NULL, mask};
+        //whole rows, so each stage of a job covers the same pixels even interleaved
+        get_job_part(i, steps, model->height, 0, &jobs[i].update.part);
+        jobs[i].normalize.part = jobs[i].update.part;
+        jobs[i].segment.part = jobs[i].update.part;
     }
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
+    return parallel_for(do_job_update_segment_gmm, jobs, sizeof(struct JobUpdateSegmentGMM), steps);
+}
+
+//runs a copy of job for each part of the frame on the worker pool
+//will return 0 if errors
+int run_gaussian_update_jobs(struct JobUpdateGMM *job) {
+    struct JobUpdateGMM jobs[MAX_BATCH_JOBS];
+    int i, steps;
     
-    return 1;
+    steps = get_job_count(job->model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i] = *job;
+        get_job_part(i, steps, job->model->height, 1, &jobs[i].part);
+    }
+    
+    return parallel_for(do_job_update_gmm, jobs, sizeof(struct JobUpdateGMM), steps);
 }
 
 //generates the most likely background image based on the model
 struct BMP *generate_gaussian_background_thr(struct GaussianModel *model) {
+    struct JobBackgroundGMM jobs[MAX_BATCH_JOBS];
     struct BMP *bg;
+    int i, steps;
 
     bg = init_BMP(model->width, model->height);
     if (!bg)
         return NULL;
     
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobBackgroundGMM *t1_job, *t2_job, *t3_job, *t4_job;
-    
-    //create jobs
-    t1_job = create_job_background_gmm(model, bg, 0);
-    t2_job = create_job_background_gmm(model, bg, 1);
-    t3_job = create_job_background_gmm(model, bg, 2);
-    t4_job = create_job_background_gmm(model, bg, 3);
-    
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_background_gmm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_background_gmm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_background_gmm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_background_gmm, t4_job)) {
-        return NULL;
+    steps = get_job_count(model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].model = model;
+        jobs[i].background = bg;
+        get_job_part(i, steps, model->height, 1, &jobs[i].part);
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
+    if (!parallel_for(do_job_background_gmm, jobs, sizeof(struct JobBackgroundGMM), steps)) {
+        free_BMP(bg);
         return NULL;
     }
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
-    
     return bg;
 }
 
 //normalizes all priors within the model
 //returns 0 for errors
 int normalize_priors_thr(struct GaussianModel *model) {
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobNormalizeGMM *t1_job, *t2_job, *t3_job, *t4_job;
-
-    //create jobs
-    t1_job = create_job_normalize_gmm(model, 0);
-    t2_job = create_job_normalize_gmm(model, 1);
-    t3_job = create_job_normalize_gmm(model, 2);
-    t4_job = create_job_normalize_gmm(model, 3);
-        
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_normalize_gmm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_normalize_gmm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_normalize_gmm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_normalize_gmm, t4_job)) {
-        return 0;
-    }
+    struct JobNormalizeGMM jobs[MAX_BATCH_JOBS];
+    int i, steps;
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
-        return 0;
+    steps = get_job_count(model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].model = model;
+        get_job_part(i, steps, model->height, 1, &jobs[i].part);
     }
-       
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
-       
-    return 1;
+    
+    return parallel_for(do_job_normalize_gmm, jobs, sizeof(struct JobNormalizeGMM), steps);
 }
 
 //returns a malloc'd list of indexes from the initial list in their order
@@ -272,12 +310,12 @@ void *do_job_update_gmm(void *job_struct) {
     struct BMP *seg_map;
     struct BMP *img;
     struct Pixel p, cp;
-    int step;
+    unsigned char *row, *seg_row, *gray_row;
     int x, y, k, worst;
     double meanr, meang, meanb, valr, valg, valb, avg_val, avg_mean;
     double var;
     double prior;
-    int matched;
+    int matched, fg;
     double wsum;
     
     //get job struct
@@ -285,7 +323,6 @@ void *do_job_update_gmm(void *job_struct) {
     model = job->model;
     seg_map = job->seg_map;
     img = job->img;
-    step = job->step;
     
     matched = 0;
     
@@ -296,14 +333,23 @@ void *do_job_update_gmm(void *job_struct) {
     for (k = 0; k < model->k; k++) {
         ratings[k] = 0.0;
     }
-    for (y = 0; y < model->height; y++) {
-        for (x = step; x < model->width; x+=NUM_THREADS) {
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        row = get_row(img, y);
+        seg_row = seg_map ? get_row(seg_map, y) : NULL;
+        gray_row = job->gray_map ? job->gray_map->pixel_data + (y * model->width) : NULL;
+        for (x = job->part.x0; x < model->width; x += job->part.xstep) {
             //get gaussian mixture for this coordinate
             gm = model->map[(y*model->width)+x];
-            //get segmap pixel at this coordinate
-            p = get_pixel(seg_map, x, y);
-            //check if pixel is foreground classified
-            if (p.red == 255 && p.green == 255 && p.blue == 255) {
+            //check if pixel is foreground classified, in whichever map was given
+            if (job->mask) {
+                fg = get_mask1(job->mask, x, y);
+            } else if (gray_row) {
+                fg = gray_row[x] == 255;
+            } else {
+                p = read_pixel(seg_row + 3 * x);
+                fg = p.red == 255 && p.green == 255 && p.blue == 255;
+            }
+            if (fg) {
                 //gather 'ratings' (prior/variance) of pixels at this coordinate
                 for (k = 0; k < model->k; k++) {
                     ratings[k] = (gm->mixture[k]->prior / gm->mixture[k]->variance);
@@ -312,7 +358,7 @@ void *do_job_update_gmm(void *job_struct) {
                 worst = index_of_min(ratings, model->k);
                 gp = gm->mixture[worst]; //store pointer to the one to be deleted
                 //get pixel from change image
-                cp = get_pixel(img, x, y);
+                cp = read_pixel(row + 3 * x);
                 //replace worst rated pixel with newly observed pixel.
                 gp->meanr = cp.red;
                 gp->meang = cp.green;
@@ -322,7 +368,7 @@ void *do_job_update_gmm(void *job_struct) {
                 gm->mixture[worst] = gp;
             } else {
                 //otherwise pixel is background
-                p = get_pixel(img, x, y);
+                p = read_pixel(row + 3 * x);
                 valr = p.red;
                 valg = p.green;
                 valb = p.blue;
@@ -362,19 +408,19 @@ void *do_job_background_gmm(void *job_struct) {
     struct GaussianMixture *tmp;
     struct GaussianPixel *pixel;
     struct Pixel newp;
-    int step;
+    unsigned char *row;
     int x, y, i;
     
     //get job struct
     struct JobBackgroundGMM *job = (struct JobBackgroundGMM *) job_struct;
     model = job->model;
     bg = job->background;
-    step = job->step;
     
     double ratings[model->k];
 
-    for (y = 0; y < model->height; y++) {
-        for (x = step; x < model->width; x+=NUM_THREADS) {
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        row = get_row(bg, y);
+        for (x = job->part.x0; x < model->width; x += job->part.xstep) {
             tmp = model->map[(y*model->width)+x];
             //store ratings
             for (i = 0; i < model->k; i++) {
@@ -403,9 +449,7 @@ void *do_job_background_gmm(void *job_struct) {
             } else if (pixel->meanb < 0.0) {
                 newp.blue = 0;
             }
-            if (!set_pixel(bg, x, y, newp)) {
-                return NULL;
-            }
+            write_pixel(row + 3 * x, newp);
         }
     }
     return NULL;
@@ -413,88 +457,110 @@ void *do_job_background_gmm(void *job_struct) {
 
 void *do_job_segment_gmm(void *job_struct) {
     struct GaussianModel *model;
-    struct GaussianMixture *gm;
-    struct GaussianPixel *gp;
     struct BMP *seg_map;
     struct BMP *img;
-    struct Pixel p;
-    int step;
-    int x, y, k;
-    int is_bg;
-    double wsum;
+    unsigned char *row, *seg_row, *out, *bits;
+    unsigned char b;
+    int x, xb, xe, y, fg;
     
     //get job struct
     struct JobSegmentGMM *job = (struct JobSegmentGMM *) job_struct;
     model = job->model;
     img = job->img;
     seg_map = job->seg_map;
-    step = job->step;
     
     //arrays in thread stack memory
     double priors[model->k];
     double sorted_priors[model->k];
     int sorted_indexes[model->k];
     
-    for (y = 0; y < model->height; y++) {
-        for (x = step; x < model->width; x+=NUM_THREADS) {
-            gm = model->map[(y * model->width) + x];
-            is_bg = 0;
-            wsum = 0;
-                    
-            //gather priors
-            for (k = 0; k < model->k; k++) {
-                sorted_priors[k] = priors[k] = gm->mixture[k]->prior;
+    //whole rows of the job's band or tile, walked in runs of 8 pixels, a mask byte each
+    //interleaved, jobs take the runs of every row in turn, so a mask byte still has
+    //only one writer
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        row = get_row(img, y);
+        seg_row = seg_map ? get_row(seg_map, y) : NULL;
+        out = job->gray_map ? job->gray_map->pixel_data + (y * model->width) : NULL;
+        bits = job->mask ? job->mask->bit_data + (y * job->mask->stride) : NULL;
+        for (xb = job->part.x0 * 8; xb < model->width; xb += 8 * job->part.xstep) {
+            xe = xb + 8 < model->width ? xb + 8 : model->width;
+            b = 0;
+            for (x = xb; x < xe; x++) {
+                fg = is_gaussian_foreground(model, model->map[(y * model->width) + x],
+                                            read_pixel(row + 3 * x),
+                                            priors, sorted_priors, sorted_indexes);
+                b |= fg << (x - xb);
+                if (seg_row)
+                    seg_row[3 * x] = seg_row[3 * x + 1] = seg_row[3 * x + 2] = fg ? 255 : 0;
+                if (out)
+                    out[x] = fg ? 255 : 0;
             }
+            if (bits)
+                bits[xb >> 3] = b;
+        }
+        //mask padding past the last pixel is always 0
+        if (bits && job->part.x0 == 0)
+            memset(bits + ((model->width + 7) >> 3), 0, job->mask->stride - ((model->width + 7) >> 3));
+    }
+    return NULL;
+}
 
-            //sort priors
-            qsort(sorted_priors, model->k, sizeof(double), deccmp);
+//1 if p doesn't match any of the distributions that make up the background in gm
+//priors, sorted_priors and sorted_indexes are scratch space of model->k entries
+int is_gaussian_foreground(struct GaussianModel *model,
+                           struct GaussianMixture *gm,
+                           struct Pixel p,
+                           double *priors,
+                           double *sorted_priors,
+                           int *sorted_indexes) {
+    struct GaussianPixel *gp;
+    double wsum;
+    int k;
+    
+    wsum = 0;
+    
+    //gather priors
+    for (k = 0; k < model->k; k++) {
+        sorted_priors[k] = priors[k] = gm->mixture[k]->prior;
+    }
 
-            //get sorted index list (mallocs)
-            get_sorted_indexes_st(sorted_indexes, priors, sorted_priors, model->k);
+    //sort priors
+    qsort(sorted_priors, model->k, sizeof(double), deccmp);
 
-            //get the pixel at the location
-            p = get_pixel(img, x, y);
-                    
-            for (k = 0; k < model->k; k++) {
-                //check we are not yet > T
-                if (wsum > model->t) {
-                    break;
-                }
-                        
-                gp = gm->mixture[sorted_indexes[k]];
-                wsum += gp->prior;
-                        
-                //check if pixel in img matches the kth distribution
-                if (matches_distribution(p, *gp)) {
-                    set_pixel(seg_map, x, y, make_pixel(0, 0, 0));
-                    is_bg = 1;
-                    break;
-                }
-            }
-                    
-            //if no distribution matched or > T, mark as foreground
-            if (!is_bg) {
-                set_pixel(seg_map, x, y, make_pixel(255, 255, 255));
-            }
+    //get sorted index list
+    get_sorted_indexes_st(sorted_indexes, priors, sorted_priors, model->k);
+    
+    for (k = 0; k < model->k; k++) {
+        //check we are not yet > T
+        if (wsum > model->t) {
+            break;
+        }
+        
+        gp = gm->mixture[sorted_indexes[k]];
+        wsum += gp->prior;
+        
+        //check if pixel in img matches the kth distribution
+        if (matches_distribution(p, *gp)) {
+            return 0;
         }
     }
-    return NULL;
+    
+    //no distribution matched or > T
+    return 1;
 }
 
 void *do_job_normalize_gmm(void *job_struct) {
     struct GaussianModel *model;
     struct GaussianMixture *gm;
-    int step;
     int x, y, k;
     double sum;
     
     //get job struct
     struct JobNormalizeGMM *job = (struct JobNormalizeGMM *) job_struct;
     model = job->model;
-    step = job->step;
     
-    for (y = 0; y < model->height; y++) {
-        for (x = step; x < model->width; x+=NUM_THREADS) {
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        for (x = job->part.x0; x < model->width; x += job->part.xstep) {
             //get mixture of current coordinate
             gm = model->map[(y*model->width)+x];
             sum = 0;
@@ -513,56 +579,11 @@ void *do_job_normalize_gmm(void *job_struct) {
     return NULL;
 }
 
-struct JobUpdateGMM *create_job_update_gmm(struct GaussianModel *model,
-                                           struct BMP *img,
-                                           struct BMP *seg_map,
-                                           int step) {
-    struct JobUpdateGMM *job;
-    job = malloc(sizeof(struct JobUpdateGMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->seg_map = seg_map;
-    job->img = img;
-    job->step = step;
-    return job;
-}
-
-struct JobBackgroundGMM *create_job_background_gmm(struct GaussianModel *model,
-                                                   struct BMP *background,
-                                                   int step) {
-    struct JobBackgroundGMM *job;
-    job = malloc(sizeof(struct JobBackgroundGMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->background = background;
-    job->step = step;
-    return job;
-}
-
-struct JobSegmentGMM *create_job_segment_gmm(struct GaussianModel *model,
-                                             struct BMP *img,
-                                             struct BMP *seg_map,
-                                             int step) {
-    struct JobSegmentGMM *job;
-    job = malloc(sizeof(struct JobSegmentGMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->img = img;
-    job->seg_map = seg_map;
-    job->step = step;
-    return job;
-}
+void *do_job_update_segment_gmm(void *job_struct) {
+    struct JobUpdateSegmentGMM *job = (struct JobUpdateSegmentGMM *) job_struct;
 
-struct JobNormalizeGMM *create_job_normalize_gmm(struct GaussianModel *model,
-                                                 int step) {
-    struct JobNormalizeGMM *job;
-    job = malloc(sizeof(struct JobNormalizeGMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->step = step;
-    return job;
+    do_job_update_gmm(&job->update);
+    do_job_normalize_gmm(&job->normalize);
+    do_job_segment_gmm(&job->segment);
+    return NULL;
 }
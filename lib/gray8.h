@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a single channel 8 bit image, such as the luma plane of a camera frame
+//rows are stored top-down with no padding, as cameras deliver them
+struct Gray8 {
+    unsigned int width;
+    unsigned int height;
+    unsigned char *pixel_data;   //width * height values
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct Gray8 *init_gray8(unsigned int width,
+                         unsigned int height);
+
+void free_gray8(struct Gray8 *img);
+
+void bgr_to_gray8(struct BMP *src,
+                  struct Gray8 *dst);
+
+void gray8_into_BMP(struct Gray8 *src,
+                    struct BMP *dst);
+
+struct BMP *gray8_to_BMP(struct Gray8 *src);
+
+long count_gray8(struct Gray8 *img,
+                 unsigned char value);
+
+int save_gray8(struct Gray8 *img,
+               char *path);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//init gray8 image of given dimensions, with all pixels 0
+struct Gray8 *init_gray8(unsigned int width,
+                         unsigned int height) {
+    struct Gray8 *img;
+
+    img = malloc(sizeof(struct Gray8));
+    if (!img)
+        return NULL;
+
+    img->pixel_data = calloc((size_t) width * height, 1);
+    if (!img->pixel_data) {
+        free(img);
+        return NULL;
+    }
+    img->width = width;
+    img->height = height;
+
+    return img;
+}
+
+//frees all memory from given Gray8 image
+void free_gray8(struct Gray8 *img) {
+    if (!img)
+        return;
+    free(img->pixel_data);
+    free(img);
+}
+
+//takes the BT.601 luma of a bottom-up bgr BMP, the same values a camera's Y plane holds
+//dst must be the same size as src
+void bgr_to_gray8(struct BMP *src,
+                  struct Gray8 *dst) {
+    unsigned char *row, *out;
+    int x, y;
+    int width = dst->width;
+    int height = dst->height;
+
+    out = dst->pixel_data;
+    for (y = 0; y < height; y++) {
+        //bmp rows are stored bottom-up
+        row = src->pixel_data + ((height - y - 1) * src->scanline_size);
+        for (x = 0; x < width; x++) {
+            *out++ = ((66 * row[3*x + 2] + 129 * row[3*x + 1] + 25 * row[3*x] + 128) >> 8) + 16;
+        }
+    }
+}
+
+//writes src into every channel of dst, dst must be the same size as src
+void gray8_into_BMP(struct Gray8 *src,
+                    struct BMP *dst) {
+    unsigned char *in, *out;
+    int x, y;
+    int width = src->width;
+    int height = src->height;
+
+    for (y = 0; y < height; y++) {
+        in = src->pixel_data + (y * width);
+        out = dst->pixel_data + ((height - y - 1) * dst->scanline_size);
+        for (x = 0; x < width; x++) {
+            out[0] = out[1] = out[2] = in[x];
+            out += 3;
+        }
+    }
+}
+
+//creates a greyscale BMP from src, for saving
+//returns NULL on memory error
+struct BMP *gray8_to_BMP(struct Gray8 *src) {
+    struct BMP *bmp;
+
+    bmp = init_BMP(src->width, src->height);
+    if (!bmp)
+        return NULL;
+    gray8_into_BMP(src, bmp);
+
+    return bmp;
+}
+
+//counts the number of pixels equal to value in img
+long count_gray8(struct Gray8 *img,
+                 unsigned char value) {
+    unsigned char *p, *end;
+    long count;
+
+    count = 0;
+    end = img->pixel_data + ((size_t) img->width * img->height);
+    for (p = img->pixel_data; p < end; p++) {
+        count += *p == value;
+    }
+    return count;
+}
+
+//saves img as an 8 bit BMP with a grey palette, a third the size of a 24 bit one
+//returns 1 on success
+int save_gray8(struct Gray8 *img,
+               char *path) {
+    struct BMPFileHeader fh;
+    struct BMPImageHeader ih;
+    unsigned char palette[256 * 4];
+    unsigned char pad[3] = {0, 0, 0};
+    unsigned int y, row_size;
+    FILE *file;
+    int i, ok;
+
+    //8 bit BMP rows are padded to 4 bytes
+    row_size = (img->width + 3) & ~3u;
+    for (i = 0; i < 256; i++) {
+        palette[4*i] = palette[4*i + 1] = palette[4*i + 2] = i;
+        palette[4*i + 3] = 0;
+    }
+
+    memset(&fh, 0, sizeof(fh));
+    memset(&ih, 0, sizeof(ih));
+    fh.type = (((short) 77) << 8) | 66;
+    fh.off_bits = 14 + 40 + sizeof(palette);
+    fh.file_size = fh.off_bits + row_size * img->height;
+    ih.size = 40;
+    ih.width = img->width;
+    ih.height = img->height;
+    ih.planes = 1;
+    ih.bit_count = 8;
+    ih.clr_used = 256;
+
+    file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    ok = fwrite(&fh, 14, 1, file) == 1
+        && fwrite(&ih, 40, 1, file) == 1
+        && fwrite(palette, sizeof(palette), 1, file) == 1;
+    //bottom-up, gray8 rows are top-down
+    for (y = img->height; ok && y-- > 0; ) {
+        ok = fwrite(img->pixel_data + (size_t) y * img->width, img->width, 1, file) == 1
+            && (row_size == img->width
+                || fwrite(pad, row_size - img->width, 1, file) == 1);
+    }
+
+    fclose(file);
+    return ok;
+}
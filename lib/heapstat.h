@@ -0,0 +1,84 @@
+#include <stdlib.h>
+
+// ----------
+// STRUCTURES
+// ----------
+
+//counts heap allocations made by the process and by each thread, so the detector can
+//show that its steady state loop allocates nothing
+//only built with HEAP_STATS defined (make heapstats), malloc, calloc and realloc are
+//then replaced process wide with wrappers around glibc's own, without it or on other
+//C libraries nothing is replaced and the counts stay 0
+//every thread's count starts at 0, take the difference of two reads on one thread
+static __thread unsigned long heap_thread_count = 0;
+static unsigned long heap_total_count = 0;
+
+// ------------
+// DECLARATIONS
+// ------------
+
+int heap_stats_enabled();
+
+unsigned long heap_thread_allocs();
+
+unsigned long heap_total_allocs();
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//1 if allocations are being counted
+int heap_stats_enabled() {
+#if defined(HEAP_STATS) && defined(__GLIBC__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+//allocations made by the calling thread so far
+unsigned long heap_thread_allocs() {
+    return heap_thread_count;
+}
+
+//allocations made by every thread so far
+unsigned long heap_total_allocs() {
+    return __atomic_load_n(&heap_total_count, __ATOMIC_RELAXED);
+}
+
+#if defined(HEAP_STATS) && defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+//records one allocation
+static inline void heap_count() {
+    heap_thread_count++;
+    __atomic_add_fetch(&heap_total_count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    heap_count();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    heap_count();
+    return __libc_calloc(nmemb, size);
+}
+
+//resizing in place is still counted, the caller can't know it won't move
+void *realloc(void *ptr, size_t size) {
+    if (size > 0)
+        heap_count();
+    return __libc_realloc(ptr, size);
+}
+
+//glibc asks that free is replaced along with the allocators
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+#endif
@@ -0,0 +1,531 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_TRAIN_FRAMES 10   //frames the model learns from before timing starts
+#define BENCH_MAX_STAGES 32
+#define SCALE_MAX_RUNS 16       //thread counts and partitions the scaling bench compares
+
+// ----------
+// STRUCTURES
+// ----------
+
+//time spent in one kernel over every timed frame
+struct BenchStage {
+    char *name;
+    double total;         //seconds
+    double best;          //fastest frame, seconds
+    int runs;
+};
+
+//times the per frame kernels on synthetic frames, without a camera or the rest of
+//the detector, so changes to them can be measured on their own
+struct KernelBench {
+    struct BenchStage stages[BENCH_MAX_STAGES];
+    int stage_count;
+    int frames;           //frames timed
+    long counted;         //pixels the count kernels found, printed so the calls can't be dropped
+};
+
+//the threaded kernels' time per frame at one thread count and partition
+struct ScaleRun {
+    int threads;
+    int partition;
+    double gmm;           //segment and update of the bgr model, seconds per frame
+    double luma;          //segment and update of the luma model
+    double diff;          //fused difference segmentation
+    long shared_lines;    //output cache lines written by more than one job
+    unsigned long steals; //jobs run by a thread other than the one dealt them, per frame
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+int run_kernel_bench(struct SysConfig *config,
+                     int frames);
+
+void bench_record(struct KernelBench *kb,
+                  char *name,
+                  double started);
+
+void *do_job_bench_nothing(void *job_struct);
+
+int run_scaling_bench(struct SysConfig *config,
+                      int frames);
+
+long count_shared_lines(int steps,
+                        int height,
+                        size_t row_bytes,
+                        int unit_bytes,
+                        int units);
+
+void print_scaling_bench(struct ScaleRun *runs,
+                         int run_count,
+                         int frames,
+                         unsigned int width,
+                         unsigned int height);
+
+void print_kernel_bench(struct KernelBench *kb,
+                        unsigned int width,
+                        unsigned int height);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//generates frames at the configured resolution and times each kernel on them
+//the bgr model is trained on the first frames, then every stage is run on each frame
+//returns 1 on success, 0 on error
+int run_kernel_bench(struct SysConfig *config,
+                     int frames) {
+    struct KernelBench kb;
+    struct SynthSource *ss;
+    struct GaussianModel *model;
+    struct BMP *frame, *work, *seg_bmp, *bg, *diff, *thr;
+    struct Gray8 *seg_gray;
+    struct Mask1 *seg_mask, *next_mask;
+    struct EntityList *el;
+    struct EntityFilter filter;
+    struct PixelKernels *kern;
+    unsigned int width, height;
+    size_t pd_size;
+    int empty_jobs[MAX_WORKER_THREADS];
+    double t;
+    int i, y, parallel_mode_was;
+
+    if (!parse_resolution(config->resolution, &width, &height))
+        return 0;
+    if (frames < 1)
+        frames = 1;
+
+    ss = open_synth_source(width, height, config->synth_objects,
+                           config->synth_noise, config->synth_drift, 0);
+    frame = init_BMP(width, height);
+    work = init_BMP(width, height);
+    seg_bmp = init_BMP(width, height);
+    seg_gray = init_gray8(width, height);
+    seg_mask = init_mask1(width, height);
+    next_mask = init_mask1(width, height);
+    if (!ss || !frame || !work || !seg_bmp || !seg_gray || !seg_mask || !next_mask
+        || read_synth_frame(ss, frame) != 1)
+        return 0;
+
+    model = init_gaussian_model(frame, config->gmm_k_val, config->gmm_t_val, config->gmm_alpha,
+                                config->gmm_init_var, config->gmm_min_var);
+    if (!model)
+        return 0;
+    for (i = 0; i < BENCH_TRAIN_FRAMES; i++) {
+        if (read_synth_frame(ss, frame) != 1)
+            return 0;
+        segment_gaussian_model_gray8_thr(model, frame, seg_gray);
+        update_gaussian_model_gray8_thr(model, frame, seg_gray);
+        normalize_priors_thr(model);
+    }
+
+    //entities are filtered whether or not the config asks for it
+    filter = get_config_filter(config);
+    pd_size = (size_t) frame->scanline_size * height;
+    kern = get_pixel_kernels();
+    parallel_mode_was = get_parallel_mode();
+    memset(&kb, 0, sizeof(kb));
+
+    for (i = 0; i < frames; i++) {
+        if (read_synth_frame(ss, frame) != 1)
+            return 0;
+
+        //what every threaded kernel pays to hand out its jobs and wait for them, on
+        //the worker pool and with a thread created per job as before it
+        set_parallel_mode(PARALLEL_POOL);
+        t = get_monotonic_time();
+        parallel_for(do_job_bench_nothing, empty_jobs, sizeof(int), get_worker_count());
+        bench_record(&kb, "dispatch_pool", t);
+
+        set_parallel_mode(PARALLEL_SPAWN);
+        t = get_monotonic_time();
+        parallel_for(do_job_bench_nothing, empty_jobs, sizeof(int), get_worker_count());
+        bench_record(&kb, "dispatch_spawn", t);
+        set_parallel_mode(parallel_mode_was);
+
+        memcpy(work->pixel_data, frame->pixel_data, pd_size);
+        t = get_monotonic_time();
+        greyscale_BMP(work);
+        bench_record(&kb, "greyscale", t);
+
+        memcpy(work->pixel_data, frame->pixel_data, pd_size);
+        t = get_monotonic_time();
+        greyscale_BMP_thr(work);
+        bench_record(&kb, "greyscale_thr", t);
+
+        //the pixel kernels alone, over the whole frame, without the allocation and
+        //threads of the functions built on them
+        t = get_monotonic_time();
+        kern->difference(frame->pixel_data, seg_bmp->pixel_data, work->pixel_data, pd_size);
+        bench_record(&kb, "kernel_difference", t);
+
+        t = get_monotonic_time();
+        kern->threshold(work->pixel_data, work->pixel_data, pd_size, config->pixel_change_threshold);
+        bench_record(&kb, "kernel_threshold", t);
+
+        memcpy(work->pixel_data, frame->pixel_data, pd_size);
+        t = get_monotonic_time();
+        for (y = 0; y < (int) height; y++) {
+            kern->greyscale(work->pixel_data + y * work->scanline_size, width);
+        }
+        bench_record(&kb, "kernel_greyscale", t);
+
+        t = get_monotonic_time();
+        for (y = 0; y < (int) height; y++) {
+            kb.counted += kern->count(frame->pixel_data + y * frame->scanline_size, width, 255, 255, 255);
+        }
+        bench_record(&kb, "kernel_count", t);
+
+        t = get_monotonic_time();
+        diff = get_difference(frame, work);
+        bench_record(&kb, "difference", t);
+
+        t = get_monotonic_time();
+        thr = segment_BMP(diff, config->pixel_change_threshold);
+        bench_record(&kb, "threshold", t);
+        free_BMP(thr);
+        free_BMP(diff);
+
+        t = get_monotonic_time();
+        diff = get_difference_thr(frame, work);
+        bench_record(&kb, "difference_thr", t);
+
+        t = get_monotonic_time();
+        thr = segment_BMP_thr(diff, config->pixel_change_threshold);
+        bench_record(&kb, "threshold_thr", t);
+        free_BMP(thr);
+        free_BMP(diff);
+
+        //the three passes against the fused kernel, work stands in for a background
+        t = get_monotonic_time();
+        diff = get_difference_thr(frame, work);
+        greyscale_BMP_thr(diff);
+        thr = segment_BMP_thr(diff, config->pixel_change_threshold);
+        bench_record(&kb, "three_pass_thr", t);
+        free_BMP(thr);
+        free_BMP(diff);
+
+        t = get_monotonic_time();
+        segment_difference_BMP(frame, work, config->pixel_change_threshold, seg_bmp);
+        bench_record(&kb, "segment_difference", t);
+
+        t = get_monotonic_time();
+        segment_difference_BMP_thr(frame, work, config->pixel_change_threshold, seg_bmp);
+        bench_record(&kb, "segment_diff_thr", t);
+
+        t = get_monotonic_time();
+        bg = generate_gaussian_seg_map(model, frame);
+        bench_record(&kb, "gmm_segment", t);
+        free_BMP(bg);
+
+        t = get_monotonic_time();
+        segment_gaussian_model_thr(model, frame, seg_bmp);
+        bench_record(&kb, "gmm_segment_thr", t);
+
+        t = get_monotonic_time();
+        segment_gaussian_model_gray8_thr(model, frame, seg_gray);
+        bench_record(&kb, "gmm_segment_gray8", t);
+
+        t = get_monotonic_time();
+        segment_gaussian_model_mask1_thr(model, frame, seg_mask);
+        bench_record(&kb, "gmm_segment_mask1", t);
+
+        //the same foreground counted in each segmap format
+        t = get_monotonic_time();
+        kb.counted += count_pixels_thr(seg_bmp, make_pixel(255, 255, 255));
+        bench_record(&kb, "count_thr", t);
+
+        t = get_monotonic_time();
+        kb.counted += count_gray8(seg_gray, 255);
+        bench_record(&kb, "count_gray8", t);
+
+        t = get_monotonic_time();
+        kb.counted += count_mask1(seg_mask);
+        bench_record(&kb, "count_mask1", t);
+
+        memcpy(work->pixel_data, seg_bmp->pixel_data, pd_size);
+        t = get_monotonic_time();
+        el = filter_entities(work, filter, 0);
+        bench_record(&kb, "filter_entities", t);
+        free_entity_list(el);
+
+        t = get_monotonic_time();
+        bg = generate_gaussian_background_thr(model);
+        bench_record(&kb, "gmm_background_thr", t);
+        free_BMP(bg);
+
+        //the updates take turns, the model sees each frame once
+        //the pipelined pass updates with this frame and segments it again, against
+        //gmm_segment_mask1 and gmm_update_mask1 together
+        t = get_monotonic_time();
+        if (i % 4 == 0) {
+            update_gaussian_model_thr(model, frame, seg_bmp);
+            bench_record(&kb, "gmm_update_thr", t);
+        } else if (i % 4 == 1) {
+            update_gaussian_model(model, seg_bmp, frame);
+            bench_record(&kb, "gmm_update", t);
+        } else if (i % 4 == 2) {
+            update_gaussian_model_mask1_thr(model, frame, seg_mask);
+            normalize_priors_thr(model);
+            bench_record(&kb, "gmm_update_mask1", t);
+        } else {
+            update_segment_gaussian_model_mask1_thr(model, frame, seg_mask, frame, next_mask);
+            bench_record(&kb, "gmm_update_segment", t);
+        }
+        normalize_priors_thr(model);
+        kb.frames++;
+    }
+
+    print_kernel_bench(&kb, width, height);
+
+    free_gaussian_model(model);
+    free_mask1(next_mask);
+    free_mask1(seg_mask);
+    free_gray8(seg_gray);
+    free_BMP(seg_bmp);
+    free_BMP(work);
+    free_BMP(frame);
+    close_synth_source(ss);
+    return 1;
+}
+
+//adds the time since started to the stage called name
+void bench_record(struct KernelBench *kb,
+                  char *name,
+                  double started) {
+    struct BenchStage *s;
+    double took;
+    int i;
+
+    took = get_monotonic_time() - started;
+    for (i = 0; i < kb->stage_count; i++) {
+        if (strcmp(kb->stages[i].name, name) == 0)
+            break;
+    }
+    if (i == kb->stage_count) {
+        if (kb->stage_count == BENCH_MAX_STAGES)
+            return;
+        kb->stage_count++;
+        kb->stages[i].name = name;
+        kb->stages[i].total = 0;
+        kb->stages[i].best = took;
+        kb->stages[i].runs = 0;
+    }
+    s = &kb->stages[i];
+    s->total += took;
+    s->runs++;
+    if (took < s->best)
+        s->best = took;
+}
+
+//a job that does nothing, for timing dispatch alone
+void *do_job_bench_nothing(void *job_struct) {
+    return NULL;
+}
+
+//prints the mean and best time of each stage per frame
+void print_kernel_bench(struct KernelBench *kb,
+                        unsigned int width,
+                        unsigned int height) {
+    struct BenchStage *s;
+    int i;
+
+    printf("%d frames at %ux%u, %s pixel kernels, kernels in %d jobs (%s) on %s\n", kb->frames,
+           width, height, get_pixel_kernels()->name, get_job_count(height),
+           get_partition_name(get_partition_mode()),
+           get_parallel_mode() == PARALLEL_SPAWN ? "a thread each" : "the worker pool");
+    printf("%-20s %12s %12s\n", "kernel", "mean ms", "best ms");
+    for (i = 0; i < kb->stage_count; i++) {
+        s = &kb->stages[i];
+        printf("%-20s %12.3f %12.3f\n", s->name, 1000.0 * s->total / s->runs, 1000.0 * s->best);
+    }
+    printf("foreground pixels counted: %ld\n", kb->counted);
+}
+
+//times the threaded gmm, luma and difference kernels at 1, 2, 4, 8 and 16 threads with
+//frames split into row bands, interleaved and into tiles, and counts the cache lines
+//the jobs of each split share, as a measure of the false sharing between them
+//the worker pool is left at the last thread count
+//returns 1 on success, 0 on error
+int run_scaling_bench(struct SysConfig *config,
+                      int frames) {
+    static int thread_counts[] = {1, 2, 4, 8, 16};
+    struct ScaleRun runs[SCALE_MAX_RUNS];
+    struct ScaleRun *r;
+    struct SynthSource *ss;
+    struct GaussianModel *model;
+    struct LumaModel *lmodel;
+    struct BMP *frame, *bg, *seg_bmp;
+    struct Gray8 *gray;
+    struct Mask1 *mask;
+    unsigned int width, height;
+    double t;
+    unsigned long steals_was;
+    int i, n, p, run_count, partition_was;
+
+    if (!parse_resolution(config->resolution, &width, &height))
+        return 0;
+    if (frames < 1)
+        frames = 1;
+
+    ss = open_synth_source(width, height, config->synth_objects,
+                           config->synth_noise, config->synth_drift, 0);
+    frame = init_BMP(width, height);
+    bg = init_BMP(width, height);
+    seg_bmp = init_BMP(width, height);
+    gray = init_gray8(width, height);
+    mask = init_mask1(width, height);
+    if (!ss || !frame || !bg || !seg_bmp || !gray || !mask || read_synth_frame(ss, frame) != 1)
+        return 0;
+
+    bgr_to_gray8(frame, gray);
+    memcpy(bg->pixel_data, frame->pixel_data, (size_t) frame->scanline_size * height);
+    model = init_gaussian_model(frame, config->gmm_k_val, config->gmm_t_val, config->gmm_alpha,
+                                config->gmm_init_var, config->gmm_min_var);
+    lmodel = init_luma_model(gray, config->gmm_k_val, config->gmm_t_val, config->gmm_alpha,
+                             config->gmm_init_var, config->gmm_min_var);
+    if (!model || !lmodel)
+        return 0;
+
+    partition_was = get_partition_mode();
+    run_count = 0;
+    for (n = 0; n < (int) (sizeof(thread_counts) / sizeof(int)); n++) {
+        if (!configure_worker_pool(thread_counts[n], NULL, 0))
+            return 0;
+        for (p = PARTITION_BANDS; p <= PARTITION_TILES; p++) {
+            set_partition_mode(p);
+            r = &runs[run_count++];
+            memset(r, 0, sizeof(struct ScaleRun));
+            r->threads = get_worker_count();
+            r->partition = p;
+
+            //the bgr segmap and mask are split by column, the luma model by the same
+            //parts, each pixel's k distributions in one block
+            r->shared_lines = count_shared_lines(get_job_count(height), height, seg_bmp->scanline_size, 3, width)
+                            + count_shared_lines(get_job_count(height), height, mask->stride, 1, (width + 7) >> 3)
+                            + count_shared_lines(get_job_count(height), height,
+                                                 (size_t) width * lmodel->k * sizeof(struct LumaGaussian),
+                                                 lmodel->k * sizeof(struct LumaGaussian), width);
+
+            steals_was = get_worker_pool() ? get_worker_pool()->steals : 0;
+            for (i = 0; i < frames; i++) {
+                if (read_synth_frame(ss, frame) != 1)
+                    return 0;
+                bgr_to_gray8(frame, gray);
+
+                t = get_monotonic_time();
+                segment_gaussian_model_mask1_thr(model, frame, mask);
+                update_gaussian_model_mask1_thr(model, frame, mask);
+                r->gmm += get_monotonic_time() - t;
+
+                t = get_monotonic_time();
+                segment_luma_model_mask1_thr(lmodel, gray, mask);
+                update_luma_model_mask1_thr(lmodel, gray, mask);
+                r->luma += get_monotonic_time() - t;
+
+                t = get_monotonic_time();
+                segment_difference_BMP_thr(frame, bg, config->pixel_change_threshold, seg_bmp);
+                r->diff += get_monotonic_time() - t;
+            }
+            r->steals = ((get_worker_pool() ? get_worker_pool()->steals : 0) - steals_was) / frames;
+            r->gmm /= frames;
+            r->luma /= frames;
+            r->diff /= frames;
+        }
+    }
+    set_partition_mode(partition_was);
+
+    print_scaling_bench(runs, run_count, frames, width, height);
+
+    free_luma_model(lmodel);
+    free_gaussian_model(model);
+    free_mask1(mask);
+    free_gray8(gray);
+    free_BMP(seg_bmp);
+    free_BMP(bg);
+    free_BMP(frame);
+    close_synth_source(ss);
+    return 1;
+}
+
+//the 64 byte cache lines of an output written by more than one of steps jobs, split
+//as the threaded kernels split it by column
+//each row of the output is row_bytes long and holds units columns of unit_bytes
+//returns -1 on memory error
+long count_shared_lines(int steps,
+                        int height,
+                        size_t row_bytes,
+                        int unit_bytes,
+                        int units) {
+    struct JobPart part;
+    size_t line, first, last, lines;
+    int *owner;
+    long shared;
+    int i, x, y;
+
+    lines = (row_bytes * height + 63) / 64;
+    owner = malloc(lines * sizeof(int));
+    if (!owner)
+        return -1;
+    for (line = 0; line < lines; line++) {
+        owner[line] = -1;
+    }
+
+    //-2 marks a line already counted
+    shared = 0;
+    for (i = 0; i < steps; i++) {
+        get_job_part(i, steps, height, 1, &part);
+        for (y = part.y0; y < part.y1; y += part.ystep) {
+            for (x = part.x0; x < units; x += part.xstep) {
+                first = (y * row_bytes + (size_t) x * unit_bytes) / 64;
+                last = (y * row_bytes + (size_t) (x + 1) * unit_bytes - 1) / 64;
+                for (line = first; line <= last; line++) {
+                    if (owner[line] == -1) {
+                        owner[line] = i;
+                    } else if (owner[line] != i && owner[line] != -2) {
+                        owner[line] = -2;
+                        shared++;
+                    }
+                }
+            }
+        }
+    }
+
+    free(owner);
+    return shared;
+}
+
+//prints each run's time per frame and its speed-up over one thread with the same split
+void print_scaling_bench(struct ScaleRun *runs,
+                         int run_count,
+                         int frames,
+                         unsigned int width,
+                         unsigned int height) {
+    struct ScaleRun *r, *base;
+    double total;
+    int i, j;
+
+    printf("%d frames at %ux%u, %s pixel kernels, %ld cpus online\n", frames, width, height,
+           get_pixel_kernels()->name, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %-12s %10s %10s %10s %10s %9s %13s %7s\n", "threads", "partition", "gmm ms",
+           "luma ms", "diff ms", "total ms", "speed-up", "shared lines", "steals");
+    for (i = 0; i < run_count; i++) {
+        r = &runs[i];
+        base = r;
+        for (j = 0; j < run_count; j++) {
+            if (runs[j].threads == 1 && runs[j].partition == r->partition) {
+                base = &runs[j];
+                break;
+            }
+        }
+        total = r->gmm + r->luma + r->diff;
+        printf("%-8d %-12s %10.3f %10.3f %10.3f %10.3f %8.2fx %13ld %7lu\n", r->threads,
+               get_partition_name(r->partition), 1000.0 * r->gmm, 1000.0 * r->luma,
+               1000.0 * r->diff, 1000.0 * total, (base->gmm + base->luma + base->diff) / total,
+               r->shared_lines, r->steals);
+    }
+}
@@ -0,0 +1,466 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+// ----------
+// STRUCTURES
+// ----------
+
+//one distribution of a single channel mixture
+struct LumaGaussian {
+    double mean;
+    double variance;
+    double prior;
+};
+
+//gaussian mixture background model over 8 bit luma
+//same method as GaussianModel, but one channel and the k distributions of each
+//pixel sit next to each other in one block instead of being malloc'd separately
+struct LumaModel {
+    int width;
+    int height;
+    int k; //number of guassians in the mixture
+    double t; //portion of data for background, max sum of weight of pixels in bg
+    double alpha;
+    double min_variance;
+    double new_dist_variance; //variance of new distributions added to mixture 1.5*init_var
+    struct LumaGaussian *dists; //width * height * k distributions, pixel by pixel
+};
+
+//the segmap is whichever of seg_map and mask is set
+struct JobLumaGMM {
+    struct LumaModel *model;
+    struct Gray8 *img;
+    struct Gray8 *seg_map;
+    struct Mask1 *mask;
+    struct JobPart part;
+};
+
+//one part of the frame updated with the frame before, then segmented
+struct JobUpdateSegmentLuma {
+    struct JobLumaGMM update;
+    struct JobLumaGMM segment;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct LumaModel *init_luma_model(struct Gray8 *img,
+                                  int k,
+                                  double t,
+                                  double alpha,
+                                  double initial_variance,
+                                  double min_variance);
+
+void free_luma_model(struct LumaModel *model);
+
+struct Gray8 *generate_luma_seg_map_thr(struct LumaModel *model,
+                                        struct Gray8 *img);
+
+int segment_luma_model_thr(struct LumaModel *model,
+                           struct Gray8 *img,
+                           struct Gray8 *seg_map);
+
+int update_luma_model_thr(struct LumaModel *model,
+                          struct Gray8 *img,
+                          struct Gray8 *seg_map);
+
+int segment_luma_model_mask1_thr(struct LumaModel *model,
+                                 struct Gray8 *img,
+                                 struct Mask1 *mask);
+
+int update_luma_model_mask1_thr(struct LumaModel *model,
+                                struct Gray8 *img,
+                                struct Mask1 *mask);
+
+int update_segment_luma_model_mask1_thr(struct LumaModel *model,
+                                        struct Gray8 *prev_img,
+                                        struct Mask1 *prev_mask,
+                                        struct Gray8 *img,
+                                        struct Mask1 *mask);
+
+struct Gray8 *generate_luma_background_thr(struct LumaModel *model);
+
+int run_luma_jobs(struct LumaModel *model,
+                  struct Gray8 *img,
+                  struct Gray8 *seg_map,
+                  struct Mask1 *mask,
+                  void *(*job_fn)(void *));
+
+int luma_matches(double val,
+                 struct LumaGaussian *d);
+
+int is_luma_foreground(struct LumaModel *model,
+                       struct LumaGaussian *gm,
+                       double val,
+                       int *order);
+
+//job declarations
+
+void *do_job_segment_luma(void *job_struct);
+
+void *do_job_update_luma(void *job_struct);
+
+void *do_job_background_luma(void *job_struct);
+
+void *do_job_update_segment_luma(void *job_struct);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//initializes a LumaModel using the given image and values
+//returns NULL on memory error
+struct LumaModel *init_luma_model(struct Gray8 *img,
+                                  int k,
+                                  double t,
+                                  double alpha,
+                                  double initial_variance,
+                                  double min_variance) {
+    struct LumaModel *model;
+    struct LumaGaussian *d;
+    int i, n;
+
+    model = malloc(sizeof(struct LumaModel));
+    if (!model)
+        return NULL;
+
+    model->width = img->width;
+    model->height = img->height;
+    model->k = k;
+    model->t = t;
+    model->alpha = alpha;
+    model->min_variance = min_variance;
+    model->new_dist_variance = 1.5*initial_variance;
+
+    n = model->width * model->height;
+    model->dists = malloc((size_t) n * k * sizeof(struct LumaGaussian));
+    if (!model->dists) {
+        free(model);
+        return NULL;
+    }
+
+    //every distribution starts at the pixel value of the init image
+    d = model->dists;
+    for (i = 0; i < n * k; i++) {
+        d[i].mean = img->pixel_data[i / k];
+        d[i].variance = initial_variance;
+        d[i].prior = 1.0 / k;
+    }
+
+    return model;
+}
+
+//frees the given luma model
+void free_luma_model(struct LumaModel *model) {
+    if (!model)
+        return;
+    free(model->dists);
+    free(model);
+}
+
+//generates the segmentation map of the foreground of img using the background model
+//foreground pixels are 255, background 0
+struct Gray8 *generate_luma_seg_map_thr(struct LumaModel *model,
+                                        struct Gray8 *img) {
+    struct Gray8 *seg_map;
+
+    seg_map = init_gray8(model->width, model->height);
+    if (!seg_map)
+        return NULL;
+
+    if (!segment_luma_model_thr(model, img, seg_map)) {
+        free_gray8(seg_map);
+        return NULL;
+    }
+
+    return seg_map;
+}
+
+//writes the segmentation map of img into seg_map, which must be the size of the model,
+//so a caller can reuse the same map every frame
+//will return 0 if errors
+int segment_luma_model_thr(struct LumaModel *model,
+                           struct Gray8 *img,
+                           struct Gray8 *seg_map) {
+    return run_luma_jobs(model, img, seg_map, NULL, do_job_segment_luma);
+}
+
+//updates the given model based on the given image and it's segmentation map
+//priors are normalised in the same pass, there is no separate normalise step
+//will return 0 if errors
+int update_luma_model_thr(struct LumaModel *model,
+                          struct Gray8 *img,
+                          struct Gray8 *seg_map) {
+    return run_luma_jobs(model, img, seg_map, NULL, do_job_update_luma);
+}
+
+//segment_luma_model_thr into a one bit mask, foreground is set
+//will return 0 if errors
+int segment_luma_model_mask1_thr(struct LumaModel *model,
+                                 struct Gray8 *img,
+                                 struct Mask1 *mask) {
+    return run_luma_jobs(model, img, NULL, mask, do_job_segment_luma);
+}
+
+//update_luma_model_thr with a one bit segmap, foreground is set
+//will return 0 if errors
+int update_luma_model_mask1_thr(struct LumaModel *model,
+                                struct Gray8 *img,
+                                struct Mask1 *mask) {
+    return run_luma_jobs(model, img, NULL, mask, do_job_update_luma);
+}
+
+//updates the model with prev_img and its mask and segments img into mask, in one pass
+//over the model instead of two
+//every pixel's distributions are updated before it is segmented, so mask is the same
+//as segmenting after update_luma_model_mask1_thr
+//mask must not be prev_mask
+//will return 0 if errors
+int update_segment_luma_model_mask1_thr(struct LumaModel *model,
+                                        struct Gray8 *prev_img,
+                                        struct Mask1 *prev_mask,
+                                        struct Gray8 *img,
+                                        struct Mask1 *mask) {
+    struct JobUpdateSegmentLuma jobs[MAX_BATCH_JOBS];
+    int i, steps;
+
+    steps = get_job_count(model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].update = (struct JobLumaGMM) {model, prev_img, NULL, prev_mask};
+        jobs[i].segment = (struct JobLumaGMM) {model, img, NULL, mask};
+        //whole rows, so both stages of a job cover the same pixels even interleaved
+        get_job_part(i, steps, model->height, 0, &jobs[i].update.part);
+        jobs[i].segment.part = jobs[i].update.part;
+    }
+
+    return parallel_for(do_job_update_segment_luma, jobs, sizeof(struct JobUpdateSegmentLuma), steps);
+}
+
+//generates the most likely background image based on the model
+struct Gray8 *generate_luma_background_thr(struct LumaModel *model) {
+    struct Gray8 *bg;
+
+    bg = init_gray8(model->width, model->height);
+    if (!bg)
+        return NULL;
+
+    if (!run_luma_jobs(model, bg, NULL, NULL, do_job_background_luma)) {
+        free_gray8(bg);
+        return NULL;
+    }
+
+    return bg;
+}
+
+//runs job_fn over the model on the worker pool and waits for it
+//returns 0 if the jobs can't be run
+int run_luma_jobs(struct LumaModel *model,
+                  struct Gray8 *img,
+                  struct Gray8 *seg_map,
+                  struct Mask1 *mask,
+                  void *(*job_fn)(void *)) {
+    struct JobLumaGMM jobs[MAX_BATCH_JOBS];
+    int i, steps;
+
+    steps = get_job_count(model->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].model = model;
+        jobs[i].img = img;
+        jobs[i].seg_map = seg_map;
+        jobs[i].mask = mask;
+        get_job_part(i, steps, model->height, 1, &jobs[i].part);
+    }
+
+    return parallel_for(job_fn, jobs, sizeof(struct JobLumaGMM), steps);
+}
+
+//checks whether val is "matched" by distribution d (within 2.5 of the variance,
+//the same test matches_distribution makes per channel)
+int luma_matches(double val,
+                 struct LumaGaussian *d) {
+    return (d->mean - (2.5 * d->variance)) < val &&
+           val < (d->mean + (2.5 * d->variance));
+}
+
+//1 if val doesn't match any of the distributions making up T of the weight of gm
+//order is scratch space of model->k entries
+int is_luma_foreground(struct LumaModel *model,
+                       struct LumaGaussian *gm,
+                       double val,
+                       int *order) {
+    int i, j, k, tmp;
+    double wsum;
+
+    k = model->k;
+
+    //order distributions by prior, highest first
+    for (i = 0; i < k; i++) {
+        order[i] = i;
+        for (j = i; j > 0 && gm[order[j]].prior > gm[order[j - 1]].prior; j--) {
+            tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    //background if it matches one of the distributions making up T of the weight
+    wsum = 0;
+    for (i = 0; i < k; i++) {
+        if (wsum > model->t)
+            break;
+        wsum += gm[order[i]].prior;
+        if (luma_matches(val, &gm[order[i]]))
+            return 0;
+    }
+    return 1;
+}
+
+//job functions
+
+void *do_job_segment_luma(void *job_struct) {
+    struct JobLumaGMM *job = (struct JobLumaGMM *) job_struct;
+    struct LumaModel *model;
+    unsigned char *in, *out, *bits;
+    unsigned char b;
+    int x, xb, xe, y, k, fg;
+
+    model = job->model;
+    k = model->k;
+    int order[k];
+
+    //whole rows of the job's band or tile, walked in runs of 8 pixels, a mask byte each
+    //interleaved, jobs take the runs of every row in turn, so a mask byte still has
+    //only one writer
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        in = job->img->pixel_data + (y * model->width);
+        out = job->seg_map ? job->seg_map->pixel_data + (y * model->width) : NULL;
+        bits = job->mask ? job->mask->bit_data + (y * job->mask->stride) : NULL;
+        for (xb = job->part.x0 * 8; xb < model->width; xb += 8 * job->part.xstep) {
+            xe = xb + 8 < model->width ? xb + 8 : model->width;
+            b = 0;
+            for (x = xb; x < xe; x++) {
+                fg = is_luma_foreground(model, &model->dists[((y * model->width) + x) * k], in[x], order);
+                b |= fg << (x - xb);
+                if (out)
+                    out[x] = fg ? 255 : 0;
+            }
+            if (bits)
+                bits[xb >> 3] = b;
+        }
+        //mask padding past the last pixel is always 0
+        if (bits && job->part.x0 == 0)
+            memset(bits + ((model->width + 7) >> 3), 0, job->mask->stride - ((model->width + 7) >> 3));
+    }
+    return NULL;
+}
+
+void *do_job_update_luma(void *job_struct) {
+    struct JobLumaGMM *job = (struct JobLumaGMM *) job_struct;
+    struct LumaModel *model;
+    struct LumaGaussian *gm, *gp;
+    unsigned char *in, *seg;
+    int x, y, i, k, worst, matched, fg;
+    double val, rating, worst_rating, mean, var, sum;
+
+    model = job->model;
+    k = model->k;
+
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        in = job->img->pixel_data + (y * model->width);
+        seg = job->seg_map ? job->seg_map->pixel_data + (y * model->width) : NULL;
+        for (x = job->part.x0; x < model->width; x += job->part.xstep) {
+            gm = &model->dists[((y * model->width) + x) * k];
+            val = in[x];
+            fg = seg ? seg[x] == 255 : get_mask1(job->mask, x, y);
+
+            if (fg) {
+                //foreground, replace the worst rated (prior/variance) distribution
+                worst = 0;
+                worst_rating = gm[0].prior / gm[0].variance;
+                for (i = 1; i < k; i++) {
+                    rating = gm[i].prior / gm[i].variance;
+                    if (rating <= worst_rating) {
+                        worst_rating = rating;
+                        worst = i;
+                    }
+                }
+                gp = &gm[worst];
+                gp->mean = val;
+                gp->variance = model->new_dist_variance; //initially high variance
+                gp->prior = 0.5/model->k; //initially low prior
+            } else {
+                //background, move the first matching distribution towards the value
+                matched = 0;
+                for (i = 0; i < k; i++) {
+                    gp = &gm[i];
+                    if (!matched && luma_matches(val, gp)) {
+                        matched = 1;
+                        mean = gp->mean;
+                        var = gp->variance;
+                        gp->mean = new_mean(mean, val, var, model->alpha, model->t);
+                        gp->variance = new_variance(mean, val, var, model->alpha, model->t);
+                        gp->prior = new_prior(gp->prior, model->alpha, 1);
+                    } else {
+                        gp->prior = new_prior(gp->prior, model->alpha, 0);
+                    }
+                }
+            }
+
+            //normalise priors while the mixture is in cache
+            sum = 0;
+            for (i = 0; i < k; i++) {
+                sum += gm[i].prior;
+            }
+            for (i = 0; i < k; i++) {
+                gm[i].prior /= sum;
+            }
+        }
+    }
+    return NULL;
+}
+
+void *do_job_background_luma(void *job_struct) {
+    struct JobLumaGMM *job = (struct JobLumaGMM *) job_struct;
+    struct LumaModel *model;
+    struct LumaGaussian *gm;
+    unsigned char *out;
+    int x, y, i, k, best;
+    double rating, best_rating, mean;
+
+    model = job->model;
+    k = model->k;
+
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        out = job->img->pixel_data + (y * model->width);
+        for (x = job->part.x0; x < model->width; x += job->part.xstep) {
+            gm = &model->dists[((y * model->width) + x) * k];
+
+            //most likely distribution by prior/variance
+            best = 0;
+            best_rating = gm[0].prior / gm[0].variance;
+            for (i = 1; i < k; i++) {
+                rating = gm[i].prior / gm[i].variance;
+                if (rating > best_rating) {
+                    best_rating = rating;
+                    best = i;
+                }
+            }
+
+            //ensure mean value is in correct range
+            mean = gm[best].mean;
+            out[x] = mean > 255.0 ? 255 : (mean < 0.0 ? 0 : (unsigned char) mean);
+        }
+    }
+    return NULL;
+}
+
+void *do_job_update_segment_luma(void *job_struct) {
+    struct JobUpdateSegmentLuma *job = (struct JobUpdateSegmentLuma *) job_struct;
+
+    do_job_update_luma(&job->update);
+    do_job_segment_luma(&job->segment);
+    return NULL;
+}
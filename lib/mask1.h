@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a one bit per pixel image, for segmentation maps that only hold foreground or not
+//rows are stored top-down, like Gray8, pixel x is bit x % 8 of byte x / 8
+//rows are padded to whole 64 bit words, padding bits are always 0
+//bit_data is 8 byte aligned, so it can be walked as 64 bit words
+struct Mask1 {
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;         //bytes per row
+    unsigned char *bit_data;     //stride * height bytes
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct Mask1 *init_mask1(unsigned int width,
+                         unsigned int height);
+
+void free_mask1(struct Mask1 *mask);
+
+int get_mask1_stride(unsigned int width);
+
+int get_mask1(struct Mask1 *mask,
+              int x,
+              int y);
+
+void set_mask1(struct Mask1 *mask,
+               int x,
+               int y,
+               int value);
+
+void gray8_to_mask1(struct Gray8 *src,
+                    struct Mask1 *dst);
+
+void mask1_to_gray8(struct Mask1 *src,
+                    struct Gray8 *dst);
+
+void BMP_to_mask1(struct BMP *src,
+                  struct Mask1 *dst);
+
+void mask1_into_BMP(struct Mask1 *src,
+                    struct BMP *dst);
+
+struct BMP *mask1_to_BMP(struct Mask1 *src);
+
+long count_mask1(struct Mask1 *mask);
+
+int and_mask1(struct Mask1 *a,
+              struct Mask1 *b,
+              struct Mask1 *dst);
+
+int or_mask1(struct Mask1 *a,
+             struct Mask1 *b,
+             struct Mask1 *dst);
+
+int mask1_same_size(struct Mask1 *a,
+                    struct Mask1 *b);
+
+int save_mask1(struct Mask1 *mask,
+               char *path);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//bytes in a row of a mask width pixels wide
+int get_mask1_stride(unsigned int width) {
+    return ((width + 63) / 64) * 8;
+}
+
+//init mask of given dimensions, with all pixels 0
+//returns NULL on memory error
+struct Mask1 *init_mask1(unsigned int width,
+                         unsigned int height) {
+    struct Mask1 *mask;
+
+    mask = malloc(sizeof(struct Mask1));
+    if (!mask)
+        return NULL;
+
+    mask->stride = get_mask1_stride(width);
+    mask->bit_data = calloc((size_t) mask->stride * height, 1);
+    if (!mask->bit_data) {
+        free(mask);
+        return NULL;
+    }
+    mask->width = width;
+    mask->height = height;
+
+    return mask;
+}
+
+//frees all memory from given mask
+void free_mask1(struct Mask1 *mask) {
+    if (!mask)
+        return;
+    free(mask->bit_data);
+    free(mask);
+}
+
+//1 if the pixel at x, y is set
+int get_mask1(struct Mask1 *mask,
+              int x,
+              int y) {
+    return (mask->bit_data[(size_t) y * mask->stride + (x >> 3)] >> (x & 7)) & 1;
+}
+
+//sets or clears the pixel at x, y
+void set_mask1(struct Mask1 *mask,
+               int x,
+               int y,
+               int value) {
+    unsigned char *b = &mask->bit_data[(size_t) y * mask->stride + (x >> 3)];
+    if (value)
+        *b |= 1 << (x & 7);
+    else
+        *b &= ~(1 << (x & 7));
+}
+
+//packs src into dst, every non zero pixel is set
+//dst must be the same size as src
+void gray8_to_mask1(struct Gray8 *src,
+                    struct Mask1 *dst) {
+    unsigned char *in, *out;
+    unsigned char bits;
+    unsigned int x, y;
+
+    for (y = 0; y < src->height; y++) {
+        in = src->pixel_data + (size_t) y * src->width;
+        out = dst->bit_data + (size_t) y * dst->stride;
+        memset(out, 0, dst->stride);
+        bits = 0;
+        for (x = 0; x < src->width; x++) {
+            bits |= (in[x] != 0) << (x & 7);
+            if ((x & 7) == 7) {
+                out[x >> 3] = bits;
+                bits = 0;
+            }
+        }
+        if (src->width & 7)
+            out[src->width >> 3] = bits;
+    }
+}
+
+//unpacks src into dst, set pixels become 255 and the rest 0
+//dst must be the same size as src
+void mask1_to_gray8(struct Mask1 *src,
+                    struct Gray8 *dst) {
+    unsigned char *in, *out;
+    unsigned int x, y;
+
+    for (y = 0; y < src->height; y++) {
+        in = src->bit_data + (size_t) y * src->stride;
+        out = dst->pixel_data + (size_t) y * dst->width;
+        for (x = 0; x < src->width; x++) {
+            out[x] = ((in[x >> 3] >> (x & 7)) & 1) ? 255 : 0;
+        }
+    }
+}
+
+//packs a 24 bit segmap into dst, pixels with any channel non zero are set
+//dst must be the same size as src
+void BMP_to_mask1(struct BMP *src,
+                  struct Mask1 *dst) {
+    unsigned char *row, *out;
+    unsigned int x, y, height;
+
+    height = dst->height;
+    memset(dst->bit_data, 0, (size_t) dst->stride * height);
+    for (y = 0; y < height; y++) {
+        //bmp rows are stored bottom-up
+        row = src->pixel_data + (size_t) (height - y - 1) * src->scanline_size;
+        out = dst->bit_data + (size_t) y * dst->stride;
+        for (x = 0; x < dst->width; x++) {
+            if (row[3*x] | row[3*x + 1] | row[3*x + 2])
+                out[x >> 3] |= 1 << (x & 7);
+        }
+    }
+}
+
+//writes src into dst as black and white, dst must be the same size as src
+void mask1_into_BMP(struct Mask1 *src,
+                    struct BMP *dst) {
+    unsigned char *in, *out;
+    unsigned int x, y, height;
+
+    height = src->height;
+    for (y = 0; y < height; y++) {
+        in = src->bit_data + (size_t) y * src->stride;
+        out = dst->pixel_data + (size_t) (height - y - 1) * dst->scanline_size;
+        for (x = 0; x < src->width; x++) {
+            out[0] = out[1] = out[2] = ((in[x >> 3] >> (x & 7)) & 1) ? 255 : 0;
+            out += 3;
+        }
+    }
+}
+
+//creates a black and white BMP from src
+//returns NULL on memory error
+struct BMP *mask1_to_BMP(struct Mask1 *src) {
+    struct BMP *bmp;
+
+    bmp = init_BMP(src->width, src->height);
+    if (!bmp)
+        return NULL;
+    mask1_into_BMP(src, bmp);
+
+    return bmp;
+}
+
+//counts the set pixels in mask, padding bits are 0 so the whole block is counted in
+//one run, a 64 bit word at a time with popcnt where the cpu has it
+long count_mask1(struct Mask1 *mask) {
+    return get_pixel_kernels()->count_bits(mask->bit_data, (size_t) mask->stride * mask->height);
+}
+
+//1 if a and b are the same size
+int mask1_same_size(struct Mask1 *a,
+                    struct Mask1 *b) {
+    return a->width == b->width && a->height == b->height;
+}
+
+//dst = a & b, for keeping only the pixels of a inside a region of interest
+//all three must be the same size, dst may be a or b
+//returns 0 if the sizes differ
+int and_mask1(struct Mask1 *a,
+              struct Mask1 *b,
+              struct Mask1 *dst) {
+    unsigned long long *wa, *wb, *wd;
+    size_t i, words;
+
+    if (!mask1_same_size(a, b) || !mask1_same_size(a, dst))
+        return 0;
+    //rows are whole words, so the mask is one run of them
+    wa = (unsigned long long *) a->bit_data;
+    wb = (unsigned long long *) b->bit_data;
+    wd = (unsigned long long *) dst->bit_data;
+    words = (size_t) a->stride * a->height / 8;
+    for (i = 0; i < words; i++) {
+        wd[i] = wa[i] & wb[i];
+    }
+    return 1;
+}
+
+//dst = a | b, for merging masks or building up a dilation from shifted copies
+//all three must be the same size, dst may be a or b
+//returns 0 if the sizes differ
+int or_mask1(struct Mask1 *a,
+             struct Mask1 *b,
+             struct Mask1 *dst) {
+    unsigned long long *wa, *wb, *wd;
+    size_t i, words;
+
+    if (!mask1_same_size(a, b) || !mask1_same_size(a, dst))
+        return 0;
+    wa = (unsigned long long *) a->bit_data;
+    wb = (unsigned long long *) b->bit_data;
+    wd = (unsigned long long *) dst->bit_data;
+    words = (size_t) a->stride * a->height / 8;
+    for (i = 0; i < words; i++) {
+        wd[i] = wa[i] | wb[i];
+    }
+    return 1;
+}
+
+//saves mask as a 1 bit BMP with a black and white palette, 24 times smaller than
+//the 24 bit segmap
+//returns 1 on success
+int save_mask1(struct Mask1 *mask,
+               char *path) {
+    struct BMPFileHeader fh;
+    struct BMPImageHeader ih;
+    unsigned char palette[8] = {0, 0, 0, 0, 255, 255, 255, 0};
+    unsigned char row[mask->stride + 4];
+    unsigned char *in;
+    unsigned int x, y, row_size;
+    FILE *file;
+    int ok;
+
+    //1 bit BMP rows are padded to 4 bytes, most significant bit first
+    row_size = ((mask->width + 31) / 32) * 4;
+
+    memset(&fh, 0, sizeof(fh));
+    memset(&ih, 0, sizeof(ih));
+    fh.type = (((short) 77) << 8) | 66;
+    fh.off_bits = 14 + 40 + sizeof(palette);
+    fh.file_size = fh.off_bits + row_size * mask->height;
+    ih.size = 40;
+    ih.width = mask->width;
+    ih.height = mask->height;
+    ih.planes = 1;
+    ih.bit_count = 1;
+    ih.clr_used = 2;
+
+    file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    ok = fwrite(&fh, 14, 1, file) == 1
+        && fwrite(&ih, 40, 1, file) == 1
+        && fwrite(palette, sizeof(palette), 1, file) == 1;
+    //bottom-up, with each byte's bits reversed
+    for (y = mask->height; ok && y-- > 0; ) {
+        in = mask->bit_data + (size_t) y * mask->stride;
+        memset(row, 0, row_size);
+        for (x = 0; x < mask->width; x++) {
+            if ((in[x >> 3] >> (x & 7)) & 1)
+                row[x >> 3] |= 0x80 >> (x & 7);
+        }
+        ok = fwrite(row, row_size, 1, file) == 1;
+    }
+
+    fclose(file);
+    return ok;
+}
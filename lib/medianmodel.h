@@ -90,19 +90,22 @@ struct MedianModel *init_median_model(struct BMP *base,
 }
 
 //generates the segmentation map between the given image and model
-//thresholding the difference image with the given value
+//thresholding the greyscaled difference image with the given value, the difference
+//is taken in the same pass as the threshold and never stored
 struct BMP *generate_median_seg_map(struct MedianModel *model,
                                     struct BMP *img,
                                     unsigned char threshold) {
-    struct BMP *bg, *diff, *seg_map;
+    struct BMP *bg;
     bg = generate_median_background(model);
-    diff = get_difference(img, bg);
-    greyscale_BMP(diff);
-    seg_map = segment_BMP(diff, threshold);
+    if (!bg)
+        return NULL;
     
-    free_BMP(bg);
-    free_BMP(diff);
-    return seg_map;
+    //the background is written over with the map
+    if (segment_difference_BMP(img, bg, threshold, bg) < 0) {
+        free_BMP(bg);
+        return NULL;
+    }
+    return bg;
 }
 
 //updates the given model based on the img and it's segmentation map
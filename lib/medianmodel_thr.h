@@ -5,7 +5,7 @@
 struct JobBackgroundMM {
     struct MedianModel *model;
     struct BMP *bg;
-    int step;
+    struct JobPart part;
 };
 
 struct JobUpdateMM {
@@ -14,7 +14,7 @@ struct JobUpdateMM {
     struct BMP *img;
     struct BMP *bg;
     struct BMP *new_img;
-    int step;
+    struct JobPart part;
 };
 
 //function declarations
@@ -34,96 +34,65 @@ void *do_job_background_mm(void *job_struct);
 
 void *do_job_update_mm(void *job_struct);
 
-struct JobBackgroundMM *create_job_background_mm(struct MedianModel *model,
-                                                 struct BMP *bg,
-                                                 int step);
-
-
-struct JobUpdateMM *create_job_update_mm(struct MedianModel *model,
-                                         struct BMP *seg_map,
-                                         struct BMP *img,
-                                         struct BMP *bg,
-                                         struct BMP *new_img,
-                                         int step);
-
-
-struct JobBackgroundMM *create_job_background_mm(struct MedianModel *model,
-                                                 struct BMP *bg,
-                                                 int step);
-
 // ---------
 // FUNCTIONS
 // ---------
 
 //generates the median background image from the model
-//runs 4 threads
+//runs on the worker pool
 struct BMP *generate_median_background_thr(struct MedianModel *model) {
+    struct JobBackgroundMM jobs[MAX_BATCH_JOBS];
     struct BMP *bg;
+    int i, steps;
 
     bg = init_BMP(model->image_header->width, model->image_header->height);
     if (!bg)
         return NULL;
     
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobBackgroundMM *t1_job, *t2_job, *t3_job, *t4_job;
-    
-    //create jobs
-    t1_job = create_job_background_mm(model, bg, 0);
-    t2_job = create_job_background_mm(model, bg, 1);
-    t3_job = create_job_background_mm(model, bg, 2);
-    t4_job = create_job_background_mm(model, bg, 3);
-    
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_background_mm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_background_mm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_background_mm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_background_mm, t4_job)) {
-        return NULL;
+    steps = get_job_count(model->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].model = model;
+        jobs[i].bg = bg;
+        get_job_part(i, steps, model->image_header->height, 1, &jobs[i].part);
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
+    if (!parallel_for(do_job_background_mm, jobs, sizeof(struct JobBackgroundMM), steps)) {
+        free_BMP(bg);
         return NULL;
     }
     
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
-    
     return bg;
 }
 
 //generates the segmentation map between the given image and model
-//thresholding the difference image with the given value
-//runs 4 threads
+//thresholding the greyscaled difference image with the given value, the difference
+//is taken in the same pass as the threshold and never stored
+//runs on the worker pool
 struct BMP *generate_median_seg_map_thr(struct MedianModel *model,
                                         struct BMP *img,
                                         unsigned char threshold) {
-    struct BMP *bg, *diff, *seg_map;
+    struct BMP *bg;
     bg = generate_median_background_thr(model);
-    diff = get_difference_thr(img, bg);
-    greyscale_BMP_thr(diff);
-    seg_map = segment_BMP_thr(diff, threshold);
+    if (!bg)
+        return NULL;
     
-    free_BMP(bg);
-    free_BMP(diff);
-    return seg_map;
+    //the background is written over with the map
+    if (segment_difference_BMP_thr(img, bg, threshold, bg) < 0) {
+        free_BMP(bg);
+        return NULL;
+    }
+    return bg;
 }
 
 //updates the model with the given seg_map and img
-//runs 4 threads
+//runs on the worker pool
 void update_median_model_thr(struct MedianModel *model,
                              struct BMP *seg_map,
                              struct BMP *img) {
+    struct JobUpdateMM jobs[MAX_BATCH_JOBS];
     struct BMP *new_img, *bg;
     struct CPQueue *tmp, *tl;
-    int pd_size;
+    int pd_size, i, steps;
     
     pd_size = get_scanline_size(model->image_header->width) * model->image_header->height;
     
@@ -131,37 +100,18 @@ void update_median_model_thr(struct MedianModel *model,
     
     bg = generate_median_background_thr(model);
     
-    //declare threads and jobs
-    pthread_t t1, t2, t3, t4;
-    struct JobUpdateMM *t1_job, *t2_job, *t3_job, *t4_job;
-    
-    //create jobs
-    t1_job = create_job_update_mm(model, seg_map, img, bg, new_img, 0);
-    t2_job = create_job_update_mm(model, seg_map, img, bg, new_img, 1);
-    t3_job = create_job_update_mm(model, seg_map, img, bg, new_img, 2);
-    t4_job = create_job_update_mm(model, seg_map, img, bg, new_img, 3);
-    
-    //create threads
-    if (pthread_create(&t1, NULL, do_job_update_mm, t1_job) ||
-        pthread_create(&t2, NULL, do_job_update_mm, t2_job) ||
-        pthread_create(&t3, NULL, do_job_update_mm, t3_job) ||
-        pthread_create(&t4, NULL, do_job_update_mm, t4_job)) {
-        return;
+    steps = get_job_count(model->image_header->height);
+    for (i = 0; i < steps; i++) {
+        jobs[i].model = model;
+        jobs[i].seg_map = seg_map;
+        jobs[i].img = img;
+        jobs[i].bg = bg;
+        jobs[i].new_img = new_img;
+        get_job_part(i, steps, model->image_header->height, 1, &jobs[i].part);
     }
     
-    //wait for threads to join
-    if (pthread_join(t1, NULL) ||
-        pthread_join(t2, NULL) ||
-        pthread_join(t3, NULL) ||
-        pthread_join(t4, NULL)) {
+    if (!parallel_for(do_job_update_mm, jobs, sizeof(struct JobUpdateMM), steps))
         return;
-    }
-    
-    //free job structs
-    free(t1_job);
-    free(t2_job);
-    free(t3_job);
-    free(t4_job);
     
     //store head of queue for removal
     tmp = model->bgs;
@@ -199,19 +149,20 @@ void *do_job_background_mm(void *job_struct) {
     struct BMP *bg;
     struct CPQueue *tmp;
     
-    int step, i, j, k, pd_size;
+    int i, j, k, x, y, scanline;
     
     //unpack job struct
     struct JobBackgroundMM *job = (struct JobBackgroundMM *) job_struct;
     model = job->model;
     bg = job->bg;
-    step = job->step;
     
     unsigned char vals[model->n];
     
-    pd_size = get_scanline_size(model->image_header->width) * model->image_header->height;
+    scanline = get_scanline_size(model->image_header->width);
 
-    for (i = step; i < pd_size; i+=4) {
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+    for (x = job->part.x0; x < scanline; x += job->part.xstep) {
+        i = y * scanline + x;
         //collect all values at position i.
         tmp = model->bgs;
         j = 0;
@@ -223,12 +174,14 @@ void *do_job_background_mm(void *job_struct) {
         qsort(vals, model->n, sizeof(unsigned char), uns_char_cmp);
         bg->pixel_data[i] = vals[(model->n-1) / 2];
     }
+    }
+    return NULL;
 }
 
 void *do_job_update_mm(void *job_struct) {
     struct MedianModel *model;
     struct BMP *seg_map, *img, *bg, *new_img;
-    int i, step, pd_size;
+    int i, x, y, scanline;
     
     //unpack job_struct
     struct JobUpdateMM *job = (struct JobUpdateMM *) job_struct;
@@ -237,48 +190,18 @@ void *do_job_update_mm(void *job_struct) {
     img = job->img;
     bg = job->bg;
     new_img = job->new_img;
-    step = job->step;
     
-    pd_size = get_scanline_size(model->image_header->width) * model->image_header->height;
+    scanline = get_scanline_size(model->image_header->width);
     
     //at each pixel where seg_map[i] == 255 (motion) replace with median
     //from the background
-    for (i = step; i < pd_size; i += 4) {
-        if (seg_map->pixel_data[i] == 255) {
-            new_img->pixel_data[i] = bg->pixel_data[i];
+    for (y = job->part.y0; y < job->part.y1; y += job->part.ystep) {
+        for (x = job->part.x0; x < scanline; x += job->part.xstep) {
+            i = y * scanline + x;
+            if (seg_map->pixel_data[i] == 255) {
+                new_img->pixel_data[i] = bg->pixel_data[i];
+            }
         }
     }
-}
-    
-struct JobBackgroundMM *create_job_background_mm(struct MedianModel *model,
-                                                 struct BMP *bg,
-                                                 int step) {
-    struct JobBackgroundMM *job;
-    job = malloc(sizeof(struct JobBackgroundMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->bg = bg;
-    job->step = step;
-    return job;
-}
-
-
-struct JobUpdateMM *create_job_update_mm(struct MedianModel *model,
-                                         struct BMP *seg_map,
-                                         struct BMP *img,
-                                         struct BMP *bg,
-                                         struct BMP *new_img,
-                                         int step) {
-    struct JobUpdateMM *job;
-    job = malloc(sizeof(struct JobUpdateMM));
-    if (!job)
-        return NULL;
-    job->model = model;
-    job->seg_map = seg_map;
-    job->img = img;
-    job->bg = bg;
-    job->new_img = new_img;
-    job->step = step;
-    return job;
+    return NULL;
 }
@@ -0,0 +1,555 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <jpeglib.h>
+
+#define MJPEG_MAX_CLIENTS 16          //viewers served at once, more are turned away
+#define MJPEG_BOUNDARY "motdecframe"
+#define MJPEG_POLL_MS 200             //how often the listener checks if it should stop
+#define MJPEG_SEND_TIMEOUT 5          //seconds a viewer may stall a send before it is dropped
+
+#define MJPEG_STREAM_FRAME 0          //GET /stream, the live frames
+#define MJPEG_STREAM_SEGMAP 1         //GET /segmap, the frames with the segmap over them
+#define MJPEG_STREAMS 2
+
+// ----------
+// STRUCTURES
+// ----------
+
+//an encoded frame, shared by every viewer of its stream
+//freed when the last viewer sending it and the server are done with it
+struct JpegFrame {
+    unsigned char *data;
+    unsigned long size;
+    unsigned long seq;              //capture sequence number of the frame
+    int refs;
+};
+
+//libjpeg's error handler, with where to jump back to instead of exiting
+struct MjpegError {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+struct MjpegClient {
+    struct MjpegServer *srv;
+    int fd;
+    int stream;
+    int started;                    //thread needs joining
+    int done;                       //thread has finished with the connection
+    pthread_t thread;
+};
+
+//serves the snapshots published to shared memory as multipart jpeg streams
+//frames are encoded on the server's own thread, once per stream, and only while
+//someone is watching, the detector just tells it a new snapshot is there
+struct MjpegServer {
+    int port;
+    int quality;
+    int listen_fd;
+    int stopping;
+    int running;                    //threads haven't been joined yet
+    struct ShmReader reader;        //view of the publisher's mapping
+    unsigned char *frame;           //snapshot being encoded
+    unsigned char *segmap;
+    unsigned char *row;             //one row of the overlay
+    struct JpegFrame *latest[MJPEG_STREAMS];
+    int viewers[MJPEG_STREAMS];
+    int notified;                   //a snapshot newer than the last encode may be there
+    struct MjpegClient clients[MJPEG_MAX_CLIENTS];
+    pthread_mutex_t lock;
+    pthread_cond_t encode_cond;     //wakes the encoder
+    pthread_cond_t frame_cond;      //wakes viewers when a frame is encoded
+    pthread_t listen_thread;
+    pthread_t encode_thread;
+    unsigned long encoded;          //jpegs made, over both streams
+    double encode_time;             //seconds spent encoding
+    unsigned long sent;             //jpegs sent, over all viewers
+    unsigned long refused;          //connections turned away because all slots were in use
+    int peak_viewers;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct MjpegServer *init_mjpeg_server(int port,
+                                      int quality,
+                                      int public,
+                                      struct ShmPublisher *pub);
+
+void stop_mjpeg_server(struct MjpegServer *srv);
+
+void free_mjpeg_server(struct MjpegServer *srv);
+
+void mjpeg_notify(struct MjpegServer *srv);
+
+void release_jpeg_frame(struct JpegFrame *jf);
+
+void mjpeg_error_exit(j_common_ptr cinfo);
+
+struct JpegFrame *encode_snapshot(struct MjpegServer *srv,
+                                  int stream,
+                                  unsigned long seq);
+
+void *do_mjpeg_listen(void *arg);
+
+void *do_mjpeg_encode(void *arg);
+
+void *do_mjpeg_client(void *arg);
+
+int send_all(int fd,
+             void *data,
+             size_t size);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//starts serving pub's snapshots on port, pub must outlive the server
+//only to this machine, unless public is set, the stream has no authentication
+//returns NULL on error, such as the port being in use
+struct MjpegServer *init_mjpeg_server(int port,
+                                      int quality,
+                                      int public,
+                                      struct ShmPublisher *pub) {
+    struct MjpegServer *srv;
+    struct sockaddr_in addr;
+    int on = 1;
+
+    srv = calloc(sizeof(struct MjpegServer), 1);
+    if (!srv)
+        return NULL;
+    srv->port = port;
+    srv->quality = quality;
+    srv->listen_fd = -1;
+    srv->reader.header = pub->header;
+    srv->reader.size = pub->size;
+    pthread_mutex_init(&srv->lock, NULL);
+    pthread_cond_init(&srv->encode_cond, NULL);
+    pthread_cond_init(&srv->frame_cond, NULL);
+
+    srv->frame = malloc(pub->header->frame_size);
+    srv->segmap = malloc(pub->header->segmap_size);
+    srv->row = malloc(pub->header->width * 3);
+    if (!srv->frame || !srv->segmap || !srv->row) {
+        free_mjpeg_server(srv);
+        return NULL;
+    }
+
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0) {
+        free_mjpeg_server(srv);
+        return NULL;
+    }
+    setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(public ? INADDR_ANY : INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(srv->listen_fd, MJPEG_MAX_CLIENTS) != 0) {
+        free_mjpeg_server(srv);
+        return NULL;
+    }
+
+    if (pthread_create(&srv->encode_thread, NULL, do_mjpeg_encode, srv) != 0) {
+        free_mjpeg_server(srv);
+        return NULL;
+    }
+    if (pthread_create(&srv->listen_thread, NULL, do_mjpeg_listen, srv) != 0) {
+        pthread_mutex_lock(&srv->lock);
+        srv->stopping = 1;
+        pthread_cond_signal(&srv->encode_cond);
+        pthread_mutex_unlock(&srv->lock);
+        pthread_join(srv->encode_thread, NULL);
+        free_mjpeg_server(srv);
+        return NULL;
+    }
+    srv->running = 1;
+
+    return srv;
+}
+
+//disconnects every viewer and stops the threads, stats stay readable
+void stop_mjpeg_server(struct MjpegServer *srv) {
+    int i;
+
+    if (!srv->running)
+        return;
+
+    //viewers blocked in send are woken by shutting their sockets down
+    pthread_mutex_lock(&srv->lock);
+    srv->stopping = 1;
+    for (i = 0; i < MJPEG_MAX_CLIENTS; i++) {
+        if (srv->clients[i].started && !srv->clients[i].done)
+            shutdown(srv->clients[i].fd, SHUT_RDWR);
+    }
+    pthread_cond_signal(&srv->encode_cond);
+    pthread_cond_broadcast(&srv->frame_cond);
+    pthread_mutex_unlock(&srv->lock);
+
+    pthread_join(srv->listen_thread, NULL);
+    pthread_join(srv->encode_thread, NULL);
+    for (i = 0; i < MJPEG_MAX_CLIENTS; i++) {
+        if (srv->clients[i].started) {
+            pthread_join(srv->clients[i].thread, NULL);
+            close(srv->clients[i].fd);
+            srv->clients[i].started = 0;
+        }
+    }
+    srv->running = 0;
+}
+
+//stops the server, if still running, and frees it
+void free_mjpeg_server(struct MjpegServer *srv) {
+    int i;
+
+    if (!srv)
+        return;
+
+    stop_mjpeg_server(srv);
+
+    for (i = 0; i < MJPEG_STREAMS; i++) {
+        release_jpeg_frame(srv->latest[i]);
+    }
+    if (srv->listen_fd >= 0)
+        close(srv->listen_fd);
+    pthread_mutex_destroy(&srv->lock);
+    pthread_cond_destroy(&srv->encode_cond);
+    pthread_cond_destroy(&srv->frame_cond);
+    free(srv->frame);
+    free(srv->segmap);
+    free(srv->row);
+    free(srv);
+}
+
+//tells the encoder a new snapshot was published, call after shm_end
+//costs the caller nothing more than the lock when no one is watching
+void mjpeg_notify(struct MjpegServer *srv) {
+    pthread_mutex_lock(&srv->lock);
+    if (srv->viewers[MJPEG_STREAM_FRAME] + srv->viewers[MJPEG_STREAM_SEGMAP] > 0) {
+        srv->notified = 1;
+        pthread_cond_signal(&srv->encode_cond);
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+//drops a reference to jf, freeing it with the last one, call with the lock held
+void release_jpeg_frame(struct JpegFrame *jf) {
+    if (!jf)
+        return;
+    if (--jf->refs == 0) {
+        free(jf->data);
+        free(jf);
+    }
+}
+
+//libjpeg error handler, jumps back into encode_snapshot instead of exiting the process
+void mjpeg_error_exit(j_common_ptr cinfo) {
+    struct MjpegError *err = (struct MjpegError *) cinfo->err;
+
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(err->jump, 1);
+}
+
+//encodes the snapshot in srv->frame as a jpeg, with srv->segmap tinted red over it
+//for the segmap stream
+//returns NULL on memory error, or if libjpeg fails, the frame is then skipped
+struct JpegFrame *encode_snapshot(struct MjpegServer *srv,
+                                  int stream,
+                                  unsigned long seq) {
+    struct jpeg_compress_struct cinfo;
+    struct MjpegError jerr;
+    struct JpegFrame *jf;
+    JSAMPROW row;
+    unsigned char *in, *seg;
+    int x, y, width, height, scanline;
+
+    jf = calloc(sizeof(struct JpegFrame), 1);
+    if (!jf)
+        return NULL;
+    jf->seq = seq;
+    jf->refs = 1;
+
+    width = srv->reader.header->width;
+    height = srv->reader.header->height;
+    scanline = get_scanline_size(width);
+
+    cinfo.err = jpeg_std_error(&jerr.mgr);
+    jerr.mgr.error_exit = mjpeg_error_exit;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(jf->data);
+        free(jf);
+        return NULL;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &jf->data, &jf->size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_EXT_BGR; //BMP pixel order, no conversion pass
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, srv->quality, TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    for (y = 0; y < height; y++) {
+        //bmp rows are stored bottom-up
+        in = srv->frame + 54 + ((height - y - 1) * scanline);
+        if (stream == MJPEG_STREAM_SEGMAP) {
+            seg = srv->segmap + (y * width);
+            for (x = 0; x < width; x++) {
+                if (seg[x]) {
+                    srv->row[3*x] = in[3*x] >> 1;
+                    srv->row[3*x + 1] = in[3*x + 1] >> 1;
+                    srv->row[3*x + 2] = (in[3*x + 2] >> 1) + 128;
+                } else {
+                    srv->row[3*x] = in[3*x];
+                    srv->row[3*x + 1] = in[3*x + 1];
+                    srv->row[3*x + 2] = in[3*x + 2];
+                }
+            }
+            row = srv->row;
+        } else {
+            row = in;
+        }
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    if (!jf->data) {
+        free(jf);
+        return NULL;
+    }
+    return jf;
+}
+
+//listener thread, accepts viewers until stopped
+void *do_mjpeg_listen(void *arg) {
+    struct MjpegServer *srv = arg;
+    struct MjpegClient *client;
+    struct pollfd pfd;
+    struct timeval tv;
+    char *busy = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+    int i, fd;
+
+    pfd.fd = srv->listen_fd;
+    pfd.events = POLLIN;
+    while (1) {
+        pthread_mutex_lock(&srv->lock);
+        if (srv->stopping) {
+            pthread_mutex_unlock(&srv->lock);
+            break;
+        }
+        pthread_mutex_unlock(&srv->lock);
+
+        if (poll(&pfd, 1, MJPEG_POLL_MS) <= 0)
+            continue;
+        fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        //a viewer that stops reading is dropped instead of holding a frame forever
+        tv.tv_sec = MJPEG_SEND_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        //find a free slot, joining the thread of a finished viewer to reuse its slot
+        client = NULL;
+        pthread_mutex_lock(&srv->lock);
+        for (i = 0; i < MJPEG_MAX_CLIENTS && !client; i++) {
+            if (srv->clients[i].started && srv->clients[i].done) {
+                pthread_mutex_unlock(&srv->lock);
+                pthread_join(srv->clients[i].thread, NULL);
+                close(srv->clients[i].fd);
+                pthread_mutex_lock(&srv->lock);
+                srv->clients[i].started = 0;
+            }
+            if (!srv->clients[i].started)
+                client = &srv->clients[i];
+        }
+        if (!client || srv->stopping) {
+            srv->refused++;
+            pthread_mutex_unlock(&srv->lock);
+            send_all(fd, busy, strlen(busy));
+            close(fd);
+            continue;
+        }
+        client->srv = srv;
+        client->fd = fd;
+        client->done = 0;
+        client->started = 1;
+        if (pthread_create(&client->thread, NULL, do_mjpeg_client, client) != 0) {
+            client->started = 0;
+            close(fd);
+        }
+        pthread_mutex_unlock(&srv->lock);
+    }
+
+    return NULL;
+}
+
+//encoder thread, encodes the newest snapshot for each stream being watched
+void *do_mjpeg_encode(void *arg) {
+    struct MjpegServer *srv = arg;
+    struct ShmStats stats;
+    struct JpegFrame *jf[MJPEG_STREAMS];
+    int want[MJPEG_STREAMS];
+    int i;
+    double start;
+
+    pthread_mutex_lock(&srv->lock);
+    while (1) {
+        while (!srv->notified && !srv->stopping)
+            pthread_cond_wait(&srv->encode_cond, &srv->lock);
+        if (srv->stopping)
+            break;
+        srv->notified = 0;
+
+        //only streams with viewers are encoded, and only for frames they don't have
+        for (i = 0; i < MJPEG_STREAMS; i++) {
+            want[i] = srv->viewers[i] > 0;
+            jf[i] = NULL;
+        }
+        pthread_mutex_unlock(&srv->lock);
+
+        if (read_shm_snapshot(&srv->reader, srv->frame, srv->segmap, &stats) == 1) {
+            for (i = 0; i < MJPEG_STREAMS; i++) {
+                //latest[i] is only replaced on this thread, safe to read unlocked
+                if (!want[i] || (srv->latest[i] && srv->latest[i]->seq == stats.frame_seq))
+                    continue;
+                start = get_monotonic_time();
+                jf[i] = encode_snapshot(srv, i, stats.frame_seq);
+                srv->encode_time += get_monotonic_time() - start;
+            }
+        }
+
+        pthread_mutex_lock(&srv->lock);
+        for (i = 0; i < MJPEG_STREAMS; i++) {
+            if (!jf[i])
+                continue;
+            release_jpeg_frame(srv->latest[i]);
+            srv->latest[i] = jf[i];
+            srv->encoded++;
+        }
+        pthread_cond_broadcast(&srv->frame_cond);
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    return NULL;
+}
+
+//viewer thread, answers the request and sends each new frame of the stream asked for
+//a viewer slower than the detector skips straight to the newest frame
+void *do_mjpeg_client(void *arg) {
+    struct MjpegClient *client = arg;
+    struct MjpegServer *srv = client->srv;
+    struct JpegFrame *jf;
+    char request[1024], part[128];
+    char *ok = "HTTP/1.0 200 OK\r\n"
+               "Content-Type: multipart/x-mixed-replace; boundary=" MJPEG_BOUNDARY "\r\n"
+               "Cache-Control: no-cache\r\n"
+               "Connection: close\r\n\r\n";
+    char *notfound = "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n";
+    unsigned long last_seq;
+    int len, n, stream, sent;
+
+    //only the request line matters, anything else is ignored
+    len = 0;
+    request[0] = '\0';
+    while (len < (int) sizeof(request) - 1 && !strstr(request, "\r\n")) {
+        n = recv(client->fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0)
+            break;
+        len += n;
+        request[len] = '\0';
+    }
+
+    if (strncmp(request, "GET /stream ", 12) == 0) {
+        stream = MJPEG_STREAM_FRAME;
+    } else if (strncmp(request, "GET /segmap ", 12) == 0) {
+        stream = MJPEG_STREAM_SEGMAP;
+    } else {
+        send_all(client->fd, notfound, strlen(notfound));
+        pthread_mutex_lock(&srv->lock);
+        client->done = 1;
+        pthread_mutex_unlock(&srv->lock);
+        return NULL;
+    }
+    client->stream = stream;
+
+    if (!send_all(client->fd, ok, strlen(ok))) {
+        pthread_mutex_lock(&srv->lock);
+        client->done = 1;
+        pthread_mutex_unlock(&srv->lock);
+        return NULL;
+    }
+
+    //ask for an encode straight away so the viewer doesn't wait for the next frame
+    pthread_mutex_lock(&srv->lock);
+    srv->viewers[stream]++;
+    if (srv->viewers[MJPEG_STREAM_FRAME] + srv->viewers[MJPEG_STREAM_SEGMAP] > srv->peak_viewers)
+        srv->peak_viewers = srv->viewers[MJPEG_STREAM_FRAME] + srv->viewers[MJPEG_STREAM_SEGMAP];
+    srv->notified = 1;
+    pthread_cond_signal(&srv->encode_cond);
+
+    last_seq = 0;
+    while (!srv->stopping) {
+        if (!srv->latest[stream] || srv->latest[stream]->seq == last_seq) {
+            pthread_cond_wait(&srv->frame_cond, &srv->lock);
+            continue;
+        }
+        jf = srv->latest[stream];
+        jf->refs++;
+        last_seq = jf->seq;
+        pthread_mutex_unlock(&srv->lock);
+
+        len = snprintf(part, sizeof(part),
+                       "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n",
+                       jf->size);
+        sent = send_all(client->fd, part, len)
+               && send_all(client->fd, jf->data, jf->size)
+               && send_all(client->fd, "\r\n", 2);
+
+        pthread_mutex_lock(&srv->lock);
+        release_jpeg_frame(jf);
+        if (!sent)
+            break;
+        srv->sent++;
+    }
+    srv->viewers[stream]--;
+    client->done = 1;
+    pthread_mutex_unlock(&srv->lock);
+
+    return NULL;
+}
+
+//sends all size bytes of data, never raising SIGPIPE
+//returns 1 on success, 0 if the viewer went away or timed out
+int send_all(int fd,
+             void *data,
+             size_t size) {
+    unsigned char *p = data;
+    ssize_t n;
+
+    while (size > 0) {
+        n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0)
+            return 0;
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
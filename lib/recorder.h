@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//results of recorder_trigger
+#define REC_REJECTED 0   //limit reached or ffmpeg couldn't be started
+#define REC_STARTED  1   //a new clip was started
+#define REC_EXTENDED 2   //the event was added to the clip already recording
+
+// ----------
+// STRUCTURES
+// ----------
+
+struct Recorder;
+
+//one clip being encoded by its own ffmpeg child
+//frames are fed to ffmpeg by a writer thread so the detector never waits on it
+struct Recording {
+    int active;                  //slot holds a running recording
+    int joinable;                //writer thread has finished and needs joining
+    pid_t pid;
+    int fd;                      //ffmpeg stdin
+    char path[256];
+    double start_time;
+    double end_time;             //pushed back when overlapping events extend the clip
+    unsigned long frames_written;
+    unsigned long preroll_from;  //pre-roll frames written at the start of the clip
+    unsigned long preroll_to;
+    unsigned char *buffer;       //one I420 frame, as ffmpeg reads it
+    struct BMP *scratch;         //copy of the newest frame, converted outside the lock, bgr only
+    pthread_t thread;
+    struct Recorder *rec;
+};
+
+//records event clips from the frames the detector is already seeing
+//the last few seconds are kept in memory as I420 (half the size of bgr) so clips start before the event
+struct Recorder {
+    char *ffmpeg_path;
+    unsigned int width;
+    unsigned int height;
+    int frame_size;              //bytes in an I420 frame
+    int fps;                     //clip frame rate
+    double clip_length;          //seconds recorded after the last event of a clip
+    double max_length;           //longest a clip can be extended to
+    int max_recordings;          //clips that may be encoding at once
+    struct Recording *recordings;
+    struct Recording *current;   //newest clip, the one events are added to
+    int luma;                    //frames are 8 bit luma, clips are recorded in greyscale
+    struct BMP *latest;          //newest captured frame, bgr only
+    struct Gray8 *latest_luma;   //newest captured frame, luma only
+    unsigned long latest_seq;
+    int preroll_count;           //frames of pre-roll kept, 0 for none
+    unsigned char *preroll;      //preroll_count I420 frames
+    unsigned long *preroll_seq;  //sample number held in each pre-roll slot
+    unsigned long preroll_next;  //sample number of the next pre-roll frame
+    double next_sample;          //monotonic time the next pre-roll frame is due
+    _Atomic int active_count;
+    int stopping;
+    pthread_mutex_t lock;
+    unsigned long started;
+    unsigned long extended;
+    unsigned long rejected;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct Recorder *init_recorder(char *ffmpeg_path,
+                               unsigned int width,
+                               unsigned int height,
+                               int fps,
+                               int clip_length,
+                               int max_length,
+                               int max_recordings,
+                               int preroll_seconds,
+                               int luma);
+
+void free_recorder(struct Recorder *rec);
+
+void recorder_push_frame(struct Recorder *rec,
+                         struct Frame *frame);
+
+int recorder_trigger(struct Recorder *rec,
+                     char *path);
+
+int start_recording(struct Recorder *rec,
+                    struct Recording *r,
+                    char *path,
+                    double now);
+
+int spawn_recording_ffmpeg(struct Recorder *rec,
+                           struct Recording *r);
+
+void *do_recording(void *arg);
+
+int write_full(int fd,
+               unsigned char *buf,
+               size_t len);
+
+long recorder_memory(struct Recorder *rec);
+
+void bgr_to_i420(struct BMP *src,
+                 unsigned char *dst);
+
+void gray8_to_i420(struct Gray8 *src,
+                   unsigned char *dst);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a recorder for frames of width x height, bgr or 8 bit luma if luma is set
+//preroll_seconds of frames before each event are kept in memory and put at the start of the clip
+//returns NULL on memory error
+struct Recorder *init_recorder(char *ffmpeg_path,
+                               unsigned int width,
+                               unsigned int height,
+                               int fps,
+                               int clip_length,
+                               int max_length,
+                               int max_recordings,
+                               int preroll_seconds,
+                               int luma) {
+    struct Recorder *rec;
+    int i;
+
+    rec = calloc(sizeof(struct Recorder), 1);
+    if (!rec)
+        return NULL;
+
+    rec->ffmpeg_path = ffmpeg_path;
+    rec->width = width;
+    rec->height = height;
+    //full size luma, quarter size chroma planes
+    rec->frame_size = (width * height) + 2 * (((width + 1) / 2) * ((height + 1) / 2));
+    rec->fps = fps;
+    rec->clip_length = clip_length;
+    rec->max_length = max_length > clip_length ? max_length : clip_length;
+    rec->max_recordings = max_recordings;
+    rec->luma = luma;
+    atomic_init(&rec->active_count, 0);
+    pthread_mutex_init(&rec->lock, NULL);
+
+    if (luma)
+        rec->latest_luma = init_gray8(width, height);
+    else
+        rec->latest = init_BMP(width, height);
+    rec->recordings = calloc(max_recordings, sizeof(struct Recording));
+    if ((!rec->latest && !rec->latest_luma) || !rec->recordings) {
+        free_recorder(rec);
+        return NULL;
+    }
+
+    //pre-roll is allocated once, its size never changes
+    rec->preroll_count = preroll_seconds * fps;
+    if (rec->preroll_count > 0) {
+        rec->preroll = malloc((size_t) rec->preroll_count * rec->frame_size);
+        rec->preroll_seq = calloc(rec->preroll_count, sizeof(unsigned long));
+        if (!rec->preroll || !rec->preroll_seq) {
+            free_recorder(rec);
+            return NULL;
+        }
+        //sample numbers start at 1 so an empty slot never matches
+        rec->preroll_next = 1;
+        rec->next_sample = get_monotonic_time();
+    }
+    for (i = 0; i < max_recordings; i++) {
+        rec->recordings[i].rec = rec;
+        rec->recordings[i].fd = -1;
+        rec->recordings[i].pid = -1;
+    }
+
+    return rec;
+}
+
+//ends every recording early, waits for ffmpeg to finish the clips and frees the recorder
+void free_recorder(struct Recorder *rec) {
+    int i;
+
+    if (!rec)
+        return;
+
+    if (rec->recordings) {
+        //writer threads see this on their next frame
+        pthread_mutex_lock(&rec->lock);
+        rec->stopping = 1;
+        pthread_mutex_unlock(&rec->lock);
+
+        for (i = 0; i < rec->max_recordings; i++) {
+            if (rec->recordings[i].active || rec->recordings[i].joinable)
+                pthread_join(rec->recordings[i].thread, NULL);
+            free(rec->recordings[i].buffer);
+            if (rec->recordings[i].scratch)
+                free_BMP(rec->recordings[i].scratch);
+        }
+        free(rec->recordings);
+    }
+
+    free(rec->preroll);
+    free(rec->preroll_seq);
+    if (rec->latest)
+        free_BMP(rec->latest);
+    free_gray8(rec->latest_luma);
+    pthread_mutex_destroy(&rec->lock);
+    free(rec);
+}
+
+//gives the recorder the newest frame
+//a pre-roll frame is kept every 1/fps seconds, the full frame is only copied while something is recording
+void recorder_push_frame(struct Recorder *rec,
+                         struct Frame *frame) {
+    unsigned long slot;
+    double now;
+
+    if (rec->preroll_count > 0) {
+        now = get_monotonic_time();
+        if (now >= rec->next_sample) {
+            slot = rec->preroll_next % rec->preroll_count;
+            pthread_mutex_lock(&rec->lock);
+            if (rec->luma)
+                gray8_to_i420(frame->luma, rec->preroll + (slot * rec->frame_size));
+            else
+                bgr_to_i420(frame->img, rec->preroll + (slot * rec->frame_size));
+            rec->preroll_seq[slot] = rec->preroll_next;
+            rec->preroll_next++;
+            pthread_mutex_unlock(&rec->lock);
+            rec->next_sample += 1.0 / rec->fps;
+            //don't bunch samples up after a stall
+            if (rec->next_sample < now)
+                rec->next_sample = now + 1.0 / rec->fps;
+        }
+    }
+
+    if (atomic_load(&rec->active_count) == 0)
+        return;
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->luma)
+        memcpy(rec->latest_luma->pixel_data, frame->luma->pixel_data, rec->width * rec->height);
+    else
+        memcpy(rec->latest->pixel_data, frame->img->pixel_data,
+               rec->latest->scanline_size * rec->height);
+    rec->latest_seq++;
+    pthread_mutex_unlock(&rec->lock);
+}
+
+//records an event, returns straight away
+//an event during a clip extends it (up to max_length), otherwise a new clip is started at path
+//returns REC_STARTED, REC_EXTENDED or REC_REJECTED
+int recorder_trigger(struct Recorder *rec,
+                     char *path) {
+    struct Recording *r;
+    double now;
+    int i, ret;
+
+    now = get_monotonic_time();
+    ret = REC_REJECTED;
+
+    pthread_mutex_lock(&rec->lock);
+
+    //overlapping event, keep the clip that is already running going
+    r = rec->current;
+    if (r && r->active && now < r->end_time
+        && now + rec->clip_length <= r->start_time + rec->max_length) {
+        r->end_time = now + rec->clip_length;
+        rec->extended++;
+        pthread_mutex_unlock(&rec->lock);
+        return REC_EXTENDED;
+    }
+
+    //find a free slot, joining writer threads that have finished
+    for (i = 0; i < rec->max_recordings; i++) {
+        r = &rec->recordings[i];
+        if (r->active)
+            continue;
+        if (r->joinable) {
+            pthread_join(r->thread, NULL);
+            r->joinable = 0;
+        }
+        if (start_recording(rec, r, path, now)) {
+            rec->current = r;
+            rec->started++;
+            ret = REC_STARTED;
+        }
+        break;
+    }
+
+    if (ret == REC_REJECTED)
+        rec->rejected++;
+
+    pthread_mutex_unlock(&rec->lock);
+    return ret;
+}
+
+//starts the thread that records a clip into path
+//called with the recorder locked, returns 1 on success
+int start_recording(struct Recorder *rec,
+                    struct Recording *r,
+                    char *path,
+                    double now) {
+    //each is made once and kept, one that failed is tried again on the next event
+    if (!r->buffer) {
+        r->buffer = malloc(rec->frame_size);
+        if (!r->buffer)
+            return 0;
+    }
+    if (!rec->luma && !r->scratch) {
+        r->scratch = init_BMP(rec->width, rec->height);
+        if (!r->scratch)
+            return 0;
+    }
+
+    strncpy(r->path, path, sizeof(r->path) - 1);
+    r->path[sizeof(r->path) - 1] = '\0';
+    r->start_time = now;
+    r->end_time = now + rec->clip_length;
+    r->frames_written = 0;
+    //everything in the pre-roll ring when the event happened
+    r->preroll_to = rec->preroll_next;
+    r->preroll_from = rec->preroll_next > rec->preroll_count + 1
+                    ? rec->preroll_next - rec->preroll_count : 1;
+    if (rec->preroll_count == 0)
+        r->preroll_from = r->preroll_to;
+    r->active = 1;
+
+    if (pthread_create(&r->thread, NULL, do_recording, r) != 0) {
+        r->active = 0;
+        return 0;
+    }
+
+    atomic_fetch_add(&rec->active_count, 1);
+    return 1;
+}
+
+//creates the clip's directory and starts ffmpeg encoding raw frames from a pipe into it
+//runs on the writer thread so the detector never waits on storage or fork
+//returns 1 on success
+int spawn_recording_ffmpeg(struct Recorder *rec,
+                           struct Recording *r) {
+    int pipefd[2];
+    int devnull;
+    pid_t pid;
+    char size[32], fps[16];
+    char *args[24];
+
+    if (!make_parent_dirs(r->path))
+        return 0;
+
+    //close on exec so later children don't hold this clip's pipe open
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
+        return 0;
+
+    sprintf(size, "%ux%u", rec->width, rec->height);
+    sprintf(fps, "%d", rec->fps);
+
+    // ffmpeg args
+    args[0] = rec->ffmpeg_path;
+    //-y -loglevel panic
+    args[1] = "-y";
+    args[2] = "-loglevel";
+    args[3] = "panic";
+    // -f rawvideo -pix_fmt yuv420p -video_size -framerate -i stdin
+    args[4] = "-f";
+    args[5] = "rawvideo";
+    args[6] = "-pix_fmt";
+    args[7] = "yuv420p";
+    args[8] = "-video_size";
+    args[9] = size;
+    args[10] = "-framerate";
+    args[11] = fps;
+    args[12] = "-i";
+    args[13] = "pipe:0";
+    //keep 4:2:0 so browsers can play the clip
+    args[14] = "-pix_fmt";
+    args[15] = "yuv420p";
+    //-movflags faststart
+    args[16] = "-movflags";
+    args[17] = "+faststart";
+    // logs/date/time/output.mp4
+    args[18] = r->path;
+    args[19] = (char *) NULL;
+
+    pid = fork();
+
+    //fork error return
+    if (pid == -1) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 0;
+    //child - exec with stdin as read end of pipe
+    } else if (pid == 0) {
+        dup2(pipefd[0], STDIN_FILENO);
+        devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execv(rec->ffmpeg_path, args);
+        _exit(EXIT_FAILURE);
+    }
+
+    //parent - keep write end
+    close(pipefd[0]);
+
+    r->pid = pid;
+    r->fd = pipefd[1];
+    return 1;
+}
+
+//writer thread, writes the pre-roll then feeds the newest frame to ffmpeg at the clip
+//frame rate until the clip ends
+void *do_recording(void *arg) {
+    struct Recording *r = arg;
+    struct Recorder *rec = r->rec;
+    struct timespec ts;
+    unsigned long sample, slot;
+    double next, now, wait;
+    int ok, failed;
+
+    failed = !spawn_recording_ffmpeg(rec, r);
+
+    //pre-roll, oldest first, as fast as ffmpeg takes it, none if ffmpeg didn't start
+    for (sample = r->preroll_from; !failed && sample < r->preroll_to; sample++) {
+        slot = sample % rec->preroll_count;
+        pthread_mutex_lock(&rec->lock);
+        if (rec->stopping) {
+            pthread_mutex_unlock(&rec->lock);
+            break;
+        }
+        //slot may have been reused while ffmpeg was slow, skip it if so
+        ok = rec->preroll_seq[slot] == sample;
+        if (ok)
+            memcpy(r->buffer, rec->preroll + (slot * rec->frame_size), rec->frame_size);
+        pthread_mutex_unlock(&rec->lock);
+
+        if (!ok)
+            continue;
+        if (!write_full(r->fd, r->buffer, rec->frame_size)) {
+            failed = 1;
+            break;
+        }
+        r->frames_written++;
+    }
+
+    next = get_monotonic_time();
+
+    //luma frames only fill the Y plane, chroma stays neutral
+    if (rec->luma)
+        memset(r->buffer + (rec->width * rec->height), 128,
+               rec->frame_size - (rec->width * rec->height));
+
+    while (!failed) {
+        pthread_mutex_lock(&rec->lock);
+        if (rec->stopping || get_monotonic_time() >= r->end_time) {
+            pthread_mutex_unlock(&rec->lock);
+            break;
+        }
+        if (rec->luma) {
+            //already in ffmpeg's layout, copied straight into the Y plane
+            memcpy(r->buffer, rec->latest_luma->pixel_data, rec->width * rec->height);
+            pthread_mutex_unlock(&rec->lock);
+        } else {
+            //copy out and convert without the lock, capture only waits for the copy
+            memcpy(r->scratch->pixel_data, rec->latest->pixel_data,
+                   rec->latest->scanline_size * rec->height);
+            pthread_mutex_unlock(&rec->lock);
+
+            bgr_to_i420(r->scratch, r->buffer);
+        }
+
+        //ffmpeg has gone, nothing more can be recorded
+        if (!write_full(r->fd, r->buffer, rec->frame_size))
+            break;
+        r->frames_written++;
+
+        //wait for the next frame time
+        next += 1.0 / rec->fps;
+        now = get_monotonic_time();
+        wait = next - now;
+        if (wait > 0.0) {
+            ts.tv_sec = (time_t) wait;
+            ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+            nanosleep(&ts, NULL);
+        } else if (wait < -1.0) {
+            next = now;
+        }
+    }
+
+    //eof tells ffmpeg to finish the clip
+    if (r->fd != -1)
+        close(r->fd);
+    if (r->pid != -1)
+        waitpid(r->pid, NULL, 0);
+
+    pthread_mutex_lock(&rec->lock);
+    r->fd = -1;
+    r->pid = -1;
+    r->active = 0;
+    r->joinable = 1;
+    if (rec->current == r)
+        rec->current = NULL;
+    atomic_fetch_sub(&rec->active_count, 1);
+    pthread_mutex_unlock(&rec->lock);
+
+    return NULL;
+}
+
+//writes exactly len bytes from buf to fd
+//returns 1 on success, 0 on error
+int write_full(int fd,
+               unsigned char *buf,
+               size_t len) {
+    ssize_t w;
+    while (len > 0) {
+        w = write(fd, buf, len);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return 0;
+        buf += w;
+        len -= w;
+    }
+    return 1;
+}
+
+//bytes held by the recorder, the pre-roll plus one frame per clip slot
+long recorder_memory(struct Recorder *rec) {
+    long bytes, frame_bytes;
+    frame_bytes = rec->luma ? (long) rec->width * rec->height
+                            : (long) rec->latest->scanline_size * rec->height;
+    bytes = (long) rec->preroll_count * rec->frame_size;
+    bytes += frame_bytes;
+    //luma clips have no bgr scratch frame
+    bytes += (long) rec->max_recordings * (rec->frame_size + (rec->luma ? 0 : frame_bytes));
+    return bytes;
+}
+
+//converts a bottom-up bgr BMP to a top-down I420 frame (Y plane, then U and V at half size)
+//BT.601 integer conversion, chroma is taken from the average of each 2x2 block
+void bgr_to_i420(struct BMP *src,
+                 unsigned char *dst) {
+    unsigned char *yp, *up, *vp, *row, *row2;
+    int x, y, x2, r, g, b;
+    int width = src->image_header->width;
+    int height = src->image_header->height;
+    int cw = (width + 1) / 2;
+
+    yp = dst;
+    up = dst + (width * height);
+    vp = up + (cw * ((height + 1) / 2));
+
+    //luma
+    for (y = 0; y < height; y++) {
+        //bmp rows are stored bottom-up
+        row = src->pixel_data + ((height - y - 1) * src->scanline_size);
+        for (x = 0; x < width; x++) {
+            b = row[3*x];
+            g = row[3*x + 1];
+            r = row[3*x + 2];
+            *yp++ = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        }
+    }
+
+    //chroma
+    for (y = 0; y < height; y += 2) {
+        row = src->pixel_data + ((height - y - 1) * src->scanline_size);
+        //odd heights repeat the last row
+        row2 = y + 1 < height ? row - src->scanline_size : row;
+        for (x = 0; x < width; x += 2) {
+            x2 = x + 1 < width ? x + 1 : x;
+            b = (row[3*x] + row[3*x2] + row2[3*x] + row2[3*x2] + 2) >> 2;
+            g = (row[3*x + 1] + row[3*x2 + 1] + row2[3*x + 1] + row2[3*x2 + 1] + 2) >> 2;
+            r = (row[3*x + 2] + row[3*x2 + 2] + row2[3*x + 2] + row2[3*x2 + 2] + 2) >> 2;
+            *up++ = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            *vp++ = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+}
+
+//copies a top-down luma frame into the Y plane of an I420 frame, with neutral chroma
+void gray8_to_i420(struct Gray8 *src,
+                   unsigned char *dst) {
+    int luma_size = src->width * src->height;
+    int chroma_size = ((src->width + 1) / 2) * ((src->height + 1) / 2);
+
+    memcpy(dst, src->pixel_data, luma_size);
+    memset(dst + luma_size, 128, 2 * chroma_size);
+}
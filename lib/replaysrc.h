@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define REPLAY_BMP_DIR 0   //directory of .bmp files, played in name order
+#define REPLAY_RAW     1   //one file of back to back bgr24 frames
+
+// ----------
+// STRUCTURES
+// ----------
+
+//replays recorded frames from disk in place of a camera
+struct ReplaySource {
+    int type;                //REPLAY_* kind of recording
+    char **files;            //bmp file names, REPLAY_BMP_DIR only
+    int file_count;
+    FILE *raw;               //open raw file, REPLAY_RAW only
+    int mapped;              //the raw file is mapped instead of read, bmp files are always read
+    unsigned char *raw_map;  //mapping of the raw file, REPLAY_RAW when mapped only
+    size_t raw_map_size;
+    long frame_count;        //frames in the recording
+    long index;              //next frame to play
+    unsigned int width;
+    unsigned int height;
+    double fps;              //playback rate, 0 plays as fast as the reader takes frames
+    double next_time;        //monotonic time the next frame is due
+    int loop;                //start again from the first frame at the end
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct ReplaySource *open_replay_source(char *path,
+                                        char *resolution,
+                                        double fps,
+                                        int loop,
+                                        int mapped);
+
+int read_replay_frame(struct ReplaySource *rs,
+                      struct BMP *frame);
+
+void close_replay_source(struct ReplaySource *rs);
+
+int read_bmp_into(char *path,
+                  struct BMP *frame);
+
+int read_bmp_size(char *path,
+                  unsigned int *width,
+                  unsigned int *height);
+
+int replay_name_cmp(const void *a,
+                    const void *b);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//opens a recording for replay
+//path is either a directory of 24 bit BMPs, all the same size, or a raw file of
+//top-down bgr24 frames of the given resolution (as written by ffmpeg -f rawvideo)
+//mapped maps a raw file once instead of reading it, BMPs are read with stdio either
+//way, each frame is copied into a preallocated ring frame whichever is used, so
+//mapping every file would only add an mmap, munmap and page faults per frame
+//returns NULL if the recording can't be opened or is empty
+struct ReplaySource *open_replay_source(char *path,
+                                        char *resolution,
+                                        double fps,
+                                        int loop,
+                                        int mapped) {
+    struct ReplaySource *rs;
+    struct stat st;
+    struct dirent *ent;
+    DIR *dir;
+    char **files;
+    int len;
+
+    if (stat(path, &st) != 0)
+        return NULL;
+
+    rs = calloc(sizeof(struct ReplaySource), 1);
+    if (!rs)
+        return NULL;
+
+    rs->fps = fps;
+    rs->loop = loop;
+    rs->mapped = mapped;
+
+    if (S_ISDIR(st.st_mode)) {
+        rs->type = REPLAY_BMP_DIR;
+        dir = opendir(path);
+        if (!dir) {
+            free(rs);
+            return NULL;
+        }
+        //collect every .bmp in the directory
+        while ((ent = readdir(dir)) != NULL) {
+            len = strlen(ent->d_name);
+            if (len < 5 || strcasecmp(&ent->d_name[len - 4], ".bmp") != 0)
+                continue;
+            files = realloc(rs->files, (rs->file_count + 1) * sizeof(char *));
+            if (!files)
+                break;
+            rs->files = files;
+            rs->files[rs->file_count] = malloc(strlen(path) + len + 2);
+            if (!rs->files[rs->file_count])
+                break;
+            sprintf(rs->files[rs->file_count], "%s/%s", path, ent->d_name);
+            rs->file_count++;
+        }
+        closedir(dir);
+
+        if (rs->file_count == 0) {
+            close_replay_source(rs);
+            return NULL;
+        }
+        qsort(rs->files, rs->file_count, sizeof(char *), replay_name_cmp);
+
+        //frame size comes from the first image
+        if (!read_bmp_size(rs->files[0], &rs->width, &rs->height)) {
+            close_replay_source(rs);
+            return NULL;
+        }
+        rs->frame_count = rs->file_count;
+    } else {
+        rs->type = REPLAY_RAW;
+        if (!parse_resolution(resolution, &rs->width, &rs->height)) {
+            free(rs);
+            return NULL;
+        }
+        rs->raw = fopen(path, "rb");
+        if (!rs->raw) {
+            free(rs);
+            return NULL;
+        }
+        rs->frame_count = st.st_size / ((long) rs->width * rs->height * 3);
+        if (rs->frame_count == 0) {
+            close_replay_source(rs);
+            return NULL;
+        }
+        //the whole recording is mapped once, frames are copied straight out of it
+        if (mapped) {
+            rs->raw_map_size = st.st_size;
+            rs->raw_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(rs->raw), 0);
+            if (rs->raw_map == MAP_FAILED) {
+                rs->raw_map = NULL;
+                close_replay_source(rs);
+                return NULL;
+            }
+            madvise(rs->raw_map, st.st_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    rs->next_time = get_monotonic_time();
+    return rs;
+}
+
+//reads the next recorded frame into frame, waiting until it is due if fps is set
+//returns 1 on success, 0 on error and -1 once the recording has ended
+int read_replay_frame(struct ReplaySource *rs,
+                      struct BMP *frame) {
+    struct timespec ts;
+    unsigned char *raw;
+    double now, wait;
+    int y, row_size;
+
+    if (frame->image_header->width != rs->width ||
+        frame->image_header->height != rs->height)
+        return 0;
+
+    if (rs->index >= rs->frame_count) {
+        if (!rs->loop)
+            return -1;
+        rs->index = 0;
+    }
+
+    //hold the frame back until it is due
+    if (rs->fps > 0.0) {
+        now = get_monotonic_time();
+        wait = rs->next_time - now;
+        if (wait > 0.0) {
+            ts.tv_sec = (time_t) wait;
+            ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+            nanosleep(&ts, NULL);
+        } else if (wait < -1.0) {
+            //reader fell far behind, don't burst to catch up
+            rs->next_time = now;
+        }
+        rs->next_time += 1.0 / rs->fps;
+    }
+
+    if (rs->type == REPLAY_BMP_DIR) {
+        if (!read_bmp_into(rs->files[rs->index], frame))
+            return 0;
+    } else if (rs->raw_map) {
+        //raw frames are top-down, bmp rows are bottom-up
+        row_size = rs->width * 3;
+        raw = rs->raw_map + (size_t) rs->index * row_size * rs->height;
+        for (y = rs->height - 1; y >= 0; y--) {
+            memcpy(frame->pixel_data + (y * frame->scanline_size), raw, row_size);
+            raw += row_size;
+        }
+    } else {
+        if (rs->index == 0 && fseek(rs->raw, 0, SEEK_SET) != 0)
+            return 0;
+        //raw frames are top-down, bmp rows are bottom-up
+        row_size = rs->width * 3;
+        for (y = rs->height - 1; y >= 0; y--) {
+            if (fread(frame->pixel_data + (y * frame->scanline_size), row_size, 1, rs->raw) != 1)
+                return 0;
+        }
+    }
+
+    rs->index++;
+    return 1;
+}
+
+//closes the recording and frees the source
+void close_replay_source(struct ReplaySource *rs) {
+    int i;
+    if (!rs)
+        return;
+    for (i = 0; i < rs->file_count; i++) {
+        free(rs->files[i]);
+    }
+    free(rs->files);
+    if (rs->raw_map)
+        munmap(rs->raw_map, rs->raw_map_size);
+    if (rs->raw)
+        fclose(rs->raw);
+    free(rs);
+}
+
+//reads the pixel data of the BMP at path straight into frame, without allocating
+//the file must be a 24 bit BMP the same size as frame, it may be top-down
+//returns 1 on success
+int read_bmp_into(char *path,
+                  struct BMP *frame) {
+    struct BMPFileHeader fh;
+    struct BMPImageHeader ih;
+    FILE *file;
+    int32_t height;
+    int ok, y;
+
+    file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    //a negative height marks a top-down file
+    ok = fread(&fh, 14, 1, file) == 1
+        && fread(&ih, 40, 1, file) == 1
+        && ih.bit_count == 24
+        && ih.width == frame->image_header->width
+        && fseek(file, fh.off_bits, SEEK_SET) == 0;
+    height = (int32_t) ih.height;
+    if (ok && height == (int32_t) frame->image_header->height) {
+        ok = fread(frame->pixel_data, frame->scanline_size * height, 1, file) == 1;
+    } else if (ok && height < 0 && -(int64_t) height == frame->image_header->height) {
+        //bmp rows are bottom-up, so the file's first row is the frame's last
+        for (y = frame->image_header->height - 1; ok && y >= 0; y--) {
+            ok = fread(frame->pixel_data + (y * frame->scanline_size), frame->scanline_size, 1, file) == 1;
+        }
+    } else {
+        ok = 0;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+//reads the dimensions of the 24 bit BMP at path, a negative height marks a top-down
+//file and its absolute value is the height
+//returns 1 on success
+int read_bmp_size(char *path,
+                  unsigned int *width,
+                  unsigned int *height) {
+    struct BMPFileHeader fh;
+    struct BMPImageHeader ih;
+    FILE *file;
+    int64_t h;
+    int ok;
+
+    file = fopen(path, "rb");
+    if (!file)
+        return 0;
+
+    ok = fread(&fh, 14, 1, file) == 1
+        && fread(&ih, 40, 1, file) == 1
+        && ih.bit_count == 24
+        && (int32_t) ih.width > 0
+        && (int32_t) ih.height != 0;
+
+    fclose(file);
+    if (ok) {
+        h = (int32_t) ih.height;
+        *width = ih.width;
+        *height = h < 0 ? -h : h;
+    }
+    return ok;
+}
+
+//orders file names for qsort
+int replay_name_cmp(const void *a,
+                    const void *b) {
+    return strcmp(*(char **) a, *(char **) b);
+}
@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define SHM_NAME "/motdec"        //shared memory object the live view is published in
+#define SHM_MAGIC 0x4344544d      //"MTDC" in memory
+#define SHM_VERSION 1
+#define SHM_READ_RETRIES 100      //attempts at a consistent snapshot before giving up
+
+// ----------
+// STRUCTURES
+// ----------
+
+//detector state published with each frame
+struct ShmStats {
+    unsigned long frame_seq;        //capture sequence number of the frame
+    double capture_time;            //monotonic time it was captured
+    long pixel_change_count;        //foreground pixels in its segmap
+    double change_percent;          //0.0 - 1.0
+    int motion;                     //1 if the frame was a motion event
+    double fps;                     //frames processed per second since the detector started
+    unsigned long frames_captured;
+    unsigned long frames_dropped;
+    unsigned long events;           //motion events since start
+};
+
+//one of the two buffers, written while readers use the other
+//seq is odd while the slot is being written, readers retry if it changed under them
+struct ShmSlot {
+    _Atomic unsigned long seq;
+    struct ShmStats stats;
+    //followed by frame_size bytes of frame, a complete 24 bit BMP file,
+    //then segmap_size bytes of segmap, 0 or 255 per pixel, rows top-down
+};
+
+//start of the shared memory object
+struct ShmHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int width;
+    unsigned int height;
+    unsigned int frame_size;        //bytes of BMP file in each slot
+    unsigned int segmap_size;       //bytes of segmap in each slot
+    unsigned int slot_size;         //distance between slots
+    unsigned int slot_offset;       //offset of the first slot from the header
+    _Atomic int front;              //slot holding the newest complete snapshot, -1 before the first
+    _Atomic unsigned long published; //snapshots published
+    pid_t pid;                      //publishing process
+};
+
+//motdec's end, the only writer
+struct ShmPublisher {
+    char name[64];
+    size_t size;
+    struct ShmHeader *header;
+    struct ShmSlot *back;           //slot being written between begin and end
+    unsigned char bmp_header[54];   //file and image header of every published frame
+};
+
+//a reader's mapping of the object
+struct ShmReader {
+    size_t size;
+    struct ShmHeader *header;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct ShmPublisher *open_shm_publisher(char *name,
+                                        unsigned int width,
+                                        unsigned int height);
+
+void close_shm_publisher(struct ShmPublisher *pub);
+
+void shm_begin(struct ShmPublisher *pub);
+
+void shm_put_frame(struct ShmPublisher *pub,
+                   struct BMP *frame);
+
+void shm_put_frame_gray8(struct ShmPublisher *pub,
+                         struct Gray8 *frame);
+
+void shm_put_segmap(struct ShmPublisher *pub,
+                    struct BMP *segmap);
+
+void shm_put_segmap_gray8(struct ShmPublisher *pub,
+                          struct Gray8 *segmap);
+
+void shm_put_segmap_mask1(struct ShmPublisher *pub,
+                          struct Mask1 *segmap);
+
+void shm_end(struct ShmPublisher *pub,
+             struct ShmStats *stats);
+
+struct ShmReader *open_shm_reader(char *name);
+
+void close_shm_reader(struct ShmReader *rd);
+
+int read_shm_snapshot(struct ShmReader *rd,
+                      unsigned char *frame,
+                      unsigned char *segmap,
+                      struct ShmStats *stats);
+
+struct ShmSlot *shm_slot(struct ShmHeader *header,
+                         int index);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates the shared memory object name for frames of width x height
+//any object left behind by a previous run is replaced
+//returns NULL on error
+struct ShmPublisher *open_shm_publisher(char *name,
+                                        unsigned int width,
+                                        unsigned int height) {
+    struct ShmPublisher *pub;
+    struct BMP *tmpl;
+    struct ShmHeader *h;
+    unsigned int frame_size, segmap_size, slot_size, slot_offset;
+    int fd;
+
+    pub = calloc(sizeof(struct ShmPublisher), 1);
+    if (!pub)
+        return NULL;
+    strncpy(pub->name, name, sizeof(pub->name) - 1);
+
+    //headers come from an empty BMP so published frames match saved ones
+    tmpl = init_BMP(width, height);
+    if (!tmpl) {
+        free(pub);
+        return NULL;
+    }
+    memcpy(pub->bmp_header, tmpl->file_header, 14);
+    memcpy(pub->bmp_header + 14, tmpl->image_header, 40);
+    frame_size = tmpl->file_header->file_size;
+    free_BMP(tmpl);
+
+    //slots are cache line aligned so the writer and readers don't share lines
+    segmap_size = width * height;
+    slot_offset = (sizeof(struct ShmHeader) + 63) & ~63u;
+    slot_size = (sizeof(struct ShmSlot) + frame_size + segmap_size + 63) & ~63u;
+    pub->size = slot_offset + 2 * (size_t) slot_size;
+
+    shm_unlink(pub->name);
+    fd = shm_open(pub->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        free(pub);
+        return NULL;
+    }
+    if (ftruncate(fd, pub->size) != 0) {
+        close(fd);
+        shm_unlink(pub->name);
+        free(pub);
+        return NULL;
+    }
+    h = mmap(NULL, pub->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        shm_unlink(pub->name);
+        free(pub);
+        return NULL;
+    }
+
+    h->version = SHM_VERSION;
+    h->width = width;
+    h->height = height;
+    h->frame_size = frame_size;
+    h->segmap_size = segmap_size;
+    h->slot_size = slot_size;
+    h->slot_offset = slot_offset;
+    h->pid = getpid();
+    atomic_init(&h->front, -1);
+    atomic_init(&h->published, 0);
+    atomic_init(&shm_slot(h, 0)->seq, 0);
+    atomic_init(&shm_slot(h, 1)->seq, 0);
+    //readers check the magic last, the layout is complete once it is set
+    atomic_thread_fence(memory_order_release);
+    h->magic = SHM_MAGIC;
+
+    pub->header = h;
+    return pub;
+}
+
+//unmaps and removes the shared memory object
+void close_shm_publisher(struct ShmPublisher *pub) {
+    if (!pub)
+        return;
+    munmap(pub->header, pub->size);
+    shm_unlink(pub->name);
+    free(pub);
+}
+
+//starts writing a snapshot into the slot readers aren't using
+void shm_begin(struct ShmPublisher *pub) {
+    int front;
+
+    front = atomic_load_explicit(&pub->header->front, memory_order_relaxed);
+    pub->back = shm_slot(pub->header, front == 0 ? 1 : 0);
+
+    //odd while being written
+    atomic_fetch_add_explicit(&pub->back->seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+//copies a bgr frame into the snapshot being written
+void shm_put_frame(struct ShmPublisher *pub,
+                   struct BMP *frame) {
+    unsigned char *dst = (unsigned char *) (pub->back + 1);
+
+    memcpy(dst, pub->bmp_header, 54);
+    memcpy(dst + 54, frame->pixel_data, pub->header->frame_size - 54);
+}
+
+//copies a luma frame into the snapshot being written, as a greyscale BMP
+void shm_put_frame_gray8(struct ShmPublisher *pub,
+                         struct Gray8 *frame) {
+    unsigned char *dst = (unsigned char *) (pub->back + 1);
+    unsigned char *in, *out;
+    int x, y, scanline;
+
+    memcpy(dst, pub->bmp_header, 54);
+    scanline = get_scanline_size(frame->width);
+    for (y = 0; y < frame->height; y++) {
+        in = frame->pixel_data + (y * frame->width);
+        //bmp rows are stored bottom-up
+        out = dst + 54 + ((frame->height - y - 1) * scanline);
+        for (x = 0; x < frame->width; x++) {
+            out[0] = out[1] = out[2] = in[x];
+            out += 3;
+        }
+    }
+}
+
+//copies a bgr segmap into the snapshot being written, one byte per pixel
+void shm_put_segmap(struct ShmPublisher *pub,
+                    struct BMP *segmap) {
+    unsigned char *out = (unsigned char *) (pub->back + 1) + pub->header->frame_size;
+    unsigned char *in;
+    int x, y;
+    int width = pub->header->width;
+    int height = pub->header->height;
+
+    for (y = 0; y < height; y++) {
+        in = segmap->pixel_data + ((height - y - 1) * segmap->scanline_size);
+        for (x = 0; x < width; x++) {
+            *out++ = in[3*x];
+        }
+    }
+}
+
+//copies a luma segmap into the snapshot being written
+void shm_put_segmap_gray8(struct ShmPublisher *pub,
+                          struct Gray8 *segmap) {
+    memcpy((unsigned char *) (pub->back + 1) + pub->header->frame_size,
+           segmap->pixel_data, pub->header->segmap_size);
+}
+
+//copies a one bit segmap into the snapshot being written, unpacked to a byte per pixel
+//so readers see the same layout whichever segmap the detector keeps
+void shm_put_segmap_mask1(struct ShmPublisher *pub,
+                          struct Mask1 *segmap) {
+    struct Gray8 out;
+
+    out.width = pub->header->width;
+    out.height = pub->header->height;
+    out.pixel_data = (unsigned char *) (pub->back + 1) + pub->header->frame_size;
+    mask1_to_gray8(segmap, &out);
+}
+
+//finishes the snapshot and makes it the one readers get
+void shm_end(struct ShmPublisher *pub,
+             struct ShmStats *stats) {
+    struct ShmHeader *h = pub->header;
+
+    pub->back->stats = *stats;
+
+    //even again, then flip readers over to it
+    atomic_thread_fence(memory_order_release);
+    atomic_fetch_add_explicit(&pub->back->seq, 1, memory_order_relaxed);
+    atomic_store_explicit(&h->front, pub->back == shm_slot(h, 0) ? 0 : 1, memory_order_release);
+    atomic_fetch_add_explicit(&h->published, 1, memory_order_release);
+    pub->back = NULL;
+}
+
+//maps the object name published by a running motdec
+//returns NULL if it doesn't exist or isn't one of ours
+struct ShmReader *open_shm_reader(char *name) {
+    struct ShmReader *rd;
+    struct stat st;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct ShmHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    rd = calloc(sizeof(struct ShmReader), 1);
+    if (!rd) {
+        close(fd);
+        return NULL;
+    }
+    rd->size = st.st_size;
+    rd->header = mmap(NULL, rd->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (rd->header == MAP_FAILED) {
+        free(rd);
+        return NULL;
+    }
+
+    if (rd->header->magic != SHM_MAGIC || rd->header->version != SHM_VERSION
+        || rd->header->slot_offset + 2 * (size_t) rd->header->slot_size > rd->size) {
+        close_shm_reader(rd);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    return rd;
+}
+
+//unmaps the object
+void close_shm_reader(struct ShmReader *rd) {
+    if (!rd)
+        return;
+    munmap(rd->header, rd->size);
+    free(rd);
+}
+
+//copies the newest snapshot out, frame (frame_size bytes), segmap (segmap_size bytes)
+//and stats may each be NULL if not wanted
+//returns 1 on success, 0 if no consistent snapshot could be taken and -1 if nothing
+//has been published yet
+int read_shm_snapshot(struct ShmReader *rd,
+                      unsigned char *frame,
+                      unsigned char *segmap,
+                      struct ShmStats *stats) {
+    struct ShmHeader *h = rd->header;
+    struct ShmSlot *slot;
+    unsigned char *data;
+    unsigned long before, after;
+    int i, front;
+
+    for (i = 0; i < SHM_READ_RETRIES; i++) {
+        front = atomic_load_explicit(&h->front, memory_order_acquire);
+        if (front < 0)
+            return -1;
+        slot = shm_slot(h, front);
+        data = (unsigned char *) (slot + 1);
+
+        before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        if (frame)
+            memcpy(frame, data, h->frame_size);
+        if (segmap)
+            memcpy(segmap, data + h->frame_size, h->segmap_size);
+        if (stats)
+            *stats = slot->stats;
+
+        //the writer lapped us if the slot changed while we copied
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+        if (before == after)
+            return 1;
+    }
+    return 0;
+}
+
+//returns slot index 0 or 1 of the object
+struct ShmSlot *shm_slot(struct ShmHeader *header,
+                         int index) {
+    return (struct ShmSlot *) ((unsigned char *) header + header->slot_offset
+                               + (size_t) index * header->slot_size);
+}
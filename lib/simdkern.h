@@ -0,0 +1,746 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+#define SIMD_CLASSES 192    //longest block a kernel walks, in bytes
+
+// ----------
+// STRUCTURES
+// ----------
+
+//byte and pixel kernels shared by the serial and threaded image functions
+//one set is picked the first time they are asked for, the widest the cpu runs, and
+//every set gives exactly the same output as the scalar one
+//pixels are bgr triplets, as in BMP rows, and a span never runs past the pointer and
+//length it is given
+struct PixelKernels {
+    char *name;
+    //out[i] = |a[i] - b[i]|
+    void (*difference)(unsigned char *a,
+                       unsigned char *b,
+                       unsigned char *out,
+                       size_t n);
+    //out[i] = 255 if in[i] > threshold else 0
+    void (*threshold)(unsigned char *in,
+                      unsigned char *out,
+                      size_t n,
+                      unsigned char threshold);
+    //sets every channel of each pixel to the mean of the three, rounded down
+    void (*greyscale)(unsigned char *bgr,
+                      size_t pixels);
+    //pixels equal to b, g, r
+    size_t (*count)(unsigned char *bgr,
+                    size_t pixels,
+                    unsigned char b,
+                    unsigned char g,
+                    unsigned char r);
+    //difference, greyscale and threshold in one pass, every channel of out[i] is 255
+    //if the mean of |a - b| over pixel i's channels is above threshold, else 0
+    //returns the pixels set, out may be a or b
+    size_t (*segment_difference)(unsigned char *a,
+                                 unsigned char *b,
+                                 unsigned char *out,
+                                 size_t pixels,
+                                 unsigned char threshold);
+    //set bits in the n bytes at bits
+    size_t (*count_bits)(unsigned char *bits,
+                         size_t n);
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct PixelKernels *get_pixel_kernels();
+
+int select_pixel_kernels(char *name);
+
+int pixel_kernels_supported(char *name);
+
+void init_pixel_kernels();
+
+void difference_scalar(unsigned char *a,
+                       unsigned char *b,
+                       unsigned char *out,
+                       size_t n);
+
+void threshold_scalar(unsigned char *in,
+                      unsigned char *out,
+                      size_t n,
+                      unsigned char threshold);
+
+void greyscale_scalar(unsigned char *bgr,
+                      size_t pixels);
+
+size_t count_scalar(unsigned char *bgr,
+                    size_t pixels,
+                    unsigned char b,
+                    unsigned char g,
+                    unsigned char r);
+
+size_t segment_difference_scalar(unsigned char *a,
+                                 unsigned char *b,
+                                 unsigned char *out,
+                                 size_t pixels,
+                                 unsigned char threshold);
+
+size_t count_bits_scalar(unsigned char *bits,
+                         size_t n);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//scalar kernels, the reference the others must match and the fallback without simd
+
+void difference_scalar(unsigned char *a,
+                       unsigned char *b,
+                       unsigned char *out,
+                       size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        out[i] = abs(a[i] - b[i]);
+    }
+}
+
+void threshold_scalar(unsigned char *in,
+                      unsigned char *out,
+                      size_t n,
+                      unsigned char threshold) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        out[i] = in[i] > threshold ? 255 : 0;
+    }
+}
+
+void greyscale_scalar(unsigned char *bgr,
+                      size_t pixels) {
+    unsigned char *end = bgr + 3 * pixels;
+    for (; bgr < end; bgr += 3) {
+        bgr[0] = bgr[1] = bgr[2] = (bgr[0] + bgr[1] + bgr[2]) / 3;
+    }
+}
+
+size_t count_scalar(unsigned char *bgr,
+                    size_t pixels,
+                    unsigned char b,
+                    unsigned char g,
+                    unsigned char r) {
+    unsigned char *end = bgr + 3 * pixels;
+    size_t count = 0;
+    for (; bgr < end; bgr += 3) {
+        count += bgr[0] == b && bgr[1] == g && bgr[2] == r;
+    }
+    return count;
+}
+
+size_t segment_difference_scalar(unsigned char *a,
+                                 unsigned char *b,
+                                 unsigned char *out,
+                                 size_t pixels,
+                                 unsigned char threshold) {
+    unsigned char *end = a + 3 * pixels;
+    unsigned char value;
+    size_t count = 0;
+    for (; a < end; a += 3, b += 3, out += 3) {
+        value = (abs(a[0] - b[0]) + abs(a[1] - b[1]) + abs(a[2] - b[2])) / 3 > threshold ? 255 : 0;
+        out[0] = out[1] = out[2] = value;
+        count += value & 1;
+    }
+    return count;
+}
+
+//a word at a time, without the popcnt instruction gcc counts them with a table
+size_t count_bits_scalar(unsigned char *bits,
+                         size_t n) {
+    unsigned long long w;
+    size_t i, count;
+    count = 0;
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, bits + i, 8);
+        count += __builtin_popcountll(w);
+    }
+    for (; i < n; i++) {
+        count += __builtin_popcount(bits[i]);
+    }
+    return count;
+}
+
+#ifdef SIMD_X86
+
+//the channel each byte of a block holds, 0 blue, 1 green, 2 red, for blocks that start
+//on a pixel, loaded as masks so a vector knows which of its lanes start a pixel
+//blocks are 3 vectors long, so the pattern is the same in every one
+static unsigned char simd_class8[SIMD_CLASSES];
+
+//greyscale divides the sum of a pixel's channels, at most 765, by 3 as
+//(sum * 43691) >> 17, which is exact for every sum below 98304
+#define SIMD_THIRD 43691
+
+//sse2, 16 bytes at a time, blocks of 48 bytes
+
+__attribute__((target("sse2")))
+void difference_sse2(unsigned char *a,
+                     unsigned char *b,
+                     unsigned char *out,
+                     size_t n) {
+    __m128i va, vb;
+    size_t i;
+    for (i = 0; i + 16 <= n; i += 16) {
+        va = _mm_loadu_si128((__m128i *) (a + i));
+        vb = _mm_loadu_si128((__m128i *) (b + i));
+        //one of the saturated differences is 0, the other the distance
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+    }
+    difference_scalar(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void threshold_sse2(unsigned char *in,
+                    unsigned char *out,
+                    size_t n,
+                    unsigned char threshold) {
+    __m128i bias, t, v;
+    size_t i;
+    //sse2 only compares signed bytes, flipping the top bit keeps the unsigned order
+    bias = _mm_set1_epi8((char) 0x80);
+    t = _mm_set1_epi8((char) (threshold ^ 0x80));
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = _mm_xor_si128(_mm_loadu_si128((__m128i *) (in + i)), bias);
+        _mm_storeu_si128((__m128i *) (out + i), _mm_cmpgt_epi8(v, t));
+    }
+    threshold_scalar(in + i, out + i, n - i, threshold);
+}
+
+//means of each byte and the 2 after it, l0, l1 and l2 being the same bytes at offsets
+//0, 1 and 2, lanes that start a pixel hold its grey value, the rest are masked off
+__attribute__((target("sse2")))
+static inline __attribute__((always_inline)) __m128i mean3_sse2(__m128i l0,
+                                                                __m128i l1,
+                                                                __m128i l2) {
+    __m128i zero, third, lo, hi;
+    zero = _mm_setzero_si128();
+    third = _mm_set1_epi16((short) SIMD_THIRD);
+    lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(l0, zero), _mm_unpacklo_epi8(l1, zero)),
+                       _mm_unpacklo_epi8(l2, zero));
+    hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(l0, zero), _mm_unpackhi_epi8(l1, zero)),
+                       _mm_unpackhi_epi8(l2, zero));
+    lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, third), 1);
+    hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, third), 1);
+    return _mm_packus_epi16(lo, hi);
+}
+
+//|a - b| for the 16 bytes at a and b
+__attribute__((target("sse2")))
+static inline __attribute__((always_inline)) __m128i absdiff_sse2(unsigned char *a,
+                                                                  unsigned char *b) {
+    __m128i va, vb;
+    va = _mm_loadu_si128((__m128i *) a);
+    vb = _mm_loadu_si128((__m128i *) b);
+    //one of the saturated differences is 0, the other the distance
+    return _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+}
+
+//the bytes of cur moved up n lanes, the lowest n filled from the top of prev
+//so the value of a pixel starting near the end of one vector reaches the next
+#define SIMD_CARRY_SSE2(cur, prev, n) \
+    _mm_or_si128(_mm_slli_si128(cur, n), _mm_srli_si128(prev, 16 - (n)))
+
+__attribute__((target("sse2")))
+void greyscale_sse2(unsigned char *bgr,
+                    size_t pixels) {
+    __m128i zero, g, prev;
+    unsigned char *q;
+    size_t i, bytes;
+    int k;
+    zero = _mm_setzero_si128();
+    bytes = 3 * pixels;
+    //the loads reach 2 bytes past each chunk, which the next chunk hasn't stored yet
+    for (i = 0; i + 48 + 2 <= bytes; i += 48) {
+        //blocks start and end on a pixel, nothing carries from one to the next
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            q = bgr + i + 16 * k;
+            g = _mm_and_si128(mean3_sse2(_mm_loadu_si128((__m128i *) q),
+                                         _mm_loadu_si128((__m128i *) (q + 1)),
+                                         _mm_loadu_si128((__m128i *) (q + 2))),
+                              _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (simd_class8 + 16 * k)), zero));
+            //each grey value is copied into the 2 bytes after it, those of pixels
+            //starting in the last 2 lanes of the chunk before carry into this one
+            _mm_storeu_si128((__m128i *) q,
+                             _mm_or_si128(g, _mm_or_si128(SIMD_CARRY_SSE2(g, prev, 1), SIMD_CARRY_SSE2(g, prev, 2))));
+            prev = g;
+        }
+    }
+    greyscale_scalar(bgr + i, (bytes - i) / 3);
+}
+
+__attribute__((target("sse2")))
+size_t count_sse2(unsigned char *bgr,
+                  size_t pixels,
+                  unsigned char b,
+                  unsigned char g,
+                  unsigned char r) {
+    __m128i vb, vg, vr, eq, cls, zero;
+    size_t i, bytes, count;
+    int k;
+    vb = _mm_set1_epi8((char) b);
+    vg = _mm_set1_epi8((char) g);
+    vr = _mm_set1_epi8((char) r);
+    zero = _mm_setzero_si128();
+    bytes = 3 * pixels;
+    count = 0;
+    //a lane that starts a pixel matches if it, and the 2 bytes after it, do
+    for (i = 0; i + 48 + 2 <= bytes; i += 48) {
+        for (k = 0; k < 3; k++) {
+            eq = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (bgr + i + 16 * k)), vb),
+                 _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (bgr + i + 16 * k + 1)), vg),
+                               _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (bgr + i + 16 * k + 2)), vr)));
+            cls = _mm_loadu_si128((__m128i *) (simd_class8 + 16 * k));
+            eq = _mm_and_si128(eq, _mm_cmpeq_epi8(cls, zero));
+            count += __builtin_popcount(_mm_movemask_epi8(eq));
+        }
+    }
+    return count + count_scalar(bgr + i, (bytes - i) / 3, b, g, r);
+}
+
+__attribute__((target("sse2")))
+size_t segment_difference_sse2(unsigned char *a,
+                               unsigned char *b,
+                               unsigned char *out,
+                               size_t pixels,
+                               unsigned char threshold) {
+    __m128i zero, bias, t, f, prev;
+    size_t i, j, bytes, count;
+    int k;
+    zero = _mm_setzero_si128();
+    bias = _mm_set1_epi8((char) 0x80);
+    t = _mm_set1_epi8((char) (threshold ^ 0x80));
+    bytes = 3 * pixels;
+    count = 0;
+    //as greyscale_sse2, with the differences taken as the bytes are loaded
+    for (i = 0; i + 48 + 2 <= bytes; i += 48) {
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            j = i + 16 * k;
+            f = _mm_cmpgt_epi8(_mm_xor_si128(mean3_sse2(absdiff_sse2(a + j, b + j),
+                                                        absdiff_sse2(a + j + 1, b + j + 1),
+                                                        absdiff_sse2(a + j + 2, b + j + 2)), bias), t);
+            f = _mm_and_si128(f, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *) (simd_class8 + 16 * k)), zero));
+            count += __builtin_popcount(_mm_movemask_epi8(f));
+            _mm_storeu_si128((__m128i *) (out + j),
+                             _mm_or_si128(f, _mm_or_si128(SIMD_CARRY_SSE2(f, prev, 1), SIMD_CARRY_SSE2(f, prev, 2))));
+            prev = f;
+        }
+    }
+    return count + segment_difference_scalar(a + i, b + i, out + i, (bytes - i) / 3, threshold);
+}
+
+//count_bits_scalar with the popcnt instruction, which every cpu with avx2 has
+__attribute__((target("popcnt")))
+size_t count_bits_popcnt(unsigned char *bits,
+                         size_t n) {
+    unsigned long long w;
+    size_t i, count;
+    count = 0;
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, bits + i, 8);
+        count += __builtin_popcountll(w);
+    }
+    for (; i < n; i++) {
+        count += __builtin_popcount(bits[i]);
+    }
+    return count;
+}
+
+//avx2, the same as sse2 over 32 bytes, blocks of 96 bytes
+
+__attribute__((target("avx2")))
+void difference_avx2(unsigned char *a,
+                     unsigned char *b,
+                     unsigned char *out,
+                     size_t n) {
+    __m256i va, vb;
+    size_t i;
+    for (i = 0; i + 32 <= n; i += 32) {
+        va = _mm256_loadu_si256((__m256i *) (a + i));
+        vb = _mm256_loadu_si256((__m256i *) (b + i));
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va)));
+    }
+    //gcc leaves out the vzeroupper before a tail call, and a thread going on to sse
+    //code with the upper halves dirty runs it several times slower
+    _mm256_zeroupper();
+    difference_sse2(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void threshold_avx2(unsigned char *in,
+                    unsigned char *out,
+                    size_t n,
+                    unsigned char threshold) {
+    __m256i bias, t, v;
+    size_t i;
+    bias = _mm256_set1_epi8((char) 0x80);
+    t = _mm256_set1_epi8((char) (threshold ^ 0x80));
+    for (i = 0; i + 32 <= n; i += 32) {
+        v = _mm256_xor_si256(_mm256_loadu_si256((__m256i *) (in + i)), bias);
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_cmpgt_epi8(v, t));
+    }
+    _mm256_zeroupper();
+    threshold_sse2(in + i, out + i, n - i, threshold);
+}
+
+//mean3_sse2 over 32 bytes
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) __m256i mean3_avx2(__m256i l0,
+                                                                __m256i l1,
+                                                                __m256i l2) {
+    __m256i third, lo, hi;
+    third = _mm256_set1_epi16((short) SIMD_THIRD);
+#define SIMD_WIDEN(v, half) _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, half))
+    lo = _mm256_add_epi16(_mm256_add_epi16(SIMD_WIDEN(l0, 0), SIMD_WIDEN(l1, 0)), SIMD_WIDEN(l2, 0));
+    hi = _mm256_add_epi16(_mm256_add_epi16(SIMD_WIDEN(l0, 1), SIMD_WIDEN(l1, 1)), SIMD_WIDEN(l2, 1));
+#undef SIMD_WIDEN
+    lo = _mm256_srli_epi16(_mm256_mulhi_epu16(lo, third), 1);
+    hi = _mm256_srli_epi16(_mm256_mulhi_epu16(hi, third), 1);
+    //packing works within 128 bit lanes, the permute puts the halves back in order
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+//absdiff_sse2 over 32 bytes
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) __m256i absdiff_avx2(unsigned char *a,
+                                                                  unsigned char *b) {
+    __m256i va, vb;
+    va = _mm256_loadu_si256((__m256i *) a);
+    vb = _mm256_loadu_si256((__m256i *) b);
+    return _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+}
+
+//the bytes of cur moved up n lanes, the lowest n filled from the top of prev
+#define SIMD_CARRY_AVX2(cur, prev, n) \
+    _mm256_alignr_epi8(cur, _mm256_permute2x128_si256(prev, cur, 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+void greyscale_avx2(unsigned char *bgr,
+                    size_t pixels) {
+    __m256i zero, g, prev;
+    unsigned char *q;
+    size_t i, bytes;
+    int k;
+    zero = _mm256_setzero_si256();
+    bytes = 3 * pixels;
+    for (i = 0; i + 96 + 2 <= bytes; i += 96) {
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            q = bgr + i + 32 * k;
+            g = _mm256_and_si256(mean3_avx2(_mm256_loadu_si256((__m256i *) q),
+                                            _mm256_loadu_si256((__m256i *) (q + 1)),
+                                            _mm256_loadu_si256((__m256i *) (q + 2))),
+                                 _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *) (simd_class8 + 32 * k)), zero));
+            _mm256_storeu_si256((__m256i *) q,
+                                _mm256_or_si256(g, _mm256_or_si256(SIMD_CARRY_AVX2(g, prev, 1),
+                                                                   SIMD_CARRY_AVX2(g, prev, 2))));
+            prev = g;
+        }
+    }
+    _mm256_zeroupper();
+    greyscale_sse2(bgr + i, (bytes - i) / 3);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t count_avx2(unsigned char *bgr,
+                  size_t pixels,
+                  unsigned char b,
+                  unsigned char g,
+                  unsigned char r) {
+    __m256i vb, vg, vr, eq, cls, zero;
+    size_t i, bytes, count;
+    int k;
+    vb = _mm256_set1_epi8((char) b);
+    vg = _mm256_set1_epi8((char) g);
+    vr = _mm256_set1_epi8((char) r);
+    zero = _mm256_setzero_si256();
+    bytes = 3 * pixels;
+    count = 0;
+    for (i = 0; i + 96 + 2 <= bytes; i += 96) {
+        for (k = 0; k < 3; k++) {
+            eq = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *) (bgr + i + 32 * k)), vb),
+                 _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *) (bgr + i + 32 * k + 1)), vg),
+                                  _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *) (bgr + i + 32 * k + 2)), vr)));
+            cls = _mm256_loadu_si256((__m256i *) (simd_class8 + 32 * k));
+            eq = _mm256_and_si256(eq, _mm256_cmpeq_epi8(cls, zero));
+            count += __builtin_popcount((unsigned int) _mm256_movemask_epi8(eq));
+        }
+    }
+    return count + count_sse2(bgr + i, (bytes - i) / 3, b, g, r);
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t segment_difference_avx2(unsigned char *a,
+                               unsigned char *b,
+                               unsigned char *out,
+                               size_t pixels,
+                               unsigned char threshold) {
+    __m256i zero, bias, t, f, prev;
+    size_t i, j, bytes, count;
+    int k;
+    zero = _mm256_setzero_si256();
+    bias = _mm256_set1_epi8((char) 0x80);
+    t = _mm256_set1_epi8((char) (threshold ^ 0x80));
+    bytes = 3 * pixels;
+    count = 0;
+    for (i = 0; i + 96 + 2 <= bytes; i += 96) {
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            j = i + 32 * k;
+            f = _mm256_cmpgt_epi8(_mm256_xor_si256(mean3_avx2(absdiff_avx2(a + j, b + j),
+                                                              absdiff_avx2(a + j + 1, b + j + 1),
+                                                              absdiff_avx2(a + j + 2, b + j + 2)), bias), t);
+            f = _mm256_and_si256(f, _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *) (simd_class8 + 32 * k)), zero));
+            count += __builtin_popcount((unsigned int) _mm256_movemask_epi8(f));
+            _mm256_storeu_si256((__m256i *) (out + j),
+                                _mm256_or_si256(f, _mm256_or_si256(SIMD_CARRY_AVX2(f, prev, 1),
+                                                                   SIMD_CARRY_AVX2(f, prev, 2))));
+            prev = f;
+        }
+    }
+    return count + segment_difference_sse2(a + i, b + i, out + i, (bytes - i) / 3, threshold);
+}
+
+//avx-512, needs the byte and word instructions of avx512bw, blocks of 192 bytes
+
+__attribute__((target("avx512f,avx512bw")))
+void difference_avx512(unsigned char *a,
+                       unsigned char *b,
+                       unsigned char *out,
+                       size_t n) {
+    __m512i va, vb;
+    size_t i;
+    for (i = 0; i + 64 <= n; i += 64) {
+        va = _mm512_loadu_si512(a + i);
+        vb = _mm512_loadu_si512(b + i);
+        _mm512_storeu_si512(out + i, _mm512_or_si512(_mm512_subs_epu8(va, vb), _mm512_subs_epu8(vb, va)));
+    }
+    difference_avx2(a + i, b + i, out + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void threshold_avx512(unsigned char *in,
+                      unsigned char *out,
+                      size_t n,
+                      unsigned char threshold) {
+    __m512i t;
+    size_t i;
+    t = _mm512_set1_epi8((char) threshold);
+    for (i = 0; i + 64 <= n; i += 64) {
+        _mm512_storeu_si512(out + i, _mm512_movm_epi8(_mm512_cmpgt_epu8_mask(_mm512_loadu_si512(in + i), t)));
+    }
+    threshold_avx2(in + i, out + i, n - i, threshold);
+}
+
+//mean3_sse2 over 64 bytes
+__attribute__((target("avx512f,avx512bw")))
+static inline __attribute__((always_inline)) __m512i mean3_avx512(__m512i l0,
+                                                                  __m512i l1,
+                                                                  __m512i l2) {
+    __m512i third, lo, hi;
+    third = _mm512_set1_epi16((short) SIMD_THIRD);
+#define SIMD_WIDEN(v, half) _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, half))
+    lo = _mm512_add_epi16(_mm512_add_epi16(SIMD_WIDEN(l0, 0), SIMD_WIDEN(l1, 0)), SIMD_WIDEN(l2, 0));
+    hi = _mm512_add_epi16(_mm512_add_epi16(SIMD_WIDEN(l0, 1), SIMD_WIDEN(l1, 1)), SIMD_WIDEN(l2, 1));
+#undef SIMD_WIDEN
+    lo = _mm512_srli_epi16(_mm512_mulhi_epu16(lo, third), 1);
+    hi = _mm512_srli_epi16(_mm512_mulhi_epu16(hi, third), 1);
+    return _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi16_epi8(lo)), _mm512_cvtepi16_epi8(hi), 1);
+}
+
+//absdiff_sse2 over 64 bytes
+__attribute__((target("avx512f,avx512bw")))
+static inline __attribute__((always_inline)) __m512i absdiff_avx512(unsigned char *a,
+                                                                    unsigned char *b) {
+    __m512i va, vb;
+    va = _mm512_loadu_si512(a);
+    vb = _mm512_loadu_si512(b);
+    return _mm512_or_si512(_mm512_subs_epu8(va, vb), _mm512_subs_epu8(vb, va));
+}
+
+//the bytes of cur moved up n lanes, the lowest n filled from the top of prev
+#define SIMD_CARRY_AVX512(cur, prev, n) \
+    _mm512_alignr_epi8(cur, _mm512_alignr_epi64(cur, prev, 6), 16 - (n))
+
+__attribute__((target("avx512f,avx512bw")))
+void greyscale_avx512(unsigned char *bgr,
+                      size_t pixels) {
+    __m512i zero, g, prev;
+    unsigned char *q;
+    size_t i, bytes;
+    int k;
+    zero = _mm512_setzero_si512();
+    bytes = 3 * pixels;
+    for (i = 0; i + 192 + 2 <= bytes; i += 192) {
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            q = bgr + i + 64 * k;
+            g = _mm512_maskz_mov_epi8(_mm512_cmpeq_epi8_mask(_mm512_loadu_si512(simd_class8 + 64 * k), zero),
+                                      mean3_avx512(_mm512_loadu_si512(q), _mm512_loadu_si512(q + 1),
+                                                   _mm512_loadu_si512(q + 2)));
+            _mm512_storeu_si512(q,
+                                _mm512_or_si512(g, _mm512_or_si512(SIMD_CARRY_AVX512(g, prev, 1),
+                                                                   SIMD_CARRY_AVX512(g, prev, 2))));
+            prev = g;
+        }
+    }
+    greyscale_avx2(bgr + i, (bytes - i) / 3);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+size_t count_avx512(unsigned char *bgr,
+                    size_t pixels,
+                    unsigned char b,
+                    unsigned char g,
+                    unsigned char r) {
+    __m512i vb, vg, vr, cls;
+    __mmask64 eq;
+    size_t i, bytes, count;
+    int k;
+    vb = _mm512_set1_epi8((char) b);
+    vg = _mm512_set1_epi8((char) g);
+    vr = _mm512_set1_epi8((char) r);
+    bytes = 3 * pixels;
+    count = 0;
+    for (i = 0; i + 192 + 2 <= bytes; i += 192) {
+        for (k = 0; k < 3; k++) {
+            cls = _mm512_loadu_si512(simd_class8 + 64 * k);
+            eq = _mm512_cmpeq_epi8_mask(cls, _mm512_setzero_si512())
+                 & _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(bgr + i + 64 * k), vb)
+                 & _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(bgr + i + 64 * k + 1), vg)
+                 & _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(bgr + i + 64 * k + 2), vr);
+            count += __builtin_popcountll(eq);
+        }
+    }
+    return count + count_avx2(bgr + i, (bytes - i) / 3, b, g, r);
+}
+
+__attribute__((target("avx512f,avx512bw,popcnt")))
+size_t segment_difference_avx512(unsigned char *a,
+                                 unsigned char *b,
+                                 unsigned char *out,
+                                 size_t pixels,
+                                 unsigned char threshold) {
+    __m512i zero, t, f, prev;
+    __mmask64 m;
+    size_t i, j, bytes, count;
+    int k;
+    zero = _mm512_setzero_si512();
+    t = _mm512_set1_epi8((char) threshold);
+    bytes = 3 * pixels;
+    count = 0;
+    for (i = 0; i + 192 + 2 <= bytes; i += 192) {
+        prev = zero;
+        for (k = 0; k < 3; k++) {
+            j = i + 64 * k;
+            m = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(simd_class8 + 64 * k), zero)
+                & _mm512_cmpgt_epu8_mask(mean3_avx512(absdiff_avx512(a + j, b + j),
+                                                      absdiff_avx512(a + j + 1, b + j + 1),
+                                                      absdiff_avx512(a + j + 2, b + j + 2)), t);
+            count += __builtin_popcountll(m);
+            f = _mm512_movm_epi8(m);
+            _mm512_storeu_si512(out + j,
+                                _mm512_or_si512(f, _mm512_or_si512(SIMD_CARRY_AVX512(f, prev, 1),
+                                                                   SIMD_CARRY_AVX512(f, prev, 2))));
+            prev = f;
+        }
+    }
+    return count + segment_difference_avx2(a + i, b + i, out + i, (bytes - i) / 3, threshold);
+}
+
+#endif
+
+//every kernel set, widest first
+static struct PixelKernels pixel_kernel_sets[] = {
+#ifdef SIMD_X86
+    {"avx512", difference_avx512, threshold_avx512, greyscale_avx512, count_avx512,
+     segment_difference_avx512, count_bits_popcnt},
+    {"avx2", difference_avx2, threshold_avx2, greyscale_avx2, count_avx2,
+     segment_difference_avx2, count_bits_popcnt},
+    {"sse2", difference_sse2, threshold_sse2, greyscale_sse2, count_sse2,
+     segment_difference_sse2, count_bits_scalar},
+#endif
+    {"scalar", difference_scalar, threshold_scalar, greyscale_scalar, count_scalar,
+     segment_difference_scalar, count_bits_scalar}
+};
+
+static struct PixelKernels *pixel_kernels = NULL;
+static pthread_once_t pixel_kernels_once = PTHREAD_ONCE_INIT;
+
+//1 if the cpu can run the named set
+int pixel_kernels_supported(char *name) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "avx512") == 0)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("popcnt");
+    if (strcmp(name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    if (strcmp(name, "sse2") == 0)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+//picks the widest set the cpu supports, MOTDEC_SIMD in the environment can name a
+//narrower one, to compare them
+void init_pixel_kernels() {
+    char *want;
+    int i, n, first;
+
+#ifdef SIMD_X86
+    for (i = 0; i < SIMD_CLASSES; i++) {
+        simd_class8[i] = i % 3;
+    }
+#endif
+
+    n = sizeof(pixel_kernel_sets) / sizeof(pixel_kernel_sets[0]);
+    want = getenv("MOTDEC_SIMD");
+    first = 0;
+    for (i = 0; want && i < n; i++) {
+        if (strcmp(pixel_kernel_sets[i].name, want) == 0)
+            first = i;
+    }
+    //the scalar set, last, is always supported
+    for (i = first; i < n - 1; i++) {
+        if (pixel_kernels_supported(pixel_kernel_sets[i].name))
+            break;
+    }
+    pixel_kernels = &pixel_kernel_sets[i];
+}
+
+//the kernels in use, picked on the first call
+struct PixelKernels *get_pixel_kernels() {
+    pthread_once(&pixel_kernels_once, init_pixel_kernels);
+    return pixel_kernels;
+}
+
+//switches to the named set, for comparing them
+//returns 0 if there is no such set or the cpu can't run it
+int select_pixel_kernels(char *name) {
+    int i, n;
+
+    get_pixel_kernels();
+    n = sizeof(pixel_kernel_sets) / sizeof(pixel_kernel_sets[0]);
+    for (i = 0; i < n; i++) {
+        if (strcmp(pixel_kernel_sets[i].name, name) == 0 && pixel_kernels_supported(name)) {
+            pixel_kernels = &pixel_kernel_sets[i];
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMDTEST_BYTES 5000   //buffer each span is cut from, spans stop short of the end
+#define SIMDTEST_SPAN 1200    //longest span in bytes, past the widest kernel's block
+#define SIMDTEST_OFFSET 64    //spans start at any of the first SIMDTEST_OFFSET bytes
+#define SIMDTEST_GUARD 7      //bytes around a span, that no kernel may write
+
+// ----------
+// STRUCTURES
+// ----------
+
+//buffers shared by the kernel checks, spans are cut from them at random lengths and
+//offsets, and bytes the kernels must not touch are left at SIMDTEST_GUARD
+struct SimdTest {
+    unsigned char *a;
+    unsigned char *b;
+    unsigned char *ref_out;
+    unsigned char *out;
+    unsigned int seed;
+    long checks;
+    long fails;
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+int run_simd_selftest(int rounds);
+
+int check_pixel_kernels(struct SimdTest *st,
+                        struct PixelKernels *k,
+                        struct PixelKernels *ref,
+                        int rounds);
+
+void simdtest_fill(struct SimdTest *st,
+                   int mode);
+
+unsigned char simdtest_threshold(struct SimdTest *st,
+                                 int round);
+
+void simdtest_result(struct SimdTest *st,
+                     int ok,
+                     char *set,
+                     char *kernel,
+                     int offset,
+                     size_t n);
+
+unsigned int simdtest_rand(struct SimdTest *st);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//checks every simd kernel set the cpu runs against the scalar set, byte for byte,
+//on rounds of random spans
+//returns 1 if every set matched
+int run_simd_selftest(int rounds) {
+    struct SimdTest st;
+    struct PixelKernels *ref;
+    int i, n, ok;
+
+    st.a = malloc(SIMDTEST_BYTES);
+    st.b = malloc(SIMDTEST_BYTES);
+    st.ref_out = malloc(SIMDTEST_BYTES);
+    st.out = malloc(SIMDTEST_BYTES);
+    if (!st.a || !st.b || !st.ref_out || !st.out) {
+        free(st.a);
+        free(st.b);
+        free(st.ref_out);
+        free(st.out);
+        return 0;
+    }
+    st.seed = 1;
+
+    //the simd sets share tables that are filled with the first pick
+    get_pixel_kernels();
+    //the scalar set is last
+    n = sizeof(pixel_kernel_sets) / sizeof(pixel_kernel_sets[0]);
+    ref = &pixel_kernel_sets[n - 1];
+    ok = 1;
+    for (i = 0; i < n - 1; i++) {
+        if (!pixel_kernels_supported(pixel_kernel_sets[i].name)) {
+            printf("%-8s skipped, the cpu can't run it\n", pixel_kernel_sets[i].name);
+            continue;
+        }
+        st.checks = st.fails = 0;
+        if (!check_pixel_kernels(&st, &pixel_kernel_sets[i], ref, rounds))
+            ok = 0;
+        printf("%-8s %ld checks, %ld mismatches\n", pixel_kernel_sets[i].name, st.checks, st.fails);
+    }
+
+    free(st.a);
+    free(st.b);
+    free(st.ref_out);
+    free(st.out);
+    return ok;
+}
+
+//runs each kernel of k and ref on the same spans and compares their outputs, the
+//bytes around the span included
+//returns 1 if all matched
+int check_pixel_kernels(struct SimdTest *st,
+                        struct PixelKernels *k,
+                        struct PixelKernels *ref,
+                        int rounds) {
+    unsigned char t, pb, pg, pr;
+    size_t c1, c2, n, px;
+    int round, off, v;
+
+    for (round = 0; round < rounds; round++) {
+        off = simdtest_rand(st) % SIMDTEST_OFFSET;
+        n = simdtest_rand(st) % SIMDTEST_SPAN;
+        px = n / 3;
+        t = simdtest_threshold(st, round);
+        simdtest_fill(st, round % 3);
+
+        memset(st->ref_out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        memset(st->out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        ref->difference(st->a + off, st->b + off, st->ref_out + off, n);
+        k->difference(st->a + off, st->b + off, st->out + off, n);
+        simdtest_result(st, !memcmp(st->ref_out, st->out, SIMDTEST_BYTES), k->name, "difference", off, n);
+
+        memset(st->ref_out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        memset(st->out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        ref->threshold(st->a + off, st->ref_out + off, n, t);
+        k->threshold(st->a + off, st->out + off, n, t);
+        simdtest_result(st, !memcmp(st->ref_out, st->out, SIMDTEST_BYTES), k->name, "threshold", off, n);
+
+        memcpy(st->ref_out, st->a, SIMDTEST_BYTES);
+        memcpy(st->out, st->a, SIMDTEST_BYTES);
+        ref->greyscale(st->ref_out + off, px);
+        k->greyscale(st->out + off, px);
+        simdtest_result(st, !memcmp(st->ref_out, st->out, SIMDTEST_BYTES), k->name, "greyscale", off, px);
+
+        //a colour from the span, so there is something to count
+        pb = st->a[off + 3 * (simdtest_rand(st) % (px + 1))];
+        pg = st->a[off + 1];
+        pr = st->a[off + 2];
+        c1 = ref->count(st->a + off, px, pb, pg, pr);
+        c2 = k->count(st->a + off, px, pb, pg, pr);
+        simdtest_result(st, c1 == c2, k->name, "count", off, px);
+
+        c1 = ref->count_bits(st->a + off, n);
+        c2 = k->count_bits(st->a + off, n);
+        simdtest_result(st, c1 == c2, k->name, "count_bits", off, n);
+
+        memset(st->ref_out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        memset(st->out, SIMDTEST_GUARD, SIMDTEST_BYTES);
+        c1 = ref->segment_difference(st->a + off, st->b + off, st->ref_out + off, px, t);
+        c2 = k->segment_difference(st->a + off, st->b + off, st->out + off, px, t);
+        simdtest_result(st, c1 == c2 && !memcmp(st->ref_out, st->out, SIMDTEST_BYTES),
+                        k->name, "segment_difference", off, px);
+
+        //in place, out is a
+        memcpy(st->ref_out, st->a, SIMDTEST_BYTES);
+        memcpy(st->out, st->a, SIMDTEST_BYTES);
+        c1 = ref->segment_difference(st->ref_out + off, st->b + off, st->ref_out + off, px, t);
+        c2 = k->segment_difference(st->out + off, st->b + off, st->out + off, px, t);
+        simdtest_result(st, c1 == c2 && !memcmp(st->ref_out, st->out, SIMDTEST_BYTES),
+                        k->name, "segment_difference in place", off, px);
+    }
+
+    //every sum of three channels the greyscale division can see
+    for (v = 0; v < 256 * 3; v++) {
+        st->a[3 * v] = v / 3;
+        st->a[3 * v + 1] = (v + 1) / 3;
+        st->a[3 * v + 2] = (v + 2) / 3;
+    }
+    memcpy(st->ref_out, st->a, SIMDTEST_BYTES);
+    memcpy(st->out, st->a, SIMDTEST_BYTES);
+    ref->greyscale(st->ref_out, 256 * 3);
+    k->greyscale(st->out, 256 * 3);
+    simdtest_result(st, !memcmp(st->ref_out, st->out, SIMDTEST_BYTES), k->name, "greyscale sums", 0, 256 * 3);
+
+    return st->fails == 0;
+}
+
+//fills a and b, mode 0 with noise, 1 with 0 or 255 as in a segmap, 2 with values
+//around the middle, where thresholds and rounding are closest
+void simdtest_fill(struct SimdTest *st,
+                   int mode) {
+    int i;
+    for (i = 0; i < SIMDTEST_BYTES; i++) {
+        if (mode == 0) {
+            st->a[i] = simdtest_rand(st);
+            st->b[i] = simdtest_rand(st);
+        } else if (mode == 1) {
+            st->a[i] = (simdtest_rand(st) & 1) * 255;
+            st->b[i] = (simdtest_rand(st) & 1) * 255;
+        } else {
+            st->a[i] = 127 + simdtest_rand(st) % 3;
+            st->b[i] = 127 + simdtest_rand(st) % 3;
+        }
+    }
+}
+
+//the edge thresholds in turn, then a random one
+unsigned char simdtest_threshold(struct SimdTest *st,
+                                 int round) {
+    static const unsigned char edges[] = {0, 1, 127, 128, 254, 255};
+    int n = sizeof(edges) / sizeof(edges[0]);
+    if (round % (n + 1) < n)
+        return edges[round % (n + 1)];
+    return simdtest_rand(st);
+}
+
+//counts a check, printing the first few that failed
+void simdtest_result(struct SimdTest *st,
+                     int ok,
+                     char *set,
+                     char *kernel,
+                     int offset,
+                     size_t n) {
+    st->checks++;
+    if (ok)
+        return;
+    if (st->fails++ < 5)
+        printf("%-8s %s differs from scalar at offset %d, length %zu\n", set, kernel, offset, n);
+}
+
+//small lcg, so a failing run can be repeated
+unsigned int simdtest_rand(struct SimdTest *st) {
+    st->seed = st->seed * 1103515245 + 12345;
+    return st->seed >> 8;
+}
@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SYNTH_NOISE_TABLE 65536   //size of the precomputed noise table, power of 2
+#define SYNTH_DRIFT_PERIOD 300    //frames per lighting drift cycle
+#define SYNTH_SEED 0x5eed1234     //fixed seed so every run sees the same scene
+
+#define SYNTH_RECT 0
+#define SYNTH_BLOB 1
+
+// ----------
+// STRUCTURES
+// ----------
+
+//an object moving across the synthetic scene
+struct SynthObject {
+    int x, y;             //top left corner
+    int w, h;
+    int dx, dy;           //pixels moved per frame
+    int shape;            //SYNTH_RECT or SYNTH_BLOB
+    unsigned char b, g, r;
+};
+
+//generates frames of a noisy static scene with moving objects and lighting drift
+struct SynthSource {
+    unsigned int width;
+    unsigned int height;
+    int scanline_size;
+    unsigned char *background;   //static scene, in BMP row layout
+    signed char *noise;          //SYNTH_NOISE_TABLE samples of sensor noise
+    int noise_level;             //max noise added to a channel
+    int drift;                   //max lighting change, in channel levels
+    int object_count;
+    struct SynthObject *objects;
+    unsigned long frame;         //frames generated
+    unsigned long frame_limit;   //frames to generate, 0 for no limit
+    unsigned int rng;            //xorshift state
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct SynthSource *open_synth_source(unsigned int width,
+                                      unsigned int height,
+                                      int object_count,
+                                      int noise_level,
+                                      int drift,
+                                      unsigned long frame_limit);
+
+int read_synth_frame(struct SynthSource *ss,
+                     struct BMP *frame);
+
+void close_synth_source(struct SynthSource *ss);
+
+void move_synth_object(struct SynthSource *ss,
+                       struct SynthObject *obj);
+
+void draw_synth_object(struct SynthObject *obj,
+                       struct BMP *frame);
+
+unsigned int synth_rand(struct SynthSource *ss);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//creates a synthetic scene of the given size
+//object_count objects move over the scene, noise_level and drift are in channel levels (0 - 255)
+//returns NULL on memory error
+struct SynthSource *open_synth_source(unsigned int width,
+                                      unsigned int height,
+                                      int object_count,
+                                      int noise_level,
+                                      int drift,
+                                      unsigned long frame_limit) {
+    struct SynthSource *ss;
+    struct SynthObject *obj;
+    unsigned char *row;
+    int x, y, i, min_size, max_size;
+
+    if (width < 2 || height < 2)
+        return NULL;
+
+    ss = calloc(sizeof(struct SynthSource), 1);
+    if (!ss)
+        return NULL;
+
+    ss->width = width;
+    ss->height = height;
+    ss->scanline_size = get_scanline_size(width);
+    ss->noise_level = noise_level;
+    ss->drift = drift;
+    ss->object_count = object_count;
+    ss->frame_limit = frame_limit;
+    ss->rng = SYNTH_SEED;
+
+    ss->background = calloc(ss->scanline_size * height, 1);
+    ss->noise = malloc(SYNTH_NOISE_TABLE);
+    ss->objects = calloc(object_count + 1, sizeof(struct SynthObject));
+    if (!ss->background || !ss->noise || !ss->objects) {
+        close_synth_source(ss);
+        return NULL;
+    }
+
+    //background is a smooth gradient with some fixed texture so it isn't flat
+    for (y = 0; y < height; y++) {
+        row = ss->background + (y * ss->scanline_size);
+        for (x = 0; x < width; x++) {
+            row[3*x]     = 60 + (x * 80) / width + (synth_rand(ss) & 15);
+            row[3*x + 1] = 70 + (y * 80) / height + (synth_rand(ss) & 15);
+            row[3*x + 2] = 90 + ((x + y) * 40) / (width + height) + (synth_rand(ss) & 15);
+        }
+    }
+
+    //noise is looked up from a table, generating it per pixel would cost more than the detector
+    for (i = 0; i < SYNTH_NOISE_TABLE; i++) {
+        if (noise_level > 0)
+            ss->noise[i] = (int) (synth_rand(ss) % (2 * noise_level + 1)) - noise_level;
+        else
+            ss->noise[i] = 0;
+    }
+
+    //objects are sized relative to the frame so scenes look alike at every resolution
+    min_size = (width < height ? width : height) / 12 + 1;
+    max_size = (width < height ? width : height) / 5 + 2;
+    for (i = 0; i < object_count; i++) {
+        obj = &ss->objects[i];
+        obj->w = min_size + synth_rand(ss) % (max_size - min_size);
+        obj->h = min_size + synth_rand(ss) % (max_size - min_size);
+        if (obj->w > width)
+            obj->w = width;
+        if (obj->h > height)
+            obj->h = height;
+        obj->x = synth_rand(ss) % (width - obj->w + 1);
+        obj->y = synth_rand(ss) % (height - obj->h + 1);
+        obj->dx = 1 + synth_rand(ss) % (width / 80 + 2);
+        obj->dy = 1 + synth_rand(ss) % (height / 80 + 2);
+        if (synth_rand(ss) & 1)
+            obj->dx = -obj->dx;
+        if (synth_rand(ss) & 1)
+            obj->dy = -obj->dy;
+        obj->shape = i % 2 ? SYNTH_BLOB : SYNTH_RECT;
+        obj->b = synth_rand(ss);
+        obj->g = synth_rand(ss);
+        obj->r = synth_rand(ss);
+    }
+
+    return ss;
+}
+
+//generates the next frame of the scene into frame, as fast as it is asked for
+//returns 1 on success, 0 on error and -1 once frame_limit frames have been generated
+int read_synth_frame(struct SynthSource *ss,
+                     struct BMP *frame) {
+    unsigned char lut[256];
+    unsigned char *in, *out;
+    signed char *noise;
+    int i, x, y, v, shift, row_bytes;
+
+    if (frame->image_header->width != ss->width ||
+        frame->image_header->height != ss->height)
+        return 0;
+
+    if (ss->frame_limit > 0 && ss->frame >= ss->frame_limit)
+        return -1;
+
+    //lighting drifts slowly up and down, applied through a lookup per frame
+    shift = (int) (ss->drift * sin((2.0 * M_PI * ss->frame) / SYNTH_DRIFT_PERIOD));
+    for (i = 0; i < 256; i++) {
+        v = i + shift;
+        lut[i] = v < 0 ? 0 : (v > 255 ? 255 : v);
+    }
+
+    //background with drift and noise, noise starts at a random point in the table each row
+    row_bytes = ss->width * 3;
+    for (y = 0; y < ss->height; y++) {
+        in = ss->background + (y * ss->scanline_size);
+        out = frame->pixel_data + (y * frame->scanline_size);
+        noise = ss->noise + (synth_rand(ss) & (SYNTH_NOISE_TABLE / 2 - 1));
+        for (x = 0; x < row_bytes; x++) {
+            v = lut[in[x]] + noise[x & (SYNTH_NOISE_TABLE / 2 - 1)];
+            out[x] = v < 0 ? 0 : (v > 255 ? 255 : v);
+        }
+    }
+
+    //objects on top
+    for (i = 0; i < ss->object_count; i++) {
+        draw_synth_object(&ss->objects[i], frame);
+        move_synth_object(ss, &ss->objects[i]);
+    }
+
+    ss->frame++;
+    return 1;
+}
+
+//frees the scene
+void close_synth_source(struct SynthSource *ss) {
+    if (!ss)
+        return;
+    free(ss->background);
+    free(ss->noise);
+    free(ss->objects);
+    free(ss);
+}
+
+//moves obj one frame along, bouncing off the edges of the frame
+void move_synth_object(struct SynthSource *ss,
+                       struct SynthObject *obj) {
+    obj->x += obj->dx;
+    obj->y += obj->dy;
+    if (obj->x < 0) {
+        obj->x = 0;
+        obj->dx = -obj->dx;
+    } else if (obj->x + obj->w > ss->width) {
+        obj->x = ss->width - obj->w;
+        obj->dx = -obj->dx;
+    }
+    if (obj->y < 0) {
+        obj->y = 0;
+        obj->dy = -obj->dy;
+    } else if (obj->y + obj->h > ss->height) {
+        obj->y = ss->height - obj->h;
+        obj->dy = -obj->dy;
+    }
+}
+
+//draws obj as a solid rectangle or an ellipse filling its bounds
+void draw_synth_object(struct SynthObject *obj,
+                       struct BMP *frame) {
+    unsigned char *row;
+    int x, y, x0, x1;
+    double ry, rx, fy;
+
+    rx = obj->w / 2.0;
+    ry = obj->h / 2.0;
+
+    for (y = obj->y; y < obj->y + obj->h; y++) {
+        x0 = obj->x;
+        x1 = obj->x + obj->w;
+        //blobs only fill the span of the ellipse on this row
+        if (obj->shape == SYNTH_BLOB) {
+            fy = (y + 0.5 - obj->y - ry) / ry;
+            if (fy * fy >= 1.0)
+                continue;
+            x0 = obj->x + (int) (rx - rx * sqrt(1.0 - fy * fy));
+            x1 = obj->x + obj->w - (x0 - obj->x);
+        }
+        row = frame->pixel_data + (y * frame->scanline_size);
+        for (x = x0; x < x1; x++) {
+            row[3*x]     = obj->b;
+            row[3*x + 1] = obj->g;
+            row[3*x + 2] = obj->r;
+        }
+    }
+}
+
+//xorshift32, cheap repeatable random numbers for the scene
+unsigned int synth_rand(struct SynthSource *ss) {
+    unsigned int x = ss->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ss->rng = x;
+    return x;
+}
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+#define V4L2_NUM_BUFFERS 4
+#define V4L2_TIMEOUT_SECS 2
+#define V4L2_QBUF_RETRIES 3   //tries at giving a buffer back before it is counted lost
+
+// ----------
+// STRUCTURES
+// ----------
+
+//a single driver buffer mapped into our address space
+struct V4L2Buffer {
+    void *start;
+    size_t length;
+};
+
+//a video device opened once and left streaming into mmap'd buffers
+struct V4L2Capture {
+    int fd;
+    unsigned int width;           //negotiated width, may differ from requested
+    unsigned int height;          //negotiated height
+    unsigned int pixel_format;    //V4L2_PIX_FMT_* the driver agreed to
+    unsigned int bytes_per_line;  //stride of a row in the driver buffer
+    int luma;                     //opened for luma only reads, Y plane formats are accepted
+    int buffer_count;
+    struct V4L2Buffer *buffers;
+    unsigned long lost_buffers;   //buffers the driver wouldn't take back, each leaves one fewer
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct V4L2Capture *open_v4l2_capture(char *device,
+                                      unsigned int width,
+                                      unsigned int height,
+                                      int luma);
+
+int read_v4l2_frame(struct V4L2Capture *cap,
+                    struct BMP *frame);
+
+int read_v4l2_luma(struct V4L2Capture *cap,
+                   struct Gray8 *frame);
+
+int dequeue_v4l2_buffer(struct V4L2Capture *cap,
+                        struct v4l2_buffer *buf);
+
+int requeue_v4l2_buffer(struct V4L2Capture *cap,
+                        struct v4l2_buffer *buf);
+
+void close_v4l2_capture(struct V4L2Capture *cap);
+
+int xioctl(int fd,
+           unsigned long request,
+           void *arg);
+
+void yuyv_to_BMP(unsigned char *src,
+                 unsigned int bytes_per_line,
+                 struct BMP *frame);
+
+void rgb24_to_BMP(unsigned char *src,
+                  unsigned int bytes_per_line,
+                  int swap_rb,
+                  struct BMP *frame);
+
+void yuyv_to_gray8(unsigned char *src,
+                   unsigned int bytes_per_line,
+                   struct Gray8 *frame);
+
+void rgb24_to_gray8(unsigned char *src,
+                    unsigned int bytes_per_line,
+                    int swap_rb,
+                    struct Gray8 *frame);
+
+void plane_to_gray8(unsigned char *src,
+                    unsigned int bytes_per_line,
+                    struct Gray8 *frame);
+
+unsigned char clamp_byte(int v);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+//opens the device, negotiates a format and starts streaming into mmap'd buffers
+//if luma is set only the Y plane will be read, so NV12 and GREY devices are accepted too
+//returns NULL if the device can't be opened or doesn't support streaming capture
+struct V4L2Capture *open_v4l2_capture(char *device,
+                                      unsigned int width,
+                                      unsigned int height,
+                                      int luma) {
+    struct V4L2Capture *cap;
+    struct v4l2_capability caps;
+    struct v4l2_format fmt;
+    struct v4l2_requestbuffers req;
+    struct v4l2_buffer buf;
+    enum v4l2_buf_type type;
+    struct stat st;
+    int i;
+
+    //only character devices are real capture devices
+    if (stat(device, &st) != 0 || !S_ISCHR(st.st_mode))
+        return NULL;
+
+    cap = calloc(sizeof(struct V4L2Capture), 1);
+    if (!cap)
+        return NULL;
+
+    cap->fd = open(device, O_RDWR | O_NONBLOCK);
+    if (cap->fd < 0) {
+        free(cap);
+        return NULL;
+    }
+
+    //check the device can stream video capture
+    if (xioctl(cap->fd, VIDIOC_QUERYCAP, &caps) != 0 ||
+        !(caps.capabilities & V4L2_CAP_VIDEO_CAPTURE) ||
+        !(caps.capabilities & V4L2_CAP_STREAMING)) {
+        close(cap->fd);
+        free(cap);
+        return NULL;
+    }
+
+    //ask for YUYV, the format almost every webcam delivers natively
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(cap->fd, VIDIOC_S_FMT, &fmt) != 0) {
+        close(cap->fd);
+        free(cap);
+        return NULL;
+    }
+
+    //driver may have picked something else, only accept what we can convert
+    if (fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV &&
+        fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_BGR24 &&
+        fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24 &&
+        !(luma && (fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_NV12 ||
+                   fmt.fmt.pix.pixelformat == V4L2_PIX_FMT_GREY))) {
+        close(cap->fd);
+        free(cap);
+        return NULL;
+    }
+
+    cap->width = fmt.fmt.pix.width;
+    cap->height = fmt.fmt.pix.height;
+    cap->pixel_format = fmt.fmt.pix.pixelformat;
+    cap->bytes_per_line = fmt.fmt.pix.bytesperline;
+    cap->luma = luma;
+    if (cap->bytes_per_line == 0) {
+        if (cap->pixel_format == V4L2_PIX_FMT_NV12 || cap->pixel_format == V4L2_PIX_FMT_GREY)
+            cap->bytes_per_line = cap->width;
+        else
+            cap->bytes_per_line = cap->width * (cap->pixel_format == V4L2_PIX_FMT_YUYV ? 2 : 3);
+    }
+
+    //request driver buffers to map
+    memset(&req, 0, sizeof(req));
+    req.count = V4L2_NUM_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(cap->fd, VIDIOC_REQBUFS, &req) != 0 || req.count < 2) {
+        close(cap->fd);
+        free(cap);
+        return NULL;
+    }
+
+    cap->buffers = calloc(req.count, sizeof(struct V4L2Buffer));
+    if (!cap->buffers) {
+        close(cap->fd);
+        free(cap);
+        return NULL;
+    }
+
+    //map each buffer and hand it to the driver
+    for (i = 0; i < req.count; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(cap->fd, VIDIOC_QUERYBUF, &buf) != 0) {
+            close_v4l2_capture(cap);
+            return NULL;
+        }
+        cap->buffers[i].length = buf.length;
+        cap->buffers[i].start = mmap(NULL, buf.length,
+                                     PROT_READ | PROT_WRITE, MAP_SHARED,
+                                     cap->fd, buf.m.offset);
+        if (cap->buffers[i].start == MAP_FAILED) {
+            cap->buffers[i].start = NULL;
+            close_v4l2_capture(cap);
+            return NULL;
+        }
+        cap->buffer_count++;
+        if (xioctl(cap->fd, VIDIOC_QBUF, &buf) != 0) {
+            close_v4l2_capture(cap);
+            return NULL;
+        }
+    }
+
+    //start streaming
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(cap->fd, VIDIOC_STREAMON, &type) != 0) {
+        close_v4l2_capture(cap);
+        return NULL;
+    }
+
+    return cap;
+}
+
+//waits for the next frame from the driver and converts it into frame
+//frame must be cap->width x cap->height
+//returns 1 on success
+int read_v4l2_frame(struct V4L2Capture *cap,
+                    struct BMP *frame) {
+    struct v4l2_buffer buf;
+
+    if (frame->image_header->width != cap->width ||
+        frame->image_header->height != cap->height)
+        return 0;
+
+    //Y plane formats have no colour to convert
+    if (cap->pixel_format == V4L2_PIX_FMT_NV12 || cap->pixel_format == V4L2_PIX_FMT_GREY)
+        return 0;
+
+    if (!dequeue_v4l2_buffer(cap, &buf))
+        return 0;
+
+    //convert straight from the mapped buffer into the BMP
+    if (cap->pixel_format == V4L2_PIX_FMT_YUYV) {
+        yuyv_to_BMP(cap->buffers[buf.index].start, cap->bytes_per_line, frame);
+    } else {
+        rgb24_to_BMP(cap->buffers[buf.index].start, cap->bytes_per_line,
+                     cap->pixel_format == V4L2_PIX_FMT_RGB24, frame);
+    }
+
+    //give buffer back to the driver, the frame is read even if it won't take it
+    requeue_v4l2_buffer(cap, &buf);
+
+    return 1;
+}
+
+//waits for the next frame from the driver and copies its luma into frame
+//YUYV, NV12 and GREY frames give up their Y values without any colour conversion
+//frame must be cap->width x cap->height
+//returns 1 on success
+int read_v4l2_luma(struct V4L2Capture *cap,
+                   struct Gray8 *frame) {
+    struct v4l2_buffer buf;
+    unsigned char *start;
+
+    if (frame->width != cap->width || frame->height != cap->height)
+        return 0;
+
+    if (!dequeue_v4l2_buffer(cap, &buf))
+        return 0;
+
+    start = cap->buffers[buf.index].start;
+    if (cap->pixel_format == V4L2_PIX_FMT_YUYV) {
+        yuyv_to_gray8(start, cap->bytes_per_line, frame);
+    } else if (cap->pixel_format == V4L2_PIX_FMT_NV12 || cap->pixel_format == V4L2_PIX_FMT_GREY) {
+        //NV12 starts with the full Y plane, chroma follows it
+        plane_to_gray8(start, cap->bytes_per_line, frame);
+    } else {
+        rgb24_to_gray8(start, cap->bytes_per_line,
+                       cap->pixel_format == V4L2_PIX_FMT_RGB24, frame);
+    }
+
+    //give buffer back to the driver, the frame is read even if it won't take it
+    requeue_v4l2_buffer(cap, &buf);
+
+    return 1;
+}
+
+//waits for a filled driver buffer and takes it, skipping to the newest if several are ready
+//the caller gives buf back with VIDIOC_QBUF once it has read it
+//returns 1 on success
+int dequeue_v4l2_buffer(struct V4L2Capture *cap,
+                        struct v4l2_buffer *buf) {
+    struct v4l2_buffer next;
+    struct timeval tv;
+    fd_set fds;
+    int r;
+
+    //wait for a filled buffer
+    do {
+        FD_ZERO(&fds);
+        FD_SET(cap->fd, &fds);
+        tv.tv_sec = V4L2_TIMEOUT_SECS;
+        tv.tv_usec = 0;
+        r = select(cap->fd + 1, &fds, NULL, NULL, &tv);
+    } while (r == -1 && errno == EINTR);
+
+    if (r <= 0)
+        return 0;
+
+    //take buffer from driver
+    memset(buf, 0, sizeof(*buf));
+    buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf->memory = V4L2_MEMORY_MMAP;
+    if (xioctl(cap->fd, VIDIOC_DQBUF, buf) != 0)
+        return 0;
+
+    //frames queue up while the detector is busy, skip to the newest one
+    memset(&next, 0, sizeof(next));
+    next.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    next.memory = V4L2_MEMORY_MMAP;
+    while (xioctl(cap->fd, VIDIOC_DQBUF, &next) == 0) {
+        //the older buffer is lost if it can't go back, but next is still good
+        if (!requeue_v4l2_buffer(cap, buf)) {
+            *buf = next;
+            return 1;
+        }
+        *buf = next;
+    }
+
+    return 1;
+}
+
+//gives a dequeued buffer back to the driver, trying again if it refuses
+//a buffer that still can't go back is counted in lost_buffers
+//returns 1 on success
+int requeue_v4l2_buffer(struct V4L2Capture *cap,
+                        struct v4l2_buffer *buf) {
+    int i;
+
+    for (i = 0; i < V4L2_QBUF_RETRIES; i++) {
+        if (xioctl(cap->fd, VIDIOC_QBUF, buf) == 0)
+            return 1;
+        usleep(1000);
+    }
+    cap->lost_buffers++;
+    return 0;
+}
+
+//stops streaming, unmaps buffers and closes the device
+void close_v4l2_capture(struct V4L2Capture *cap) {
+    enum v4l2_buf_type type;
+    int i;
+
+    if (!cap)
+        return;
+
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(cap->fd, VIDIOC_STREAMOFF, &type);
+
+    for (i = 0; i < cap->buffer_count; i++) {
+        if (cap->buffers[i].start)
+            munmap(cap->buffers[i].start, cap->buffers[i].length);
+    }
+    free(cap->buffers);
+    close(cap->fd);
+    free(cap);
+}
+
+//ioctl that retries when interrupted by a signal
+int xioctl(int fd,
+           unsigned long request,
+           void *arg) {
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+//converts a packed YUYV (4:2:2) buffer to the BGR bottom-up layout of a BMP
+void yuyv_to_BMP(unsigned char *src,
+                 unsigned int bytes_per_line,
+                 struct BMP *frame) {
+    unsigned char *in, *out;
+    int x, y, c, d, e, y0, y1;
+    int width = frame->image_header->width;
+    int height = frame->image_header->height;
+
+    for (y = 0; y < height; y++) {
+        in = src + (y * bytes_per_line);
+        //bmp rows are stored bottom-up
+        out = frame->pixel_data + ((height - y - 1) * frame->scanline_size);
+        for (x = 0; x < width; x += 2) {
+            y0 = in[0];
+            d = in[1] - 128;
+            y1 = in[2];
+            e = in[3] - 128;
+            in += 4;
+
+            //BT.601 integer conversion
+            c = 298 * (y0 - 16);
+            out[0] = clamp_byte((c + 516 * d + 128) >> 8);
+            out[1] = clamp_byte((c - 100 * d - 208 * e + 128) >> 8);
+            out[2] = clamp_byte((c + 409 * e + 128) >> 8);
+            out += 3;
+
+            //odd widths have no second pixel in the last pair
+            if (x + 1 < width) {
+                c = 298 * (y1 - 16);
+                out[0] = clamp_byte((c + 516 * d + 128) >> 8);
+                out[1] = clamp_byte((c - 100 * d - 208 * e + 128) >> 8);
+                out[2] = clamp_byte((c + 409 * e + 128) >> 8);
+                out += 3;
+            }
+        }
+    }
+}
+
+//copies a packed 24 bit buffer to the bottom-up layout of a BMP
+//swap_rb is set for RGB ordered sources, BMP stores BGR
+void rgb24_to_BMP(unsigned char *src,
+                  unsigned int bytes_per_line,
+                  int swap_rb,
+                  struct BMP *frame) {
+    unsigned char *in, *out;
+    int x, y;
+    int width = frame->image_header->width;
+    int height = frame->image_header->height;
+
+    for (y = 0; y < height; y++) {
+        in = src + (y * bytes_per_line);
+        out = frame->pixel_data + ((height - y - 1) * frame->scanline_size);
+        if (!swap_rb) {
+            memcpy(out, in, width * 3);
+            continue;
+        }
+        for (x = 0; x < width; x++) {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+            in += 3;
+            out += 3;
+        }
+    }
+}
+
+//takes the Y values out of a packed YUYV (4:2:2) buffer, every other byte
+void yuyv_to_gray8(unsigned char *src,
+                   unsigned int bytes_per_line,
+                   struct Gray8 *frame) {
+    unsigned char *in, *out;
+    int x, y;
+
+    out = frame->pixel_data;
+    for (y = 0; y < frame->height; y++) {
+        in = src + (y * bytes_per_line);
+        for (x = 0; x < frame->width; x++) {
+            *out++ = in[2*x];
+        }
+    }
+}
+
+//takes the BT.601 luma of a packed 24 bit buffer
+//swap_rb is set for RGB ordered sources
+void rgb24_to_gray8(unsigned char *src,
+                    unsigned int bytes_per_line,
+                    int swap_rb,
+                    struct Gray8 *frame) {
+    unsigned char *in, *out;
+    int x, y, r, b;
+
+    r = swap_rb ? 0 : 2;
+    b = swap_rb ? 2 : 0;
+    out = frame->pixel_data;
+    for (y = 0; y < frame->height; y++) {
+        in = src + (y * bytes_per_line);
+        for (x = 0; x < frame->width; x++) {
+            *out++ = ((66 * in[r] + 129 * in[1] + 25 * in[b] + 128) >> 8) + 16;
+            in += 3;
+        }
+    }
+}
+
+//copies an 8 bit plane (GREY, or the Y plane at the start of NV12) row by row
+void plane_to_gray8(unsigned char *src,
+                    unsigned int bytes_per_line,
+                    struct Gray8 *frame) {
+    int y;
+
+    if (bytes_per_line == frame->width) {
+        memcpy(frame->pixel_data, src, (size_t) frame->width * frame->height);
+        return;
+    }
+    for (y = 0; y < frame->height; y++) {
+        memcpy(frame->pixel_data + (y * frame->width), src + (y * bytes_per_line), frame->width);
+    }
+}
+
+//clamps an int to 0 - 255
+unsigned char clamp_byte(int v) {
+    if (v < 0)
+        return 0;
+    if (v > 255)
+        return 255;
+    return v;
+}
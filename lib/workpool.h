@@ -0,0 +1,638 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#define MAX_WORKER_THREADS 64     //most workers in a pool
+#define MAX_BATCH_JOBS 256        //most jobs a kernel's work is split into
+#define TILE_ROWS 16              //rows in each tile of a frame split into tiles
+#define PARALLEL_POOL 0           //batches run on the pool's workers
+#define PARALLEL_SPAWN 1          //a thread is created and joined for every job, as before the pool
+#define PARTITION_BANDS 0         //each job takes one contiguous band of rows
+#define PARTITION_INTERLEAVED 1   //jobs take rows or columns in turn, as before the bands
+#define PARTITION_TILES 2         //many small bands, more than there are workers, so the
+                                  //workers can even out uneven work between them
+
+// ----------
+// STRUCTURES
+// ----------
+
+//the part of a frame one job covers, rows y0 up to y1 stepping by ystep, and in each
+//of them the columns (or runs of columns) from x0 stepping by xstep
+struct JobPart {
+    int y0;
+    int y1;
+    int ystep;
+    int x0;
+    int xstep;
+};
+
+//a run of a batch's jobs that one thread works through front to back, while the
+//others steal from the back once theirs are empty
+//the first job not yet taken is in the low 32 bits of range, one past the last in
+//the high 32, so both ends move with one compare and swap
+struct JobDeque {
+    atomic_ullong range;
+    char pad[64 - sizeof(atomic_ullong)]; //each deque on a cache line of its own
+};
+
+//one parallel_for, count jobs of job_size bytes each, run as job_fn(job)
+//the jobs are dealt out in order over the deques, one per worker and one for the
+//submitting thread if it runs jobs, so each thread starts on neighbouring parts of
+//the frame and only takes others' when it runs out
+//lives on the submitting thread's stack until every job is done and no worker is
+//still looking at it
+struct WorkBatch {
+    void *(*job_fn)(void *);
+    char *jobs;
+    size_t job_size;
+    int count;
+    int done;                     //jobs finished
+    int active;                   //workers taking jobs from the batch
+    int num_deques;
+    struct WorkBatch *next_batch; //queued after this one
+    struct JobDeque deques[MAX_WORKER_THREADS + 1];
+};
+
+//threads started once and shared by every threaded kernel, in place of a create and
+//join per thread per call
+//batches are queued in the order they are submitted, so each camera's detector can
+//have one in at the same time, and the submitting thread runs jobs of its own batch
+//instead of sleeping while the workers do, unless the workers are pinned, then the
+//kernels only run on their cpus
+struct WorkerPool {
+    int num_workers;
+    int started;                  //workers that need joining
+    int next_worker_id;           //deque the next worker to start takes its jobs from
+    int stopping;
+    struct WorkBatch *head;       //oldest batch with jobs not yet handed out
+    struct WorkBatch *tail;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;     //wakes idle workers
+    pthread_cond_t done_cond;     //signalled when a batch's last job finishes
+    pthread_t *workers;
+    int *cpus;                    //cpu each worker is pinned to, NULL when they aren't
+    int pin_failures;             //workers the cpu couldn't be set for
+    unsigned long batches;        //parallel_for calls
+    unsigned long jobs;
+    unsigned long caller_jobs;    //jobs run by the submitting thread rather than a worker
+    unsigned long steals;         //jobs run by a thread other than the one dealt them
+};
+
+// ------------
+// DECLARATIONS
+// ------------
+
+struct WorkerPool *init_worker_pool(int num_workers,
+                                    int *cpus,
+                                    int num_cpus);
+
+void free_worker_pool(struct WorkerPool *pool);
+
+struct WorkerPool *get_worker_pool();
+
+void init_shared_worker_pool();
+
+int configure_worker_pool(int num_workers,
+                          int *cpus,
+                          int num_cpus);
+
+int avoid_worker_cpus(struct WorkerPool *pool);
+
+int default_worker_count();
+
+int get_worker_count();
+
+int get_parallel_mode();
+
+void set_parallel_mode(int mode);
+
+int get_partition_mode();
+
+void set_partition_mode(int mode);
+
+char *get_partition_name(int mode);
+
+int get_job_count(int height);
+
+void get_job_part(int step,
+                  int steps,
+                  int height,
+                  int by_column,
+                  struct JobPart *part);
+
+int parallel_for(void *(*job_fn)(void *),
+                 void *jobs,
+                 size_t job_size,
+                 int count);
+
+int run_worker_batch(struct WorkerPool *pool,
+                     void *(*job_fn)(void *),
+                     void *jobs,
+                     size_t job_size,
+                     int count);
+
+int spawn_batch(void *(*job_fn)(void *),
+                void *jobs,
+                size_t job_size,
+                int count);
+
+void deal_batch_jobs(struct WorkBatch *batch,
+                     int num_deques);
+
+int run_batch_jobs(struct WorkBatch *batch,
+                   int deque,
+                   unsigned long *steals);
+
+int pop_job(struct JobDeque *deque);
+
+int steal_job(struct JobDeque *deque);
+
+void unqueue_batch(struct WorkerPool *pool,
+                   struct WorkBatch *batch);
+
+void *do_worker_pool_work(void *arg);
+
+// ---------
+// FUNCTIONS
+// ---------
+
+static struct WorkerPool *shared_worker_pool = NULL;
+static pthread_once_t shared_worker_pool_once = PTHREAD_ONCE_INIT;
+static int parallel_mode = PARALLEL_POOL;
+static int partition_mode = PARTITION_TILES;
+//what configure_worker_pool asked for, read when the shared pool starts
+static int shared_pool_workers = 0;
+static int *shared_pool_cpus = NULL;
+static int shared_pool_num_cpus = 0;
+static int shared_pool_started = 0;
+
+//creates a pool of num_workers threads, which wait for batches
+//with num_cpus cpus given, worker i is pinned to cpus[i % num_cpus], a cpu that can't
+//be set is counted in pin_failures and the worker left to run anywhere
+//returns NULL on memory error or if the threads can't be started
+struct WorkerPool *init_worker_pool(int num_workers,
+                                    int *cpus,
+                                    int num_cpus) {
+    struct WorkerPool *pool;
+    cpu_set_t set;
+    int i;
+
+    pool = calloc(sizeof(struct WorkerPool), 1);
+    if (!pool)
+        return NULL;
+    pool->workers = calloc(num_workers, sizeof(pthread_t));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    if (num_cpus > 0) {
+        pool->cpus = malloc(num_workers * sizeof(int));
+        if (!pool->cpus) {
+            free(pool->workers);
+            free(pool);
+            return NULL;
+        }
+        for (i = 0; i < num_workers; i++) {
+            pool->cpus[i] = cpus[i % num_cpus];
+        }
+    }
+    pool->num_workers = num_workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, do_worker_pool_work, pool) != 0) {
+            free_worker_pool(pool);
+            return NULL;
+        }
+        pool->started++;
+        if (pool->cpus) {
+            CPU_ZERO(&set);
+            CPU_SET(pool->cpus[i], &set);
+            if (pthread_setaffinity_np(pool->workers[i], sizeof(set), &set) != 0)
+                pool->pin_failures++;
+        }
+    }
+
+    return pool;
+}
+
+//stops the workers and frees the pool, no batch may be running
+void free_worker_pool(struct WorkerPool *pool) {
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->started; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->workers);
+    free(pool->cpus);
+    free(pool);
+}
+
+//starts the shared pool, MOTDEC_PARALLEL=spawn in the environment skips it and has
+//every batch create its own threads, and MOTDEC_PARTITION=bands or interleaved has
+//jobs split frames one per worker as they did before the tiles, to compare them
+void init_shared_worker_pool() {
+    char *mode;
+
+    mode = getenv("MOTDEC_PARALLEL");
+    if (mode && strcmp(mode, "spawn") == 0)
+        parallel_mode = PARALLEL_SPAWN;
+    mode = getenv("MOTDEC_PARTITION");
+    if (mode && strcmp(mode, "bands") == 0)
+        partition_mode = PARTITION_BANDS;
+    else if (mode && strcmp(mode, "interleaved") == 0)
+        partition_mode = PARTITION_INTERLEAVED;
+    shared_worker_pool = init_worker_pool(shared_pool_workers > 0 ? shared_pool_workers : default_worker_count(),
+                                          shared_pool_cpus, shared_pool_num_cpus);
+    shared_pool_started = 1;
+}
+
+//starts the shared pool with num_workers threads, 0 for one per online cpu, pinned to
+//the num_cpus cpus given, if any, or replaces it if a kernel has already started it
+//must be called before any other thread runs a kernel
+//returns 0 if the pool couldn't be started, kernels then start threads of their own
+int configure_worker_pool(int num_workers,
+                          int *cpus,
+                          int num_cpus) {
+    if (num_workers < 1)
+        num_workers = default_worker_count();
+    if (num_workers > MAX_WORKER_THREADS)
+        num_workers = MAX_WORKER_THREADS;
+
+    if (shared_pool_started) {
+        free_worker_pool(shared_worker_pool);
+        shared_worker_pool = init_worker_pool(num_workers, cpus, num_cpus);
+    } else {
+        shared_pool_workers = num_workers;
+        shared_pool_cpus = cpus;
+        shared_pool_num_cpus = num_cpus;
+        get_worker_pool();
+        //the pool keeps its own copy
+        shared_pool_cpus = NULL;
+        shared_pool_num_cpus = 0;
+    }
+    return shared_worker_pool != NULL;
+}
+
+//pins the calling thread to the cpus the pool's workers are not pinned to, threads
+//and processes it starts afterwards inherit them, so capture, recording and writing
+//stay off the kernel threads' cpus
+//returns 0 if the workers aren't pinned, leave no cpu free or it can't be set, the
+//thread is then left as it was
+int avoid_worker_cpus(struct WorkerPool *pool) {
+    cpu_set_t set;
+    int i;
+
+    if (!pool || !pool->cpus)
+        return 0;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return 0;
+    for (i = 0; i < pool->num_workers; i++) {
+        CPU_CLR(pool->cpus[i], &set);
+    }
+    if (CPU_COUNT(&set) == 0)
+        return 0;
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+//one worker per online cpu
+int default_worker_count() {
+    long n;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+        return 1;
+    return n < MAX_WORKER_THREADS ? n : MAX_WORKER_THREADS;
+}
+
+//the number of jobs kernels split their work into, one per worker
+int get_worker_count() {
+    struct WorkerPool *pool;
+
+    pool = get_worker_pool();
+    return pool ? pool->num_workers : default_worker_count();
+}
+
+//the pool every threaded kernel runs on, started on the first call
+//returns NULL if it couldn't be started
+struct WorkerPool *get_worker_pool() {
+    pthread_once(&shared_worker_pool_once, init_shared_worker_pool);
+    return shared_worker_pool;
+}
+
+//PARALLEL_POOL or PARALLEL_SPAWN
+int get_parallel_mode() {
+    get_worker_pool();
+    return parallel_mode;
+}
+
+//switches how batches are run, for comparing them
+void set_parallel_mode(int mode) {
+    get_worker_pool();
+    parallel_mode = mode;
+}
+
+//PARTITION_BANDS, PARTITION_INTERLEAVED or PARTITION_TILES
+int get_partition_mode() {
+    get_worker_pool();
+    return partition_mode;
+}
+
+//switches how frames are split into jobs, for comparing them
+void set_partition_mode(int mode) {
+    get_worker_pool();
+    partition_mode = mode;
+}
+
+//the name of a partition mode, for printing
+char *get_partition_name(int mode) {
+    switch (mode) {
+        case PARTITION_BANDS:
+            return "bands";
+        case PARTITION_INTERLEAVED:
+            return "interleaved";
+        default:
+            return "tiles";
+    }
+}
+
+//the number of jobs a kernel over a frame height rows high splits its work into
+//one per worker, or split into tiles, one per TILE_ROWS rows and at least one per
+//worker, so a worker done with its own can take tiles of one held up by a busy part
+//of the frame
+//threads created per job don't steal, so they are only ever given one job each
+int get_job_count(int height) {
+    int workers, tiles;
+
+    workers = get_worker_count();
+    if (partition_mode != PARTITION_TILES || parallel_mode == PARALLEL_SPAWN || !get_worker_pool())
+        return workers;
+
+    tiles = (height + TILE_ROWS - 1) / TILE_ROWS;
+    if (tiles < workers)
+        tiles = workers;
+    return tiles < MAX_BATCH_JOBS ? tiles : MAX_BATCH_JOBS;
+}
+
+//the part of a frame height rows high that job step of steps covers
+//a band of whole rows, so a job's writes share no cache lines with another's but at
+//the band's ends, and its reads run through memory in order, tiles are bands too
+//interleaved, jobs take columns in turn if by_column is set, else rows
+void get_job_part(int step,
+                  int steps,
+                  int height,
+                  int by_column,
+                  struct JobPart *part) {
+    if (partition_mode == PARTITION_INTERLEAVED) {
+        part->y0 = by_column ? 0 : step;
+        part->y1 = height;
+        part->ystep = by_column ? 1 : steps;
+        part->x0 = by_column ? step : 0;
+        part->xstep = by_column ? steps : 1;
+        return;
+    }
+    part->y0 = (int) ((long) height * step / steps);
+    part->y1 = (int) ((long) height * (step + 1) / steps);
+    part->ystep = 1;
+    part->x0 = 0;
+    part->xstep = 1;
+}
+
+//runs job_fn on each of the count jobs in the jobs array, at the same time, and
+//returns once they have all finished
+//runs on the shared pool, or on threads of its own if the pool is off or couldn't
+//be started
+//returns 0 if the jobs couldn't be run
+int parallel_for(void *(*job_fn)(void *),
+                 void *jobs,
+                 size_t job_size,
+                 int count) {
+    struct WorkerPool *pool;
+
+    pool = get_worker_pool();
+    if (!pool || parallel_mode == PARALLEL_SPAWN)
+        return spawn_batch(job_fn, jobs, job_size, count);
+    return run_worker_batch(pool, job_fn, jobs, job_size, count);
+}
+
+//queues the batch on pool and runs jobs from it until none are left to take, then
+//waits for the workers to finish theirs
+//with the workers pinned it only waits, the jobs stay on the pinned cpus
+//returns 1, a pool can always take a batch
+int run_worker_batch(struct WorkerPool *pool,
+                     void *(*job_fn)(void *),
+                     void *jobs,
+                     size_t job_size,
+                     int count) {
+    struct WorkBatch batch;
+    unsigned long steals;
+    int ran;
+
+    if (count < 1)
+        return 1;
+
+    batch.job_fn = job_fn;
+    batch.jobs = jobs;
+    batch.job_size = job_size;
+    batch.count = count;
+    batch.done = 0;
+    batch.active = 0;
+    batch.next_batch = NULL;
+    //the caller's deque is the last one
+    deal_batch_jobs(&batch, pool->cpus ? pool->num_workers : pool->num_workers + 1);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next_batch = &batch;
+    else
+        pool->head = &batch;
+    pool->tail = &batch;
+    pool->batches++;
+    pool->jobs += count;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    ran = 0;
+    steals = 0;
+    if (!pool->cpus)
+        ran = run_batch_jobs(&batch, pool->num_workers, &steals);
+
+    pthread_mutex_lock(&pool->lock);
+    //pinned, the workers take it off the queue once they've taken every job
+    if (!pool->cpus)
+        unqueue_batch(pool, &batch);
+    batch.done += ran;
+    pool->caller_jobs += ran;
+    pool->steals += steals;
+    while (batch.done < batch.count || batch.active > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return 1;
+}
+
+//the behaviour before the pool, a thread created and joined for every job
+//returns 0 if a thread can't be created or joined, any that were are still joined
+int spawn_batch(void *(*job_fn)(void *),
+                void *jobs,
+                size_t job_size,
+                int count) {
+    pthread_t threads[count > 0 ? count : 1];
+    int i, started, ok;
+
+    ok = 1;
+    for (started = 0; started < count; started++) {
+        if (pthread_create(&threads[started], NULL, job_fn, (char *) jobs + (size_t) started * job_size)) {
+            ok = 0;
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        if (pthread_join(threads[i], NULL))
+            ok = 0;
+    }
+    return ok;
+}
+
+//deals the batch's jobs out in order over num_deques deques, as evenly as they go
+void deal_batch_jobs(struct WorkBatch *batch,
+                     int num_deques) {
+    unsigned long long first, last;
+    int i;
+
+    batch->num_deques = num_deques;
+    for (i = 0; i < num_deques; i++) {
+        first = (unsigned long long) batch->count * i / num_deques;
+        last = (unsigned long long) batch->count * (i + 1) / num_deques;
+        atomic_init(&batch->deques[i].range, (last << 32) | first);
+    }
+}
+
+//runs jobs from the front of the batch's deque, then steals from the backs of the
+//others until every job has been taken, stolen jobs are added to steals
+//returns the number of jobs run
+int run_batch_jobs(struct WorkBatch *batch,
+                   int deque,
+                   unsigned long *steals) {
+    int i, job, ran;
+
+    ran = 0;
+    for (;;) {
+        job = pop_job(&batch->deques[deque]);
+        //the others are tried in turn from the next one, so thieves spread out
+        for (i = 1; job < 0 && i < batch->num_deques; i++) {
+            job = steal_job(&batch->deques[(deque + i) % batch->num_deques]);
+            if (job >= 0)
+                (*steals)++;
+        }
+        if (job < 0)
+            return ran;
+
+        batch->job_fn(batch->jobs + (size_t) job * batch->job_size);
+        ran++;
+    }
+}
+
+//takes the job at the front of deque
+//returns its index, or -1 if the deque is empty
+int pop_job(struct JobDeque *deque) {
+    unsigned long long range, first, last;
+
+    range = atomic_load(&deque->range);
+    do {
+        first = range & 0xffffffffULL;
+        last = range >> 32;
+        if (first >= last)
+            return -1;
+    } while (!atomic_compare_exchange_weak(&deque->range, &range, (last << 32) | (first + 1)));
+    return (int) first;
+}
+
+//takes the job at the back of deque, the one its owner would get to last
+//returns its index, or -1 if the deque is empty
+int steal_job(struct JobDeque *deque) {
+    unsigned long long range, first, last;
+
+    range = atomic_load(&deque->range);
+    do {
+        first = range & 0xffffffffULL;
+        last = range >> 32;
+        if (first >= last)
+            return -1;
+    } while (!atomic_compare_exchange_weak(&deque->range, &range, ((last - 1) << 32) | first));
+    return (int) (last - 1);
+}
+
+//takes batch off the queue, if it is still on it, once every job has been taken
+//a caller can finish its own batch while others are ahead of it
+//call with the lock held
+void unqueue_batch(struct WorkerPool *pool,
+                   struct WorkBatch *batch) {
+    struct WorkBatch *b, *prev;
+
+    prev = NULL;
+    for (b = pool->head; b && b != batch; b = b->next_batch) {
+        prev = b;
+    }
+    if (!b)
+        return;
+    if (prev)
+        prev->next_batch = b->next_batch;
+    else
+        pool->head = b->next_batch;
+    if (pool->tail == b)
+        pool->tail = prev;
+}
+
+//worker thread, runs jobs from the oldest batch until the pool stops
+void *do_worker_pool_work(void *arg) {
+    struct WorkerPool *pool = arg;
+    struct WorkBatch *batch;
+    unsigned long steals;
+    int id, ran;
+
+    pthread_mutex_lock(&pool->lock);
+    id = pool->next_worker_id++;
+    for (;;) {
+        while (!pool->stopping && !pool->head) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->stopping)
+            break;
+
+        batch = pool->head;
+        batch->active++;
+        pthread_mutex_unlock(&pool->lock);
+        steals = 0;
+        ran = run_batch_jobs(batch, id, &steals);
+        pthread_mutex_lock(&pool->lock);
+
+        //every job has been taken, so there's nothing left for anyone to find
+        unqueue_batch(pool, batch);
+        pool->steals += steals;
+        batch->done += ran;
+        //the batch is gone as soon as its caller sees it finished and left
+        if (--batch->active == 0 && batch->done == batch->count)
+            pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
@@ -1,9 +1,31 @@
 #include "lib/configuration.h"
+#include "lib/simdkern.h"
+#include "lib/workpool.h"
 #include "lib/bitmap.h"
+#include "lib/gray8.h"
+#include "lib/mask1.h"
 #include "lib/bitmap_thr.h"
+#include "lib/bmpmap.h"
+#include "lib/bufpool.h"
+#include "lib/heapstat.h"
 #include "lib/gmmodel.h"
 #include "lib/gmmodel_thr.h"
+#include "lib/lumamodel.h"
 #include "lib/entitydet.h"
+#include "lib/v4l2cap.h"
+#include "lib/ffmpegpipe.h"
+#include "lib/framering.h"
+#include "lib/replaysrc.h"
+#include "lib/synthsrc.h"
+#include "lib/framesrc.h"
+#include "lib/artwriter.h"
+#include "lib/recorder.h"
+#include "lib/shmpub.h"
+#include "lib/mjpegsrv.h"
+#include "lib/detpool.h"
+#include "lib/framesched.h"
+#include "lib/kernbench.h"
+#include "lib/simdtest.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,15 +36,96 @@
 #include <sys/wait.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
+
+//how long the detector waits for a frame before treating capture as failed
+#define CAPTURE_TIMEOUT_MS 10000
+//consecutive capture failures before the capture thread gives up
+#define CAPTURE_RETRIES 3
+//frames a camera detects on before its buffers are expected to all be pooled
+#define WARMUP_FRAMES 10
 
 //globals
 struct SysConfig *conf = NULL;
 int running = 1;
+struct ArtifactWriter *artwriter = NULL;
+struct BufferPool *bufpool = NULL;       //segmaps, shared by every camera
+struct DetectPool *pool = NULL;
+struct Camera *cameras = NULL;
+struct Camera **camera_args = NULL;   //pool task args, one per camera
+int num_cameras = 0;
+
+//time spent in each stage of the pipeline, for measuring throughput
+struct StageTimes {
+    unsigned long frames;   //frames through the detector
+    double start;           //monotonic time the detector started
+    double capture;         //seconds reading frames from the source
+    double segment;
+    double filter;
+    double count;
+    double update;
+};
+
+//a camera and everything the detector keeps for it
+//only its capture thread and the one pool worker stepping it touch it while running
+struct Camera {
+    int index;
+    char label[24];                 //prefix of its log lines, empty with one camera
+    struct SysConfig *conf;         //its own config, the global conf with one camera
+    struct FrameSource *source;
+    struct FrameRing *ring;
+    struct Recorder *recorder;
+    struct ShmPublisher *shmpub;
+    struct MjpegServer *mjpegsrv;
+    struct GaussianModel *model;
+    struct LumaModel *lmodel;
+    struct EntityFilter filter;
+    struct EntityStore *entstore;   //entities filtered from each frame, reused between frames
+    struct FrameScheduler *sched;   //which frames are detected on
+    struct Frame *pending;          //last frame detected on, with pipeline_update the model
+    struct Mask1 *pending_segmap;   //is updated with it and its segmap in the next frame's pass
+    pthread_t capture_tid;
+    int capture_thread_running;
+    int source_finished;
+    struct StageTimes stage_times;
+    pthread_mutex_t stats_lock;     //frames, events, latency and sched are read by the info file
+    unsigned long events;
+    double latency;                 //seconds from capture to decision, summed over frames
+    double max_latency;
+    unsigned long warmup_allocs;    //heap allocations detecting on the first WARMUP_FRAMES frames
+    unsigned long steady_allocs;    //and on quiet frames after them
+    unsigned long steady_frames;    //quiet frames, ones that logged nothing and saved nothing
+};
 
 //function declarations
 void handle_mot_det();
 
+void stop_mot_det();
+
+int init_cameras();
+
+int start_kernel_workers(struct SysConfig *config);
+
+int start_camera(struct Camera *cam);
+
+int take_camera_frame(struct Camera *cam,
+                      char *errstring);
+
+int train_camera(struct Camera *cam);
+
+void stop_camera(struct Camera *cam);
+
+void free_camera(struct Camera *cam);
+
+int camera_ready(void *arg);
+
+int detect_camera_frame(void *arg);
+
+void camera_shm_name(int index,
+                     char *name);
+
 void log_motion_event(char *timestamp,
+                      char *label,
                       long pixel_change_count,
                       double change_percent);
 
@@ -36,12 +139,21 @@ char *get_date_timestamp();
 
 char *get_time_timestamp();
 
-int capture_img(char *filename);
+int open_capture(struct Camera *cam);
+
+void close_capture(struct Camera *cam);
+
+int start_capture_thread(struct Camera *cam);
 
-int capture_video(char *filename);
+void stop_capture_thread(struct Camera *cam);
+
+void *do_capture(void *arg);
 
 void set_motdec_info(int running);
 
+int print_snapshot(char *what,
+                   int camera);
+
 void sighandler(int sig);
 
 // ---------
@@ -56,6 +168,10 @@ int main(int argc, char **argv) {
         puts("-- USAGE --");
         puts("start [cfg]      - Start the motion detection. Optional [cfg] for loading config");
         puts("set <name> <val> - Sets the system variable <name> to <val>.");
+        puts("snapshot <what>  - Write the live frame, segmap or stats of a running motdec to stdout.");
+        puts("bench [cfg] [n]  - Time the detection kernels on n synthetic frames.");
+        puts("scale [cfg] [n]  - Time the threaded kernels at 1 to 16 threads and both frame splits.");
+        puts("selftest [n]     - Check the simd kernels match the scalar ones on n random spans.");
         puts("help             - Display help message.");
         return 0;
     }
@@ -96,6 +212,8 @@ int main(int argc, char **argv) {
         //setup interrupt handler
         signal(SIGINT, sighandler);
         signal(SIGTERM, sighandler);
+        //a recording ffmpeg exiting early must not kill us
+        signal(SIGPIPE, SIG_IGN);
         
         //set info file and log start of program
         set_motdec_info(1);
@@ -172,6 +290,66 @@ int main(int argc, char **argv) {
             puts("Error: gmm_init_var must be 0 - 255");
         } else if (ret == 17) {
             puts("Error: gmm_min_var must be 0 - 255");
+        } else if (ret == 25) {
+            puts("Error: capture_mode must be 0 - 3");
+        } else if (ret == 26) {
+            puts("Error: ring_size must be 2 - 64");
+        } else if (ret == 27) {
+            puts("Error: ring_policy must be 0 - 2");
+        } else if (ret == 28) {
+            puts("Error: replay_path must be a directory or file");
+        } else if (ret == 29) {
+            puts("Error: replay_fps must be 0 - 255");
+        } else if (ret == 30) {
+            puts("Error: replay_loop must be 0 - 1");
+        } else if (ret == 31) {
+            puts("Error: synth_objects must be 0 - 255");
+        } else if (ret == 32) {
+            puts("Error: synth_noise must be 0 - 255");
+        } else if (ret == 33) {
+            puts("Error: synth_drift must be 0 - 255");
+        } else if (ret == 34) {
+            puts("Error: synth_frames must be >= 0");
+        } else if (ret == 35) {
+            puts("Error: record_length must be 1 - 255");
+        } else if (ret == 36) {
+            puts("Error: record_max_length must be 1 - 255");
+        } else if (ret == 37) {
+            puts("Error: max_recordings must be 1 - 16");
+        } else if (ret == 38) {
+            puts("Error: record_fps must be 1 - 60");
+        } else if (ret == 39) {
+            puts("Error: preroll_seconds must be 0 - 30");
+        } else if (ret == 40) {
+            puts("Error: artifact_queue must be 1 - 255");
+        } else if (ret == 41) {
+            puts("Error: luma_only must be 0 - 1");
+        } else if (ret == 42) {
+            puts("Error: stream_port must be 0 - 65535");
+        } else if (ret == 43) {
+            puts("Error: stream_quality must be 1 - 100");
+        } else if (ret == 44) {
+            puts("Error: cameras must be a comma separated list of config files");
+        } else if (ret == 45) {
+            puts("Error: detect_workers must be 0 - 64");
+        } else if (ret == 46) {
+            puts("Error: target_fps must be 0 - 255");
+        } else if (ret == 47) {
+            puts("Error: max_latency_ms must be 0 - 60000");
+        } else if (ret == 48) {
+            puts("Error: idle_fps must be 0 - 255");
+        } else if (ret == 49) {
+            puts("Error: idle_seconds must be 1 - 255");
+        } else if (ret == 50) {
+            puts("Error: mapped_io must be 0 - 1");
+        } else if (ret == 51) {
+            puts("Error: kernel_threads must be 0 - 64");
+        } else if (ret == 52) {
+            puts("Error: kernel_cpus must be a comma separated list of cpus or ranges, as 0,2 or 0-3");
+        } else if (ret == 53) {
+            puts("Error: pipeline_update must be 0 - 1");
+        } else if (ret == 54) {
+            puts("Error: stream_public must be 0 - 1");
         }
         
         //save config
@@ -182,16 +360,98 @@ int main(int argc, char **argv) {
         
         return 0;
     } 
+    //snapshot
+    else if (strstr(command, "snapshot") != NULL) {
+        if (argc < 3) {
+            puts("Error: expected 1 argument for 'snapshot'");
+            puts("Usage: snapshot <frame|segmap|stats> [camera]");
+            return 1;
+        }
+        return print_snapshot(argv[2], argc > 3 ? atoi(argv[3]) : 0) ? 0 : 1;
+    }
+    //bench
+    else if (strstr(command, "bench") != NULL) {
+        struct SysConfig *config;
+        char *cfgpath = "cfg/default.cfg";
+        int frames = 100;
+        
+        if (argc > 2 && is_valid_file(argv[2]))
+            cfgpath = argv[2];
+        if (argc > 3)
+            frames = atoi(argv[3]);
+        
+        config = malloc(sizeof(struct SysConfig));
+        if (!config || load_config(config, cfgpath) != 0) {
+            printf("Error: could not load %s\n", cfgpath);
+            return 1;
+        }
+        if (!start_kernel_workers(config))
+            puts("Error: could not start the kernel threads, each kernel call starts its own.");
+        if (!run_kernel_bench(config, frames)) {
+            puts("Error: could not run the benchmark, check the resolution.");
+            return 1;
+        }
+        return 0;
+    }
+    //scale
+    else if (strstr(command, "scale") != NULL) {
+        struct SysConfig *config;
+        char *cfgpath = "cfg/default.cfg";
+        int frames = 20;
+        
+        if (argc > 2 && is_valid_file(argv[2]))
+            cfgpath = argv[2];
+        if (argc > 3)
+            frames = atoi(argv[3]);
+        
+        config = malloc(sizeof(struct SysConfig));
+        if (!config || load_config(config, cfgpath) != 0) {
+            printf("Error: could not load %s\n", cfgpath);
+            return 1;
+        }
+        if (!run_scaling_bench(config, frames)) {
+            puts("Error: could not run the benchmark, check the resolution.");
+            return 1;
+        }
+        return 0;
+    }
+    //selftest
+    else if (strstr(command, "selftest") != NULL) {
+        int rounds = 4000;
+        
+        if (argc > 2)
+            rounds = atoi(argv[2]);
+        if (!run_simd_selftest(rounds)) {
+            puts("Error: the simd kernels don't match the scalar ones.");
+            return 1;
+        }
+        return 0;
+    }
     //help
     else if (strstr(command, "help") != NULL) {
         puts("\n-- USAGE --");
         puts("start            - Start the motion detection.");
         puts("set <name> <val> - Sets the system variable <name> to <val>.");
+        puts("snapshot <what> [camera]");
+        puts("                 - Write the live 'frame' or 'segmap' (BMP) or 'stats' (XML) of a camera,");
+        puts("                   the first by default, to stdout.");
+        puts("bench [cfg] [n]  - Time each detection kernel on n (default 100) synthetic frames at the");
+        puts("                   resolution, model and synth settings of the config, without a camera.");
+        puts("                   MOTDEC_SIMD=scalar, sse2, avx2 or avx512 in the environment picks the");
+        puts("                   pixel kernels, instead of the widest the cpu supports.");
+        puts("scale [cfg] [n]  - Time the threaded kernels on n (default 20) synthetic frames at 1, 2,");
+        puts("                   4, 8 and 16 threads, with frames split into row bands, interleaved and");
+        puts("                   into tiles the threads steal from each other. MOTDEC_PARTITION=bands or");
+        puts("                   interleaved in the environment splits frames one job per thread in");
+        puts("                   every command, instead of into tiles.");
+        puts("selftest [n]     - Check every simd kernel set the cpu runs gives the same bytes as the");
+        puts("                   scalar kernels, on n (default 4000) spans of random length, offset and");
+        puts("                   threshold. Exits 1 on any difference. Also run by 'make check'.");
         puts("help             - Display this message.");
         puts("\n-- INFO --");
         puts("Program that logs motion events tracked through a webcam.");
-        puts("The program takes images using a shell script 'img_capture.sh'.");
-        puts("You can edit this file to change how the picture is taken.");
+        puts("Frames are streamed from the video device by ffmpeg or directly through v4l2,");
+        puts("or replayed from disk or generated so detection can be measured without a camera.");
         puts("Event statistics are logged in the default 'log.txt' file.");
         puts("The 'logs/' directory stores the images captured for each event.");
         puts("\n-- SYSTEM VARIABLES --");
@@ -230,6 +490,83 @@ int main(int argc, char **argv) {
         puts("  - the initial variance to set each gaussian distribution to.");
         puts(" gmm_min_var (0 - 255) [gmv]");
         puts("  - the minimum variance that each distribution can have.");
+        puts(" capture_mode (0 - 3) [capm]");
+        puts("  - frame source, 0 streams raw frames from one ffmpeg process, 1 streams from the device with v4l2,");
+        puts("    2 replays a recording from replay_path, 3 generates a synthetic scene at the configured resolution.");
+        puts("    v4l2 can be tried without a camera using the vivid virtual driver (modprobe vivid).");
+        puts(" ring_size (2 - 64) [rsz]");
+        puts("  - number of captured frames that can wait for the detector.");
+        puts(" ring_policy (0 - 2) [rpol]");
+        puts("  - what to do when the detector falls behind, 0 drops the oldest frame, 1 drops the newest, 2 pauses capture.");
+        puts(" replay_path (path to directory or file) [rpth]");
+        puts("  - recording replayed when capture_mode is 2. A directory of equally sized 24 bit BMPs, played in");
+        puts("    name order, or a raw file of top-down bgr24 frames at the configured resolution.");
+        puts(" replay_fps (0 - 255) [rfps]");
+        puts("  - replay frame rate, 0 replays as fast as the detector can take frames.");
+        puts(" replay_loop (0 - 1) [rlp]");
+        puts("  - start the replay again when it ends instead of stopping.");
+        puts(" synth_objects (0 - 255) [sobj]");
+        puts("  - number of rectangles and blobs moving over the synthetic scene.");
+        puts(" synth_noise (0 - 255) [snoi]");
+        puts("  - largest noise added to each channel of a synthetic frame.");
+        puts(" synth_drift (0 - 255) [sdrf]");
+        puts("  - largest change in brightness as the synthetic lighting drifts.");
+        puts(" synth_frames (>= 0) [sfrm]");
+        puts("  - number of synthetic frames to generate before stopping, 0 for no limit.");
+        puts(" record_length (1 - 255) [rlen]");
+        puts("  - seconds of video recorded after a motion event.");
+        puts(" record_max_length (1 - 255) [rmax]");
+        puts("  - events during a recording extend it, up to this many seconds in total.");
+        puts(" max_recordings (1 - 16) [mrec]");
+        puts("  - number of clips that can be recording at the same time.");
+        puts(" record_fps (1 - 60) [recf]");
+        puts("  - frame rate of recorded clips.");
+        puts(" preroll_seconds (0 - 30) [prs]");
+        puts("  - seconds of video from before a motion event kept in memory and put at the start of its clip.");
+        puts(" artifact_queue (1 - 255) [artq]");
+        puts("  - event images that can wait to be written, further images are dropped until there is room.");
+        puts(" luma_only (0 - 1) [luma]");
+        puts("  - detect on the 8 bit luma of each frame with a one channel model instead of on bgr.");
+        puts("    Cameras deliver luma without colour conversion, event images and clips are greyscale.");
+        puts(" stream_port (0 - 65535) [sprt]");
+        puts("  - port an mjpeg live stream is served on, 0 for no stream. Only to this machine,");
+        puts("    unless stream_public is set.");
+        puts("    /stream has the frames, /segmap has the segmentation map drawn over them.");
+        puts(" stream_quality (1 - 100) [sqty]");
+        puts("  - jpeg quality of the live stream.");
+        puts(" stream_public (0 - 1) [spub]");
+        puts("  - serve the live stream on every network interface. It has no authentication, anyone");
+        puts("    who can reach the port can watch the camera.");
+        puts(" cameras (comma separated config files) [cams]");
+        puts("  - run several cameras in one motdec, each with the source, model, filter, thresholds,");
+        puts("    recording and stream set in its own config file. Logging and workers come from this one.");
+        puts("    Empty for the single camera set up in this file.");
+        puts(" detect_workers (0 - 64) [dwk]");
+        puts("  - threads the cameras' detection is shared across, 0 for one per online cpu.");
+        puts(" target_fps (0 - 255) [tfps]");
+        puts("  - frames detected on per second, others are dropped. 0 detects on every frame.");
+        puts(" max_latency_ms (0 - 60000) [mlat]");
+        puts("  - longest from capture to decision. Frames that would miss it are dropped for newer ones");
+        puts("    and frames that still miss it are counted. 0 for no limit.");
+        puts(" idle_fps (0 - 255) [ifps]");
+        puts("  - frames detected on per second while the scene is static, 0 to keep the full rate.");
+        puts(" idle_seconds (1 - 255) [idls]");
+        puts("  - seconds without change before the scene is static.");
+        puts(" mapped_io (0 - 1) [mio]");
+        puts("  - replay a raw recording and write event images through memory mapped files instead of stdio.");
+        puts("    Replayed BMP directories are always read with stdio, each file is copied into a frame");
+        puts("    either way and mapping them one by one is slower.");
+        puts(" kernel_threads (0 - 64) [kthr]");
+        puts("  - threads each segmentation and model update is split across, 0 for one per online cpu.");
+        puts(" kernel_cpus (comma separated cpus or ranges) [kcpu]");
+        puts("  - cpus the kernel threads are pinned to, as 0,2 or 0-3, so detection can be kept off");
+        puts("    the cores recording runs on. Capture, detection, recording, the stream and the image");
+        puts("    writer, and the ffmpeg they start, then run on the other cpus, or on any if the list");
+        puts("    has them all. Empty to let every thread run on any.");
+        puts(" pipeline_update (0 - 1) [pipe]");
+        puts("  - update the model with each frame in the same pass over it that segments the next,");
+        puts("    so the motion decision doesn't wait for the update. Each frame is still segmented");
+        puts("    against the model updated with every frame before it.");
         puts("\nUse 'set' and the name or abbreviation of a variable to change the value.");
         puts("Values given must be in the range specified above.");
         puts(" -- -- --\n");
@@ -240,300 +577,883 @@ int main(int argc, char **argv) {
 }
 
 //loop for image capture and motion detection
+//every camera is captured on its own thread and detected on the shared worker pool
 void handle_mot_det() {
-    struct GaussianModel *model;
-    struct EntityFilter filter;
-    struct BMP *bg, *change, *segmap, *black;
-    int i;
-    unsigned int imgw, imgh;
-    
-    //get filter from config
-    filter = get_config_filter(conf);
-    
-    //create motdecimg.bmp file in tmp
-    //capture call only overwrites image
-    FILE *fp = fopen("/tmp/motdecimg.bmp", "ab+");
-    if (fp) fclose(fp);
-    
-    //take initial base image
-    if (capture_img("/tmp/motdecimg.bmp") != 0) {
-        log_error("Error: Error capturing image.");
-        free_gaussian_model(model);
-        log_event("Stopping motdec...");
-        set_motdec_info(0);
+    struct Camera *cam;
+    char buffer[255];
+    double info_time;
+    int i, live, workers;
+
+    //training runs the kernels, so their threads are set up first
+    if (!start_kernel_workers(conf)) {
+        log_error("Error: Unable to start kernel threads, each kernel call starts its own.");
+    } else if (get_worker_pool()->pin_failures > 0) {
+        sprintf(buffer, "Error: %d of %d kernel threads could not be pinned to %s.",
+                get_worker_pool()->pin_failures, get_worker_pool()->num_workers, conf->kernel_cpus);
+        log_error(buffer);
+    } else if (get_worker_pool()->cpus) {
+        //every thread started from here on, and ffmpeg, gets the cpus left over
+        if (avoid_worker_cpus(get_worker_pool()))
+            snprintf(buffer, sizeof(buffer), "Kernel threads pinned to %s, capture, recording and writing kept off them.",
+                     conf->kernel_cpus);
+        else
+            snprintf(buffer, sizeof(buffer), "Kernel threads pinned to %s, which leaves no cpu for capture and recording.",
+                     conf->kernel_cpus);
+        log_event(buffer);
+    }
+
+    //load the camera list, one camera from conf if there is no list
+    if (!init_cameras()) {
+        stop_mot_det();
         return;
     }
-    
-    sleep(1);
-    
-    //take initial base image again
-    if (capture_img("/tmp/motdecimg.bmp") != 0) {
-        log_error("Error: Error capturing image.");
-        free_gaussian_model(model);
-        log_event("Stopping motdec...");
-        set_motdec_info(0);
+
+    //the pool is made before capture starts so capture threads can wake it
+    workers = conf->detect_workers;
+    if (workers == 0)
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    //a camera is only ever stepped by one worker, more would sit idle
+    if (workers > num_cameras)
+        workers = num_cameras;
+    if (workers < 1)
+        workers = 1;
+    pool = init_detect_pool(workers, num_cameras, (void **) camera_args,
+                            camera_ready, detect_camera_frame);
+    if (!pool) {
+        log_error("Error: Unable to create detection pool.");
+        stop_mot_det();
         return;
     }
-    
+
+    //open every camera and take an initial base image from each
+    live = 0;
+    for (i = 0; i < num_cameras; i++) {
+        if (!start_camera(&cameras[i])) {
+            stop_mot_det();
+            return;
+        }
+        live |= cameras[i].source->live;
+    }
+
+    //give the cameras time to settle their exposure
+    if (live)
+        sleep(1);
+
+    //take initial base image again
+    for (i = 0; i < num_cameras; i++) {
+        cam = &cameras[i];
+        if (!take_camera_frame(cam, "Error: Error capturing image."))  {
+            stop_mot_det();
+            return;
+        }
+    }
+
     puts("\nTraining model on background scene...");
     puts("Keep scene free from foreground objects.\n");
-    
-    sleep(3);
-    
-    //load base image to init model
-    bg = load_BMP("/tmp/motdecimg.bmp");
-    if (!bg) {
-        log_error("Error: Unable to load base image.");
-        free_gaussian_model(model);
-        log_event("Stopping motdec...");
-        set_motdec_info(0);
+
+    if (live) {
+        sleep(3);
+        //frames waiting in the rings are from before the sleep
+        for (i = 0; i < num_cameras; i++) {
+            ring_flush(cameras[i].ring);
+        }
+    }
+
+    for (i = 0; i < num_cameras; i++) {
+        if (!train_camera(&cameras[i])) {
+            stop_mot_det();
+            return;
+        }
+    }
+
+    puts("Training complete, system is now active.");
+
+    info_time = get_monotonic_time();
+    for (i = 0; i < num_cameras; i++) {
+        cameras[i].stage_times.start = info_time;
+    }
+
+    if (!start_detect_pool(pool)) {
+        log_error("Error: Unable to start detection workers.");
+        stop_mot_det();
         return;
     }
+    sprintf(buffer, "Detecting on %d camera%s with %d worker%s",
+            num_cameras, num_cameras == 1 ? "" : "s", workers, workers == 1 ? "" : "s");
+    log_event(buffer);
+    sprintf(buffer, "Pixel kernels: %s", get_pixel_kernels()->name);
+    log_event(buffer);
+
+    //workers run until every source has finished or we are stopped
+    while (running && !wait_detect_pool(pool, 100)) {
+        //refresh capture counters in the info file once a second
+        if (get_monotonic_time() - info_time >= 1.0) {
+            set_motdec_info(1);
+            info_time = get_monotonic_time();
+        }
+    }
+
+    stop_mot_det();
+}
+
+//stops the pool and every camera, frees everything handle_mot_det created and logs the stop
+void stop_mot_det() {
+    struct PoolTask *task;
+    struct WorkerPool *workers;
+    char buffer[255];
+    int i;
+
+    //workers finish the frame they are on
+    if (pool)
+        stop_detect_pool(pool);
+
+    for (i = 0; i < num_cameras; i++) {
+        stop_camera(&cameras[i]);
+    }
+
+    //write out any event images still queued
+    if (artwriter) {
+        stop_artifact_writer(artwriter);
+        sprintf(buffer, "Artifacts written: %lu | Dropped: %lu | Failed: %lu | Peak queue: %d/%d | Slowest write: %.1fms",
+                artwriter->written, artwriter->dropped, artwriter->failed,
+                artwriter->peak_count, artwriter->capacity, artwriter->max_write_time * 1000.0);
+        log_event(buffer);
+        free_artifact_writer(artwriter);
+        artwriter = NULL;
+    }
+
+    for (i = 0; i < num_cameras; i++) {
+        //worker time shows how fairly the pool shared itself out
+        if (pool && num_cameras > 1 && pool->tasks[i].steps > 0) {
+            task = &pool->tasks[i];
+            sprintf(buffer, "%sWorker time: %.2fs over %lu frames",
+                    cameras[i].label, task->run_time, task->steps);
+            log_event(buffer);
+        }
+        free_camera(&cameras[i]);
+    }
+    free(cameras);
+    free(camera_args);
+    cameras = NULL;
+    camera_args = NULL;
+    num_cameras = 0;
+
+    //buffers only get allocated while the pool warms up or when more are in use at once
+    if (bufpool) {
+        sprintf(buffer, "Buffer pool | Buffers allocated: %lu | Taken: %lu | Peak in use: %lu",
+                bufpool->allocations, bufpool->gets, bufpool->peak_outstanding);
+        log_event(buffer);
+        free_buffer_pool(bufpool);
+        bufpool = NULL;
+    }
+
+    //the kernels' workers stay up for the life of the process, each batch is one
+    //threaded kernel call
+    workers = get_worker_pool();
+    if (workers && get_parallel_mode() == PARALLEL_POOL) {
+        sprintf(buffer, "Worker pool | Workers: %d | Batches: %lu | Jobs: %lu | Run by callers: %lu | Stolen: %lu",
+                workers->num_workers, workers->batches, workers->jobs, workers->caller_jobs,
+                workers->steals);
+        log_event(buffer);
+    }
+
+    free_detect_pool(pool);
+    pool = NULL;
+
+    log_event("Stopping motdec...");
+    set_motdec_info(0);
+}
+
+//starts the threads the kernels are split across, as many as kernel_threads asks for
+//and pinned to kernel_cpus
+//returns 0 if they couldn't be started
+int start_kernel_workers(struct SysConfig *config) {
+    int cpus[MAX_WORKER_THREADS];
+    int num_cpus;
+
+    //workers past the end of the list wrap round it, so longer lists are cut short
+    num_cpus = parse_cpu_list(config->kernel_cpus, cpus, MAX_WORKER_THREADS);
+    if (num_cpus < 0)
+        num_cpus = 0;
+    if (num_cpus > MAX_WORKER_THREADS)
+        num_cpus = MAX_WORKER_THREADS;
+    return configure_worker_pool(config->kernel_threads, cpus, num_cpus);
+}
+
+//creates the cameras, from the config files listed in cameras or from conf alone
+//returns 1 on success
+int init_cameras() {
+    struct SysConfig *cfg;
+    char buffer[255], path[200];
+    char *start, *end;
+    int i, n, len, eno;
+
+    //one camera per entry in the list
+    n = 1;
+    for (start = conf->cameras; *start; start++) {
+        n += *start == ',';
+    }
+
+    cameras = calloc(n, sizeof(struct Camera));
+    camera_args = calloc(n, sizeof(struct Camera *));
+    if (!cameras || !camera_args) {
+        log_error("Error: Unable to allocate cameras.");
+        return 0;
+    }
+
+    //artifact writer is shared by every camera
+    artwriter = init_artifact_writer(conf->artifact_queue, conf->mapped_io);
+    if (!artwriter) {
+        log_error("Error: Unable to start artifact writer.");
+        return 0;
+    }
+
+    //as is the buffer pool, cameras of the same size reuse each other's buffers
+    bufpool = init_buffer_pool();
+    if (!bufpool) {
+        log_error("Error: Unable to allocate buffer pool.");
+        return 0;
+    }
+
+    start = conf->cameras;
+    for (i = 0; i < n; i++) {
+        cameras[i].index = i;
+        camera_args[i] = &cameras[i];
+        pthread_mutex_init(&cameras[i].stats_lock, NULL);
+        num_cameras++;
+
+        if (conf->cameras[0] == '\0') {
+            cameras[i].conf = conf;
+            continue;
+        }
+
+        //each listed file is a full config, its logging variables are unused
+        sprintf(cameras[i].label, "cam %d | ", i);
+        end = strchr(start, ',');
+        len = end ? end - start : (int) strlen(start);
+        if (len >= (int) sizeof(path))
+            len = sizeof(path) - 1;
+        memcpy(path, start, len);
+        path[len] = '\0';
+        start = end ? end + 1 : start + len;
+
+        cfg = malloc(sizeof(struct SysConfig));
+        if (!cfg) {
+            log_error("Error: Unable to allocate camera config.");
+            return 0;
+        }
+        if ((eno = load_config(cfg, path)) != 0) {
+            free(cfg);
+            snprintf(buffer, sizeof(buffer), "Error (%d): could not load camera config %s.", eno, path);
+            log_error(buffer);
+            return 0;
+        }
+        cameras[i].conf = cfg;
+        snprintf(buffer, sizeof(buffer), "%sLoaded config: %s", cameras[i].label, path);
+        log_event(buffer);
+    }
+
+    return 1;
+}
+
+//opens the camera's source, ring, live view and recorder, starts capture and takes
+//an initial base image
+//returns 1 on success
+int start_camera(struct Camera *cam) {
+    struct SysConfig *cc = cam->conf;
+    char buffer[255], shm_name[64];
+    unsigned int imgw, imgh;
+
+    //get filter from config
+    cam->filter = get_config_filter(cc);
+    if (cc->do_ent_filtering) {
+        cam->entstore = init_entity_store();
+        if (!cam->entstore) {
+            sprintf(buffer, "%sError: Unable to create entity store.", cam->label);
+            log_error(buffer);
+            return 0;
+        }
+    }
     
-    imgw = bg->image_header->width;
-    imgh = bg->image_header->height;
-    
-    //init gaussian model with base image
-    model = init_gaussian_model(bg, 
-                                conf->gmm_k_val,
-                                conf->gmm_t_val,
-                                conf->gmm_alpha,
-                                conf->gmm_init_var,
-                                conf->gmm_min_var);
-    
-    free_BMP(bg);
-    
+    //frames are dropped to keep to the detection rate and latency budget
+    cam->sched = init_frame_scheduler(cc->target_fps, cc->idle_fps, cc->idle_seconds,
+                                      cc->max_latency_ms, cc->change_percent_threshold);
+    if (!cam->sched) {
+        sprintf(buffer, "%sError: Unable to create frame scheduler.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
+    //open capture device, stays open for the life of the loop
+    if (!open_capture(cam)) {
+        sprintf(buffer, "%sError: Unable to open capture device.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
+    imgw = cam->source->width;
+    imgh = cam->source->height;
+
+    //preallocate the frames shared between the capture and detection threads
+    //recordings are never dropped from, so replays are repeatable
+    cam->ring = init_frame_ring(cc->ring_size,
+                                cam->source->live ? cc->ring_policy : RING_BLOCK,
+                                imgw, imgh, cc->luma_only,
+                                cc->pipeline_update ? 2 : 1);
+    if (!cam->ring) {
+        sprintf(buffer, "%sError: Unable to allocate frame ring.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
+    //live frame, segmap and stats for the web interface, the view is optional
+    camera_shm_name(cam->index, shm_name);
+    cam->shmpub = open_shm_publisher(shm_name, imgw, imgh);
+    if (!cam->shmpub) {
+        sprintf(buffer, "%sError: Unable to create shared memory, live view is unavailable.", cam->label);
+        log_error(buffer);
+    }
+
+    //the stream is encoded from the shared memory snapshots, on the server's threads
+    if (cc->stream_port > 0) {
+        if (cam->shmpub)
+            cam->mjpegsrv = init_mjpeg_server(cc->stream_port, cc->stream_quality,
+                                              cc->stream_public, cam->shmpub);
+        if (cam->mjpegsrv) {
+            sprintf(buffer, "%sServing live stream on %s port %d", cam->label,
+                    cc->stream_public ? "every interface," : "this machine only,", cc->stream_port);
+            log_event(buffer);
+        } else {
+            sprintf(buffer, "%sError: Unable to serve live stream on port %d.", cam->label, cc->stream_port);
+            log_error(buffer);
+        }
+    }
+
+    //event clips are recorded from the captured frames
+    cam->recorder = init_recorder(cc->ffmpeg_path, imgw, imgh,
+                                  cc->record_fps,
+                                  cc->record_length,
+                                  cc->record_max_length,
+                                  cc->max_recordings,
+                                  cc->preroll_seconds,
+                                  cc->luma_only);
+    if (!cam->recorder) {
+        sprintf(buffer, "%sError: Unable to create recorder.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+    sprintf(buffer, "%sRecorder memory: %.1f MB (%d pre-roll frames)", cam->label,
+            recorder_memory(cam->recorder) / (1024.0 * 1024.0), cam->recorder->preroll_count);
+    log_event(buffer);
+
+    //capture runs on its own thread from here on
+    if (!start_capture_thread(cam)) {
+        sprintf(buffer, "%sError: Unable to start capture thread.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
+    //take initial base image
+    return take_camera_frame(cam, "Error: Error capturing image.");
+}
+
+//takes a frame from the camera and hands it straight back, logging errstring if
+//none arrives
+//returns 1 on success
+int take_camera_frame(struct Camera *cam,
+                      char *errstring) {
+    struct Frame *frame;
+    char buffer[255];
+
+    if (!(frame = ring_acquire_read(cam->ring, CAPTURE_TIMEOUT_MS))) {
+        sprintf(buffer, "%s%s", cam->label, errstring);
+        log_error(buffer);
+        return 0;
+    }
+    ring_release_read(cam->ring, frame);
+    return 1;
+}
+
+//creates the camera's background model from its next frame and trains it on 10 more
+//returns 1 on success
+int train_camera(struct Camera *cam) {
+    struct SysConfig *cc = cam->conf;
+    struct Frame *frame;
+    struct BMP *black;
+    struct Gray8 *lblack;
+    char buffer[255];
+    int i, ok;
+
+    //capture base image to init model
+    frame = ring_acquire_read(cam->ring, CAPTURE_TIMEOUT_MS);
+    if (!frame) {
+        sprintf(buffer, "%sError: Unable to load base image.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
+    //init gaussian model with base image, one channel if only luma is captured
+    if (cc->luma_only) {
+        cam->lmodel = init_luma_model(frame->luma,
+                                      cc->gmm_k_val,
+                                      cc->gmm_t_val,
+                                      cc->gmm_alpha,
+                                      cc->gmm_init_var,
+                                      cc->gmm_min_var);
+    } else {
+        cam->model = init_gaussian_model(frame->img,
+                                         cc->gmm_k_val,
+                                         cc->gmm_t_val,
+                                         cc->gmm_alpha,
+                                         cc->gmm_init_var,
+                                         cc->gmm_min_var);
+    }
+
+    ring_release_read(cam->ring, frame);
+
+    if (!cam->model && !cam->lmodel) {
+        sprintf(buffer, "%sError: Unable to create background model.", cam->label);
+        log_error(buffer);
+        return 0;
+    }
+
     //create black image for use as segmap in training
-    black = init_BMP(imgw, imgh);
-    
-    
+    black = NULL;
+    lblack = NULL;
+    if (cc->luma_only)
+        lblack = init_gray8(cam->source->width, cam->source->height);
+    else
+        black = init_BMP(cam->source->width, cam->source->height);
+
     //train model for 10 frames
+    ok = 1;
     for (i = 0; i < 10; i++) {
-        //take initial base image
-        if (capture_img("/tmp/motdecimg.bmp") != 0) {
-            log_error("Error: Error capturing image.");
-            free_gaussian_model(model);
-            log_event("Stopping motdec...");
-            set_motdec_info(0);
-            return;
-        }
-        
-        //load base image to init model
-        bg = load_BMP("/tmp/motdecimg.bmp");
-        if (!bg) {
-            log_error("Error: Unable to load base image.");
-            free_gaussian_model(model);
-            log_event("Stopping motdec...");
-            set_motdec_info(0);
-            return;
+        //capture training image
+        frame = ring_acquire_read(cam->ring, CAPTURE_TIMEOUT_MS);
+        if (!frame) {
+            sprintf(buffer, "%sError: Unable to load base image.", cam->label);
+            log_error(buffer);
+            ok = 0;
+            break;
         }
-        
+
         //update and normalise
-        update_gaussian_model_thr(model, bg, black);
-        normalize_priors_thr(model);
-        printf("Training: %d\%\n", i*10);
-        
-        free(bg);
+        if (cc->luma_only) {
+            update_luma_model_thr(cam->lmodel, frame->luma, lblack);
+        } else {
+            update_gaussian_model_thr(cam->model, frame->img, black);
+            normalize_priors_thr(cam->model);
+        }
+        printf("%sTraining: %d\%\n", cam->label, i*10);
+
+        ring_release_read(cam->ring, frame);
+    }
+
+    if (black)
+        free_BMP(black);
+    free_gray8(lblack);
+
+    return ok;
+}
+
+//stops the camera's capture and live view, the models and recorder stay until freed
+void stop_camera(struct Camera *cam) {
+    char buffer[255];
+
+    stop_capture_thread(cam);
+    close_capture(cam);
+
+    //the stream reads the shared memory, stop it first
+    if (cam->mjpegsrv) {
+        stop_mjpeg_server(cam->mjpegsrv);
+        sprintf(buffer, "%sStream frames encoded: %lu (%.2fms avg) | Sent: %lu | Peak viewers: %d | Refused: %lu",
+                cam->label, cam->mjpegsrv->encoded,
+                cam->mjpegsrv->encoded > 0 ? cam->mjpegsrv->encode_time * 1000.0 / cam->mjpegsrv->encoded : 0.0,
+                cam->mjpegsrv->sent, cam->mjpegsrv->peak_viewers, cam->mjpegsrv->refused);
+        log_event(buffer);
+        free_mjpeg_server(cam->mjpegsrv);
+        cam->mjpegsrv = NULL;
+    }
+
+    close_shm_publisher(cam->shmpub);
+    cam->shmpub = NULL;
+}
+
+//finishes the camera's clips, logs its stats and frees it, call after stop_camera
+void free_camera(struct Camera *cam) {
+    struct StageTimes *st = &cam->stage_times;
+    struct FrameRingStats stats;
+    char buffer[255];
+    double elapsed, n;
+
+    //finish any clips still recording
+    if (cam->recorder) {
+        sprintf(buffer, "%sRecordings started: %lu | Extended: %lu | Rejected: %lu", cam->label,
+                cam->recorder->started, cam->recorder->extended, cam->recorder->rejected);
+        log_event(buffer);
+        free_recorder(cam->recorder);
+        cam->recorder = NULL;
+    }
+
+    //the last frame's update is never needed, the model is freed below
+    if (cam->pending) {
+        pool_put_mask1(bufpool, cam->pending_segmap);
+        ring_release_read(cam->ring, cam->pending);
+        cam->pending = NULL;
+        cam->pending_segmap = NULL;
+    }
+
+    if (cam->ring) {
+        stats = get_ring_stats(cam->ring);
+        sprintf(buffer, "%sFrames captured: %lu | Dropped: %lu | Peak ring occupancy: %d/%d", cam->label,
+                stats.captured, stats.dropped, stats.peak_occupancy, cam->ring->size);
+        log_event(buffer);
+        if (stats.captured > 0)
+            st->capture /= stats.captured;
+        free_frame_ring(cam->ring);
+        cam->ring = NULL;
+    }
+
+    //throughput and per stage cost, in ms per frame
+    if (st->frames > 0) {
+        elapsed = get_monotonic_time() - st->start;
+        n = (double) st->frames;
+        sprintf(buffer, "%sFrames processed: %lu in %.2fs (%.2f fps)", cam->label,
+                st->frames, elapsed, n / elapsed);
+        log_event(buffer);
+        sprintf(buffer, "%sStage ms per frame | capture: %.3f %s: %.3f filter: %.3f count: %.3f update: %.3f",
+                cam->label,
+                st->capture * 1000.0,
+                cam->conf->pipeline_update ? "segment+update" : "segment",
+                st->segment * 1000.0 / n,
+                st->filter * 1000.0 / n,
+                st->count * 1000.0 / n,
+                st->update * 1000.0 / n);
+        log_event(buffer);
+        sprintf(buffer, "%sCapture to decision latency | avg: %.1fms max: %.1fms", cam->label,
+                cam->latency * 1000.0 / n, cam->max_latency * 1000.0);
+        log_event(buffer);
+        //only the detection thread is counted, the kernel workers, capture and
+        //recorder threads and frames that raised an event are not
+        if (heap_stats_enabled())
+            sprintf(buffer, "%sHeap allocations on the detection thread | warm-up: %lu | "
+                    "quiet frames: %lu over %lu frames (event frames not counted) | process total: %lu",
+                    cam->label, cam->warmup_allocs, cam->steady_allocs, cam->steady_frames,
+                    heap_total_allocs());
+        else
+            sprintf(buffer, "%sHeap allocations not counted, build with make heapstats", cam->label);
+        log_event(buffer);
     }
     
-    free(black);
-    
-    puts("Training complete, system is now active.");
-    
-    //enter loop
-    while (running) {
-        
-        //take change image
-        if (capture_img("/tmp/motdecimg.bmp") != 0) {
-            log_error("Error: Error capturing image.");
-            printf("Error no: %d", errno);
-            free(bg);
-            free(change);
-            free(segmap);
-            break;
-        }
-        
-        //load change image
-        change = load_BMP("/tmp/motdecimg.bmp");
-        if (!change) {
-            log_error("Error: Unable to load change image.");
-            free_BMP(change);
+    //frames the scheduler dropped and deadlines it couldn't keep
+    if (cam->sched && cam->sched->processed > 0) {
+        sprintf(buffer, "%sScheduler | Skipped: %lu | Coalesced: %lu | Deadline misses: %lu (%.1f%%) | Idle periods: %lu",
+                cam->label, cam->sched->skipped, cam->sched->coalesced, cam->sched->missed,
+                cam->sched->missed * 100.0 / cam->sched->processed, cam->sched->idle_periods);
+        log_event(buffer);
+    }
+    free_frame_scheduler(cam->sched);
+    cam->sched = NULL;
+    free_entity_store(cam->entstore);
+    cam->entstore = NULL;
+
+    if (cam->model)
+        free_gaussian_model(cam->model);
+    free_luma_model(cam->lmodel);
+    cam->model = NULL;
+    cam->lmodel = NULL;
+
+    pthread_mutex_destroy(&cam->stats_lock);
+    if (cam->conf && cam->conf != conf)
+        free_conf(cam->conf);
+    cam->conf = NULL;
+}
+
+//pool callback, 1 if the camera has a frame waiting or its capture has stopped
+int camera_ready(void *arg) {
+    struct Camera *cam = arg;
+    return ring_waiting(cam->ring) > 0 || ring_is_closed(cam->ring);
+}
+
+//pool callback, runs detection on the camera's oldest waiting frame
+//returns 1 if a frame was processed, 0 if none was waiting and -1 once the camera's
+//capture has stopped
+int detect_camera_frame(void *arg) {
+    struct Camera *cam = arg;
+    struct SysConfig *cc = cam->conf;
+    struct StageTimes *st = &cam->stage_times;
+    struct Frame *frame;
+    struct BMP *bg, *change;
+    struct Gray8 *lbg;
+    struct Mask1 *segmap;
+    struct FrameRingStats ring_stats;
+    struct ShmStats shm_stats;
+    unsigned int imgw, imgh;
+    char buffer[255], segmappath[256];
+    double stage_start, started, latency;
+    unsigned long allocs;
+    int ret, quiet;
+
+    segmap = NULL;
+    segmappath[0] = '\0';
+    imgw = cam->source->width;
+    imgh = cam->source->height;
+
+    //take change image from the capture thread, skipping any the scheduler drops
+    frame = ring_acquire_read(cam->ring, 0);
+    while (frame) {
+        pthread_mutex_lock(&cam->stats_lock);
+        ret = sched_take(cam->sched, frame->capture_time,
+                         ring_waiting(cam->ring), get_monotonic_time());
+        pthread_mutex_unlock(&cam->stats_lock);
+        if (ret == SCHED_PROCESS)
             break;
+        ring_release_read(cam->ring, frame);
+        frame = ring_acquire_read(cam->ring, 0);
+    }
+    if (!frame) {
+        //capture thread stops at the end of a recording or on errors
+        if (ring_is_closed(cam->ring) && ring_waiting(cam->ring) == 0) {
+            if (cam->source_finished) {
+                sprintf(buffer, "%sFrame source finished.", cam->label);
+                log_event(buffer);
+            } else {
+                sprintf(buffer, "%sError: Unable to capture change image.", cam->label);
+                log_error(buffer);
+            }
+            return -1;
         }
+        return 0;
+    }
+    change = frame->img;
+    started = get_monotonic_time();
+    allocs = heap_thread_allocs();
+    quiet = 1;
+
+    //check for motion
+    long pixel_change_count;
+    double change_percent;
+    struct Pixel p;
+
+    pixel_change_count = 0L;
+    change_percent = 0.0;
+
+    //generate segmap, a one bit mask from the pool whichever model is used
+    //with a frame pending, the model is updated with it in the same pass, each pixel
+    //before it is segmented, so this frame still sees every frame before it
+    stage_start = get_monotonic_time();
+    segmap = pool_get_mask1(bufpool, imgw, imgh);
+    if (!segmap)
+        ret = 0;
+    else if (cam->pending && cc->luma_only)
+        ret = update_segment_luma_model_mask1_thr(cam->lmodel, cam->pending->luma, cam->pending_segmap,
+                                                  frame->luma, segmap);
+    else if (cam->pending)
+        ret = update_segment_gaussian_model_mask1_thr(cam->model, cam->pending->img, cam->pending_segmap,
+                                                      change, segmap);
+    else if (cc->luma_only)
+        ret = segment_luma_model_mask1_thr(cam->lmodel, frame->luma, segmap);
+    else
+        ret = segment_gaussian_model_mask1_thr(cam->model, change, segmap);
+    st->segment += get_monotonic_time() - stage_start;
+    if (cam->pending) {
+        pool_put_mask1(bufpool, cam->pending_segmap);
+        ring_release_read(cam->ring, cam->pending);
+        cam->pending = NULL;
+        cam->pending_segmap = NULL;
+    }
+    if (!ret) {
+        sprintf(buffer, "%sError: Unable to generate segmap.", cam->label);
+        log_error(buffer);
+        pool_put_mask1(bufpool, segmap);
+        ring_release_read(cam->ring, frame);
+        return -1;
+    }
+    
+    if (cc->do_ent_filtering && cam->entstore) {
+        stage_start = get_monotonic_time();
+        filter_entities_mask1(segmap, cam->filter, cam->entstore);
+        st->filter += get_monotonic_time() - stage_start;
+    }
+            
+    //count foreground pixels, a popcount over the mask's words
+    stage_start = get_monotonic_time();
+    pixel_change_count = count_mask1(segmap);
+    st->count += get_monotonic_time() - stage_start;
+    
+    //calculate change percent and compare to threshold
+    change_percent = (double) ((double) pixel_change_count / (double) (imgw * imgh));
+    if (change_percent > cc->change_percent_threshold) {
+        pthread_mutex_lock(&cam->stats_lock);
+        cam->events++;
+        pthread_mutex_unlock(&cam->stats_lock);
+    }
+    
+    //publish the frame and its segmap together, readers never see a mismatched pair
+    if (cam->shmpub) {
+        shm_begin(cam->shmpub);
+        if (cc->luma_only)
+            shm_put_frame_gray8(cam->shmpub, frame->luma);
+        else
+            shm_put_frame(cam->shmpub, change);
+        shm_put_segmap_mask1(cam->shmpub, segmap);
+        ring_stats = get_ring_stats(cam->ring);
+        shm_stats.frame_seq = frame->seq;
+        shm_stats.capture_time = frame->capture_time;
+        shm_stats.pixel_change_count = pixel_change_count;
+        shm_stats.change_percent = change_percent;
+        shm_stats.motion = change_percent > cc->change_percent_threshold;
+        shm_stats.fps = st->frames / (get_monotonic_time() - st->start);
+        shm_stats.frames_captured = ring_stats.captured;
+        shm_stats.frames_dropped = ring_stats.dropped;
+        shm_stats.events = cam->events;
+        shm_end(cam->shmpub, &shm_stats);
+        if (cam->mjpegsrv)
+            mjpeg_notify(cam->mjpegsrv);
+    }
+            
+    if (change_percent > cc->change_percent_threshold) {
+        quiet = 0;
         
-        //check for motion
-        long pixel_change_count;
-        double change_percent;
-        struct Pixel p;
-        
-        pixel_change_count = 0L;
-        change_percent = 0.0;
-        
-        //generate segmap
-        segmap = generate_gaussian_seg_map_thr(model, change);
+        //get timestamp
+        char *fullts, *datets, *timets;
+        char timetsdir[200], imgpath[256], videopath[256];
         
-        if (conf->do_ent_filtering) {
-            filter_entities(segmap, filter, 0);
-        }
-                
-        //count foreground pixels
-        pixel_change_count = count_pixels_thr(segmap, make_pixel(255,255,255));
+        fullts = get_full_timestamp();
+        datets = get_date_timestamp();
+        timets = get_time_timestamp();
         
-        //calculate change percent and compare to threshold
-        change_percent = (double) ((double) pixel_change_count / (double) (imgw * imgh));
-                
-        if (change_percent > conf->change_percent_threshold) {
-            
-            //get timestamp
-            char *fullts, *datets, *timets, *datetsdir, *timetsdir;
-            
-            fullts = get_full_timestamp();
-            datets = get_date_timestamp();
-            timets = get_time_timestamp();
-            datetsdir = malloc(strlen(datets) + strlen(conf->logs_path) + 2);
-            if (!datetsdir) {
-                printf("Error: Memory Error.");
-                break;
-            }
-            strcpy(datetsdir, conf->logs_path);
-            strcat(datetsdir, datets);
-            
-            //create datestamped folder for event
-            if (mkdir(datetsdir, 0777) != 0) {
-                //check if fail because folder exists
-                if (errno != EEXIST) {
-                    log_error("Error: Unable to make new folder for motion event.");
-                    free_BMP(bg);
-                    free_BMP(change);
-                    free_BMP(segmap);
-                    free(fullts);
-                    free(datets);
-                    free(timets);
-                    free(datetsdir);
-                    free(timetsdir);
-                    break;
-                }
-            }
-            
-            timetsdir = malloc(strlen(datetsdir) + 100);
-            if (!datetsdir) {
-                printf("Error: Memory Error.");
-                break;
-            }
-            strcpy(timetsdir, datetsdir);
-            strcat(timetsdir, "/");
-            strcat(timetsdir, timets);
-            
-            //create timestamped folder for event
-            if (mkdir(timetsdir, 0777) != 0) {
-                //check if fail because folder exists
-                if (errno != EEXIST) {
-                    log_error("Error: Unable to make new folder for motion event.");
-                    free_BMP(bg);
-                    free_BMP(change);
-                    free_BMP(segmap);
-                    free(fullts);
-                    free(datets);
-                    free(timets);
-                    free(datetsdir);
-                    free(timetsdir);
-                    break;
-                }
-            }
-            
-            //check for raw_img_output
-            if (conf->raw_img_output) {
-                char *bgdir, *changedir;
-                //generate background
-                bg = generate_gaussian_background_thr(model);
-                
-                bgdir = malloc(strlen(timetsdir) + 100);
-                changedir = malloc(strlen(timetsdir) + 100);
-                strcpy(bgdir, timetsdir);
-                strcpy(changedir, timetsdir);
-                strcat(bgdir, "/bg.bmp");
-                strcat(changedir, "/change.bmp");
-                if (!save_BMP(bg, bgdir) ||
-                    !save_BMP(change, changedir)){
-                    log_error("Error: Unable to save raw images.");
-                    free_BMP(bg);
-                    free_BMP(change);
-                    free_BMP(segmap);
-                    free(fullts);
-                    free(datets);
-                    free(timets);
-                    free(datetsdir);
-                    free(timetsdir);
-                    break;
-                }
-                free(bgdir);
-                free(changedir);
-                free_BMP(bg);
-            }
+        //folders for the event are made by the writers, off this thread
+        //cameras share the logs directory, their events are told apart by index
+        if (num_cameras > 1)
+            snprintf(timetsdir, sizeof(timetsdir), "%s%s/%s-cam%d", conf->logs_path, datets, timets, cam->index);
+        else
+            snprintf(timetsdir, sizeof(timetsdir), "%s%s/%s", conf->logs_path, datets, timets);
         
-            //check for segmap_img_output (same a seg map)
-            if (conf->segmap_img_output) {
-                char *motdir;
-                motdir = malloc(strlen(timetsdir) + 100);
-                strcpy(motdir, timetsdir);
-                strcat(motdir, "/segmap.bmp");
-                if (!save_BMP(segmap, motdir)){
-                    log_error("Error: Unable to save segentation map image.");
-                    free_BMP(bg);
-                    free_BMP(change);
-                    free_BMP(segmap);
-                    free(fullts);
-                    free(datets);
-                    free(timets);
-                    free(datetsdir);
-                    free(timetsdir);
-                    break;
-                }
-                free(motdir);
+        //check for raw_img_output
+        if (cc->raw_img_output) {
+            //generate background, the writer owns it from here
+            if (cc->luma_only) {
+                lbg = generate_luma_background_thr(cam->lmodel);
+                bg = lbg ? gray8_to_BMP(lbg) : NULL;
+                free_gray8(lbg);
+            } else {
+                bg = generate_gaussian_background_thr(cam->model);
             }
+            snprintf(imgpath, sizeof(imgpath), "%s/bg.bmp", timetsdir);
+            submit_artifact(artwriter, bg, imgpath);
             
-            //log event to stdout
-            log_motion_event(fullts, pixel_change_count, change_percent);
-            
-            //record event
-            char videopath[256];
-            strcpy(videopath, timetsdir);
-            strcat(videopath, "/");
-            strcat(videopath, "output.mp4");
-            printf("\nCAPTURING VIDEO PLEASE WAIT 15s\n");
-            capture_video(videopath);
-            printf("Video output to: %s\nResuming system...\n\n", videopath);
-            
-            free(fullts);
-            free(datets);
-            free(timets);
-            free(datetsdir);
-            free(timetsdir);
+            //change image goes back to the capture thread, the writer gets a copy
+            snprintf(imgpath, sizeof(imgpath), "%s/change.bmp", timetsdir);
+            submit_artifact(artwriter,
+                            cc->luma_only ? gray8_to_BMP(frame->luma) : clone_BMP(change),
+                            imgpath);
+        }
+    
+        //check for segmap_img_output (same a seg map), submitted once the model is updated
+        if (cc->segmap_img_output) {
+            snprintf(segmappath, sizeof(segmappath), "%s/segmap.bmp", timetsdir);
         }
         
-        //print_mixture(model, 1, 1);
-        //update model with newest image
-        update_gaussian_model_thr(model, change, segmap);
-        normalize_priors_thr(model);
+        //log event to stdout
+        log_motion_event(fullts, cam->label, pixel_change_count, change_percent);
         
-        //free created images
-        free_BMP(change);
-        free_BMP(segmap);
-        //break;
+        //record event, clips are written in the background
+        snprintf(videopath, sizeof(videopath), "%s/output.mp4", timetsdir);
+        ret = recorder_trigger(cam->recorder, videopath);
+        if (ret == REC_STARTED) {
+            printf("%sRecording video to: %s\n", cam->label, videopath);
+        } else if (ret == REC_EXTENDED) {
+            printf("%sEvent added to the current recording.\n", cam->label);
+        } else {
+            sprintf(buffer, "%sError: Unable to record event, recording limit reached.", cam->label);
+            log_error(buffer);
+        }
+        
+        free(fullts);
+        free(datets);
+        free(timets);
     }
     
-    free_gaussian_model(model);
-    log_event("Stopping motdec...");
-    set_motdec_info(0);
+    //print_mixture(cam->model, 1, 1);
+    //update model with newest image, or keep it for the next frame's pass to, the
+    //background of an event above was generated before either
+    stage_start = get_monotonic_time();
+    if (cc->pipeline_update) {
+        cam->pending = frame;
+        cam->pending_segmap = segmap;
+    } else if (cc->luma_only) {
+        update_luma_model_mask1_thr(cam->lmodel, frame->luma, segmap);
+    } else {
+        update_gaussian_model_mask1_thr(cam->model, change, segmap);
+        normalize_priors_thr(cam->model);
+    }
+    st->update += get_monotonic_time() - stage_start;
+    pthread_mutex_lock(&cam->stats_lock);
+    st->frames++;
+    pthread_mutex_unlock(&cam->stats_lock);
+    
+    //the mask is only unpacked to a BMP if the event saves it, the mask goes back to the pool
+    //unless it is pending
+    if (segmappath[0] != '\0') {
+        submit_artifact(artwriter, mask1_to_BMP(segmap), segmappath);
+        segmappath[0] = '\0';
+    }
+    if (!cam->pending)
+        pool_put_mask1(bufpool, segmap);
+    segmap = NULL;
+    
+    //decision made, capture time to now is what the camera's viewer waits
+    latency = get_monotonic_time() - frame->capture_time;
+    pthread_mutex_lock(&cam->stats_lock);
+    cam->latency += latency;
+    if (latency > cam->max_latency)
+        cam->max_latency = latency;
+    ret = sched_done(cam->sched, frame->capture_time, change_percent,
+                     started, get_monotonic_time());
+    pthread_mutex_unlock(&cam->stats_lock);
+    
+    //the rate steps down while nothing moves and back up on the first change
+    if (ret != SCHED_STEADY)
+        quiet = 0;
+    if (ret == SCHED_STEPPED_DOWN) {
+        sprintf(buffer, "%sScene static, detecting at %d fps", cam->label, cc->idle_fps);
+        log_event(buffer);
+    } else if (ret == SCHED_STEPPED_UP) {
+        if (cc->target_fps > 0)
+            sprintf(buffer, "%sChange seen, detecting at %d fps", cam->label, cc->target_fps);
+        else
+            sprintf(buffer, "%sChange seen, detecting on every frame", cam->label);
+        log_event(buffer);
+    }
+    
+    //allocations on this thread for the frame, only quiet frames are expected to make none
+    allocs = heap_thread_allocs() - allocs;
+    pthread_mutex_lock(&cam->stats_lock);
+    if (st->frames <= WARMUP_FRAMES) {
+        cam->warmup_allocs += allocs;
+    } else if (quiet) {
+        cam->steady_allocs += allocs;
+        cam->steady_frames++;
+    }
+    pthread_mutex_unlock(&cam->stats_lock);
+    
+    //hand frame back to capture thread, a pending frame goes back after the next pass
+    if (!cam->pending)
+        ring_release_read(cam->ring, frame);
+    
+    return 1;
 }
 
+
 //log event to common log file
 void log_motion_event(char *timestamp,
+                      char *label,
                       long pixel_change_count,
                       double change_percent) {
     FILE *file;
     char buffer [255];
-    sprintf(buffer, "%s | Pixels Changed: %lu | Change Percentage: %4.2f\n", timestamp, pixel_change_count, (change_percent * 100));
+    sprintf(buffer, "%s | %sPixels Changed: %lu | Change Percentage: %4.2f\n", timestamp, label, pixel_change_count, (change_percent * 100));
     file = fopen(conf->logfile_path, "a+");
     fputs(buffer, file);
     printf("%s", buffer);
@@ -562,13 +1482,14 @@ void log_event(char *evstring) {
 //returns the current date-time as yyyy.mm.dd-hh:mm:ss
 char *get_full_timestamp() {
     time_t rt;
-    struct tm * ti;
+    struct tm tm, *ti;
     char *timestamp, buffer[50];
     int len;
 
     //get raw time and convert to a time info struct
     time(&rt);
-    ti = localtime(&rt);
+    //cameras log from several threads, localtime's buffer is shared
+    ti = localtime_r(&rt, &tm);
     
     //format time string with mkdir command
     sprintf(buffer,
@@ -591,13 +1512,14 @@ char *get_full_timestamp() {
 //returns the current date as yyyy.mm.dd
 char *get_date_timestamp() {
     time_t rt;
-    struct tm * ti;
+    struct tm tm, *ti;
     char *timestamp, buffer[50];
     int len;
 
     //get raw time and convert to a time info struct
     time(&rt);
-    ti = localtime(&rt);
+    //cameras log from several threads, localtime's buffer is shared
+    ti = localtime_r(&rt, &tm);
     
     //format time string with mkdir command
     sprintf(buffer,
@@ -617,13 +1539,14 @@ char *get_date_timestamp() {
 //returns the current time as hh:mm:ss
 char *get_time_timestamp() {
     time_t rt;
-    struct tm * ti;
+    struct tm tm, *ti;
     char *timestamp, buffer[50];
     int len;
 
     //get raw time and convert to a time info struct
     time(&rt);
-    ti = localtime(&rt);
+    //cameras log from several threads, localtime's buffer is shared
+    ti = localtime_r(&rt, &tm);
     
     //format time string with mkdir command
     sprintf(buffer,
@@ -640,107 +1563,130 @@ char *get_time_timestamp() {
     return timestamp;
 }
 
-//capture image through fork using ffmpeg
-int capture_img(char *filename) {
-    pid_t pid = fork();
-    char *args[14];
-    
-    //TODO should sanitize filename
-    
-    // ffmpeg args
-    args[0] = conf->ffmpeg_path;
-    //-y -loglevel panic
-    args[1] = "-y";
-    args[2] = "-loglevel";
-    args[3] = "panic";
-    // -f video4linux2 
-    args[4] = "-f";
-    args[5] = "video4linux2";
-    // -i
-    args[6] = "-i";
-    // copy given video device to args list
-    args[7] = conf->video_device;
-    // -vframes 2 
-    args[8] = "-vframes";
-    args[9] = "1";
-    // -s
-    args[10] = "-s";
-    // copy given resolution to args list
-    args[11] = conf->resolution;
-    // /tmp/img.bmp
-    args[12] = filename;
-    args[13] = (char *) NULL;
-    
-    //fork error return
-    if (pid == -1) {
-        return -2;
-    //parent - wait
-    } else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
-        return status;
-    //child - exec
-    } else {
-        execv(conf->ffmpeg_path, args);
-        _exit(EXIT_FAILURE);
+//opens the frame source selected by the camera's capture_mode
+//returns 1 on success
+int open_capture(struct Camera *cam) {
+    cam->source = open_frame_source(cam->conf);
+    return cam->source != NULL;
+}
+
+//closes the frame source opened by open_capture
+void close_capture(struct Camera *cam) {
+    struct V4L2Capture *v4l2;
+    char buffer[255];
+
+    if (cam->source) {
+        if (cam->source->type == SOURCE_V4L2) {
+            v4l2 = cam->source->impl;
+            if (v4l2->lost_buffers > 0) {
+                sprintf(buffer, "%sError: %lu of %d capture buffers could not be given back to the driver.",
+                        cam->label, v4l2->lost_buffers, v4l2->buffer_count);
+                log_error(buffer);
+            }
+        }
+        close_frame_source(cam->source);
+        cam->source = NULL;
     }
-    
-    return 0;
 }
 
-//capture 15 second of video through fork using ffmpeg
-int capture_video(char *filename) {
+//starts the camera's capture thread filling its frame ring
+//returns 1 on success
+int start_capture_thread(struct Camera *cam) {
+    if (cam->capture_thread_running)
+        return 1;
+    //reopen the ring in case a previous stop closed it
+    atomic_store(&cam->ring->closed, 0);
+    if (pthread_create(&cam->capture_tid, NULL, do_capture, cam) != 0)
+        return 0;
+    cam->capture_thread_running = 1;
+    return 1;
+}
 
-    pid_t pid = fork();
-    char *args[16];
-    
-    //TODO should sanitize filename
+//stops the camera's capture thread and waits for it to finish
+void stop_capture_thread(struct Camera *cam) {
+    if (!cam->capture_thread_running)
+        return;
+    ring_close(cam->ring);
+    pthread_join(cam->capture_tid, NULL);
+    cam->capture_thread_running = 0;
+}
+
+//capture thread, fills frames from the camera's ring until the ring is closed
+void *do_capture(void *arg) {
+    struct Camera *cam = arg;
+    struct FrameRing *ring = cam->ring;
+    struct Frame *frame;
+    unsigned long seq;
+    double start;
+    int failures, ret;
     
-    // ffmpeg args
-    args[0] = conf->ffmpeg_path;
-    //-y -loglevel panic
-    args[1] = "-y";
-    args[2] = "-loglevel";
-    args[3] = "panic";
-    //-framerate 20
-    args[4] = "-framerate";
-    args[5] = "20";
-    //-video_size
-    args[6] = "-video_size";
-    args[7] = conf->resolution;
-    //-t 60
-    args[8] = "-t";
-    args[9] = "15";
-    // -i videodevice
-    args[10] = "-i";
-    args[11] = conf->video_device;
-    //-movflags faststart
-    args[12] = "-movflags";
-    args[13] = "+faststart";
-    // logs/date/timevideopath.mp4
-    args[14] = filename;
-    args[15] = (char *) NULL;
+    seq = 0;
+    failures = 0;
     
-    //fork error return
-    if (pid == -1) {
-        return -2;
-    //parent - wait
-    } else if (pid > 0) {
-        int status;
-        waitpid(pid, &status, 0);
-        return status;
-    //child - exec
-    } else {
-        execv(conf->ffmpeg_path, args);
-        _exit(EXIT_FAILURE);
+    while (!ring_is_closed(ring)) {
+        frame = ring_acquire_write(ring);
+        if (!frame)
+            break;
+        
+        start = get_monotonic_time();
+        if (cam->conf->luma_only)
+            ret = read_frame_source_luma(cam->source, frame->luma);
+        else
+            ret = read_frame_source(cam->source, frame->img);
+        cam->stage_times.capture += get_monotonic_time() - start;
+        
+        if (ret == SOURCE_END) {
+            ring_return_write(ring, frame);
+            cam->source_finished = 1;
+            break;
+        } else if (ret == 0) {
+            //hand frame back to the ring, try again
+            ring_return_write(ring, frame);
+            if (++failures >= CAPTURE_RETRIES)
+                break;
+            continue;
+        }
+        failures = 0;
+        
+        frame->seq = seq++;
+        frame->capture_time = get_monotonic_time();
+        
+        //clips being recorded follow the newest frame
+        recorder_push_frame(cam->recorder, frame);
+        
+        ring_publish(ring, frame);
+        detect_pool_notify(pool);
     }
     
-    return 0;
+    //wake the detector if we stopped on an error
+    ring_close(ring);
+    detect_pool_notify(pool);
+    return NULL;
+}
+
+//writes the shared memory name camera index publishes its live view in
+//camera 0 keeps the name a single camera has always used
+void camera_shm_name(int index,
+                     char *name) {
+    if (index == 0)
+        strcpy(name, SHM_NAME);
+    else
+        sprintf(name, "%s%d", SHM_NAME, index);
 }
 
 //sets tmp/motdec.info 
+//the first camera's live view and counters are at the top level, where the web
+//interface reads them, every camera's are listed after
 void set_motdec_info(int running) {
     FILE *fp;
+    struct FrameRingStats stats;
+    struct Camera *cam;
+    char exe[256], shm_name[64];
+    ssize_t len;
+    unsigned long frames, events, skipped, coalesced, missed, steady_allocs, steady_frames;
+    double latency, max_latency, elapsed;
+    int idle;
+    int i;
     
     //open file
     fp = fopen("/tmp/motdec.info", "w+");
@@ -757,6 +1703,79 @@ void set_motdec_info(int running) {
     }
     fprintf(fp, "<logfile>%s</logfile>", conf->logfile_path);
     fprintf(fp, "<logsdir>%s</logsdir>", conf->logs_path);
+    cam = num_cameras > 0 ? &cameras[0] : NULL;
+    if (cam && cam->shmpub) {
+        //the web interface runs 'bin snapshot' to read the live view
+        fprintf(fp, "<shm>%s</shm>", SHM_NAME);
+        len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+        if (len > 0) {
+            exe[len] = '\0';
+            fprintf(fp, "<bin>%s</bin>", exe);
+        }
+    }
+    if (cam && cam->mjpegsrv) {
+        fprintf(fp, "<stream_port>%d</stream_port>", cam->mjpegsrv->port);
+    }
+    if (cam && cam->ring) {
+        stats = get_ring_stats(cam->ring);
+        fprintf(fp, "<frames_captured>%lu</frames_captured>", stats.captured);
+        fprintf(fp, "<frames_dropped>%lu</frames_dropped>", stats.dropped);
+        fprintf(fp, "<ring_occupancy>%d</ring_occupancy>", stats.occupancy);
+        fprintf(fp, "<ring_peak_occupancy>%d</ring_peak_occupancy>", stats.peak_occupancy);
+    }
+    if (artwriter) {
+        fprintf(fp, "<artifacts_written>%lu</artifacts_written>", artwriter->written);
+        fprintf(fp, "<artifacts_dropped>%lu</artifacts_dropped>", artwriter->dropped);
+        fprintf(fp, "<artifact_queue_peak>%d</artifact_queue_peak>", artwriter->peak_count);
+    }
+    if (cam && cam->recorder) {
+        fprintf(fp, "<recorder_memory>%ld</recorder_memory>", recorder_memory(cam->recorder));
+    }
+    for (i = 0; i < num_cameras; i++) {
+        cam = &cameras[i];
+        if (!cam->ring)
+            continue;
+        pthread_mutex_lock(&cam->stats_lock);
+        frames = cam->stage_times.frames;
+        events = cam->events;
+        latency = cam->latency;
+        max_latency = cam->max_latency;
+        skipped = cam->sched ? cam->sched->skipped : 0;
+        coalesced = cam->sched ? cam->sched->coalesced : 0;
+        missed = cam->sched ? cam->sched->missed : 0;
+        idle = cam->sched ? cam->sched->idle : 0;
+        steady_allocs = cam->steady_allocs;
+        steady_frames = cam->steady_frames;
+        pthread_mutex_unlock(&cam->stats_lock);
+        stats = get_ring_stats(cam->ring);
+        elapsed = get_monotonic_time() - cam->stage_times.start;
+        
+        fprintf(fp, "<camera>");
+        fprintf(fp, "<index>%d</index>", i);
+        if (cam->shmpub) {
+            camera_shm_name(i, shm_name);
+            fprintf(fp, "<shm>%s</shm>", shm_name);
+        }
+        if (cam->mjpegsrv)
+            fprintf(fp, "<stream_port>%d</stream_port>", cam->mjpegsrv->port);
+        fprintf(fp, "<frames_captured>%lu</frames_captured>", stats.captured);
+        fprintf(fp, "<frames_dropped>%lu</frames_dropped>", stats.dropped);
+        fprintf(fp, "<frames_processed>%lu</frames_processed>", frames);
+        fprintf(fp, "<fps>%.2f</fps>", frames > 0 ? frames / elapsed : 0.0);
+        fprintf(fp, "<latency_ms>%.1f</latency_ms>", frames > 0 ? latency * 1000.0 / frames : 0.0);
+        fprintf(fp, "<max_latency_ms>%.1f</max_latency_ms>", max_latency * 1000.0);
+        fprintf(fp, "<events>%lu</events>", events);
+        fprintf(fp, "<frames_skipped>%lu</frames_skipped>", skipped);
+        fprintf(fp, "<frames_coalesced>%lu</frames_coalesced>", coalesced);
+        fprintf(fp, "<deadline_misses>%lu</deadline_misses>", missed);
+        fprintf(fp, "<idle>%s</idle>", idle ? "true" : "false");
+        //heap allocations made detecting quiet frames, counted only with HEAP_STATS
+        if (heap_stats_enabled()) {
+            fprintf(fp, "<quiet_frames>%lu</quiet_frames>", steady_frames);
+            fprintf(fp, "<quiet_frame_heap_allocs>%lu</quiet_frame_heap_allocs>", steady_allocs);
+        }
+        fprintf(fp, "</camera>");
+    }
     fprintf(fp, "</info>");
     //close file
     fclose(fp);
@@ -767,3 +1786,75 @@ void sighandler(int sig) {
     printf("\nSignal caught\n");
     running = 0;
 }
+
+//writes the newest live snapshot of a running motdec's camera to stdout
+//what is 'frame' or 'segmap', written as BMP files, or 'stats', written as xml
+//returns 1 on success
+int print_snapshot(char *what,
+                   int camera) {
+    struct ShmReader *rd;
+    struct ShmStats stats;
+    struct Gray8 segmap;
+    struct BMP *bmp;
+    unsigned char *frame, *seg;
+    char shm_name[64];
+    int ret, ok;
+
+    camera_shm_name(camera, shm_name);
+    rd = open_shm_reader(shm_name);
+    if (!rd) {
+        fputs("Error: motdec is not publishing a live view\n", stderr);
+        return 0;
+    }
+
+    frame = malloc(rd->header->frame_size);
+    seg = malloc(rd->header->segmap_size);
+    if (!frame || !seg) {
+        free(frame);
+        free(seg);
+        close_shm_reader(rd);
+        return 0;
+    }
+
+    ret = read_shm_snapshot(rd, frame, seg, &stats);
+    ok = 0;
+    if (ret == 1) {
+        ok = 1;
+        if (strcmp(what, "frame") == 0) {
+            //already a complete BMP file
+            ok = fwrite(frame, rd->header->frame_size, 1, stdout) == 1;
+        } else if (strcmp(what, "segmap") == 0) {
+            segmap.width = rd->header->width;
+            segmap.height = rd->header->height;
+            segmap.pixel_data = seg;
+            bmp = gray8_to_BMP(&segmap);
+            ok = bmp && save_BMP(bmp, "/dev/stdout");
+            if (bmp)
+                free_BMP(bmp);
+        } else if (strcmp(what, "stats") == 0) {
+            printf("<?xml version='1.0'?>");
+            printf("<stats>");
+            printf("<frame_seq>%lu</frame_seq>", stats.frame_seq);
+            printf("<pixel_change_count>%ld</pixel_change_count>", stats.pixel_change_count);
+            printf("<change_percent>%.4f</change_percent>", stats.change_percent);
+            printf("<motion>%s</motion>", stats.motion ? "true" : "false");
+            printf("<fps>%.2f</fps>", stats.fps);
+            printf("<frames_captured>%lu</frames_captured>", stats.frames_captured);
+            printf("<frames_dropped>%lu</frames_dropped>", stats.frames_dropped);
+            printf("<events>%lu</events>", stats.events);
+            printf("</stats>");
+        } else {
+            fputs("Error: snapshot must be frame, segmap or stats\n", stderr);
+            ok = 0;
+        }
+    } else if (ret == -1) {
+        fputs("Error: no frame has been published yet\n", stderr);
+    } else {
+        fputs("Error: live view is changing too quickly to read\n", stderr);
+    }
+
+    free(frame);
+    free(seg);
+    close_shm_reader(rd);
+    return ok;
+}